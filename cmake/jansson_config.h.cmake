@@ -71,4 +71,11 @@
    This limits the depth of e.g. array-within-array constructions. */
 #define JSON_PARSER_MAX_DEPTH 2048
 
+/* Integers in this range that the decoders return with the
+   JSON_SHARE_INTEGERS flag are shared, immortal values, so decoding
+   them allocates nothing. Set the maximum below the minimum to turn
+   the flag off. */
+#define JSON_SMALL_INTEGER_MIN (-128)
+#define JSON_SMALL_INTEGER_MAX 1023
+
 #endif
@@ -1,6 +1,7 @@
 #cmakedefine HAVE_ENDIAN_H 1
 #cmakedefine HAVE_FCNTL_H 1
 #cmakedefine HAVE_SCHED_H 1
+#cmakedefine HAVE_PTHREAD_H 1
 #cmakedefine HAVE_UNISTD_H 1
 #cmakedefine HAVE_SYS_PARAM_H 1
 #cmakedefine HAVE_SYS_STAT_H 1
@@ -17,6 +18,7 @@
 
 #cmakedefine HAVE_SYNC_BUILTINS 1
 #cmakedefine HAVE_ATOMIC_BUILTINS 1
+#cmakedefine HAVE___THREAD 1
 
 #cmakedefine HAVE_LOCALE_H 1
 #cmakedefine HAVE_SETLOCALE 1
@@ -49,5 +51,8 @@
 
 #cmakedefine USE_URANDOM 1
 #cmakedefine USE_WINDOWS_CRYPTOAPI 1
+#cmakedefine USE_POOL_ALLOC 1
+#cmakedefine USE_HASH_SIPHASH 1
+#cmakedefine USE_HASH_LOOKUP3 1
 
 #define INITIAL_HASHTABLE_ORDER @JANSSON_INITIAL_HASHTABLE_ORDER@
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* Region allocation for values that share one lifetime.
+
+   Memory is handed out from large chunks by bumping a pointer and is
+   never freed piece by piece; json_arena_reset() drops it all at once.
+   Values created in an arena are immortal (refcount (size_t)-1), so
+   json_decref() never reaches json_delete() for them. */
+
+#include <string.h>
+
+#include "bosjansson.h"
+#include "jansson_private.h"
+
+#define ARENA_DEFAULT_CHUNK_SIZE  (64 * 1024)
+
+/* Allocations larger than this get a chunk of their own */
+#define ARENA_LARGE(arena)  ((arena)->chunk_size / 4)
+
+typedef union {
+    double real;
+    json_int_t integer;
+    void *pointer;
+    size_t size;
+} arena_align_t;
+
+#define ARENA_ALIGN  sizeof(arena_align_t)
+#define ARENA_ROUND(size_)  (((size_) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+} arena_chunk_t;
+
+#define ARENA_HEADER  ARENA_ROUND(sizeof(arena_chunk_t))
+#define chunk_data(chunk_)  ((char *)(chunk_) + ARENA_HEADER)
+
+/* The containers of an arena, for releasing the values from outside
+   the arena that they hold */
+typedef struct arena_container {
+    json_t *json;
+    struct arena_container *next;
+} arena_container_t;
+
+struct json_arena {
+    arena_chunk_t *chunks;  /* the chunk being filled comes first */
+    char *pos;
+    char *end;
+    size_t chunk_size;
+    arena_container_t *containers;
+    int external;           /* a container holds a value from outside */
+};
+
+json_arena_t *json_arena_create(size_t chunk_size)
+{
+    json_arena_t *arena = jsonp_malloc(sizeof(json_arena_t));
+    if(!arena)
+        return NULL;
+
+    if(chunk_size < 256)
+        chunk_size = ARENA_DEFAULT_CHUNK_SIZE;
+
+    arena->chunks = NULL;
+    arena->pos = NULL;
+    arena->end = NULL;
+    arena->chunk_size = ARENA_ROUND(chunk_size);
+    arena->containers = NULL;
+    arena->external = 0;
+    return arena;
+}
+
+static void *arena_alloc_chunk(json_arena_t *arena, size_t size)
+{
+    arena_chunk_t *chunk;
+
+    if(size > (size_t)-1 - ARENA_HEADER)
+        return NULL;
+
+    if(size > ARENA_LARGE(arena)) {
+        /* Put it behind the current chunk so that the free space left
+           there is still used */
+        chunk = jsonp_malloc(ARENA_HEADER + size);
+        if(!chunk)
+            return NULL;
+
+        chunk->size = size;
+        if(arena->chunks) {
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        }
+        else {
+            chunk->next = NULL;
+            arena->chunks = chunk;
+            arena->pos = arena->end = chunk_data(chunk) + size;
+        }
+        return chunk_data(chunk);
+    }
+
+    chunk = jsonp_malloc(ARENA_HEADER + arena->chunk_size);
+    if(!chunk)
+        return NULL;
+
+    chunk->size = arena->chunk_size;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->pos = chunk_data(chunk) + size;
+    arena->end = chunk_data(chunk) + chunk->size;
+    return chunk_data(chunk);
+}
+
+void *jsonp_arena_malloc(json_arena_t *arena, size_t size)
+{
+    char *ptr;
+
+    if(!arena)
+        return jsonp_node_malloc(size);
+
+    if(!size || size > (size_t)-1 - ARENA_ALIGN)
+        return NULL;
+
+    size = ARENA_ROUND(size);
+    if(size > (size_t)(arena->end - arena->pos))
+        return arena_alloc_chunk(arena, size);
+
+    ptr = arena->pos;
+    arena->pos += size;
+    return ptr;
+}
+
+void *jsonp_arena_realloc(json_arena_t *arena, void *ptr,
+                          size_t old_size, size_t new_size)
+{
+    char *new_ptr;
+
+    if(!arena)
+        return jsonp_node_realloc(ptr, old_size, new_size);
+
+    if(!ptr)
+        return jsonp_arena_malloc(arena, new_size);
+
+    if(!new_size || new_size > (size_t)-1 - ARENA_ALIGN)
+        return NULL;
+
+    old_size = ARENA_ROUND(old_size);
+    new_size = ARENA_ROUND(new_size);
+    if(new_size <= old_size)
+        return ptr;
+
+    /* the last allocation can be extended within its chunk */
+    if((char *)ptr + old_size == arena->pos &&
+       new_size - old_size <= (size_t)(arena->end - arena->pos)) {
+        arena->pos += new_size - old_size;
+        return ptr;
+    }
+
+    new_ptr = jsonp_arena_malloc(arena, new_size);
+    if(!new_ptr)
+        return NULL;
+
+    memcpy(new_ptr, ptr, old_size);
+    return new_ptr;
+}
+
+void jsonp_arena_free(json_arena_t *arena, void *ptr, size_t size)
+{
+    /* arena memory is only released by json_arena_reset() */
+    if(!arena)
+        jsonp_node_free(ptr, size);
+}
+
+int jsonp_arena_add_container(json_arena_t *arena, json_t *json)
+{
+    arena_container_t *container;
+
+    container = jsonp_arena_malloc(arena, sizeof(arena_container_t));
+    if(!container)
+        return -1;
+
+    container->json = json;
+    container->next = arena->containers;
+    arena->containers = container;
+    return 0;
+}
+
+void jsonp_arena_hold(json_arena_t *arena)
+{
+    arena->external = 1;
+}
+
+/* Drop the references that the arena's containers hold to values
+   outside the arena */
+static void arena_release_external(json_arena_t *arena)
+{
+    arena_container_t *container;
+
+    for(container = arena->containers; container; container = container->next) {
+        json_t *json = container->json;
+
+        if(json_is_object(json)) {
+            hashtable_t *hashtable = &json_to_object(json)->hashtable;
+            void *iter;
+
+            for(iter = hashtable_iter(hashtable); iter;
+                iter = hashtable_iter_next(hashtable, iter))
+            {
+                json_decref((json_t *)hashtable_iter_value(iter));
+            }
+        }
+        else {
+            json_array_t *array = json_to_array(json);
+            size_t i;
+
+            for(i = 0; i < array->entries; i++)
+                json_decref(array->table[i]);
+        }
+    }
+}
+
+void json_arena_reset(json_arena_t *arena)
+{
+    arena_chunk_t *chunk, *next, *keep = NULL;
+
+    if(!arena)
+        return;
+
+    if(arena->external)
+        arena_release_external(arena);
+
+    /* one regular chunk is kept for the next document */
+    for(chunk = arena->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        if(!keep && chunk->size == arena->chunk_size)
+            keep = chunk;
+        else
+            jsonp_free(chunk);
+    }
+
+    arena->chunks = keep;
+    if(keep) {
+        keep->next = NULL;
+        arena->pos = chunk_data(keep);
+        arena->end = arena->pos + keep->size;
+    }
+    else
+        arena->pos = arena->end = NULL;
+
+    arena->containers = NULL;
+    arena->external = 0;
+}
+
+void json_arena_destroy(json_arena_t *arena)
+{
+    if(!arena)
+        return;
+
+    json_arena_reset(arena);
+    jsonp_free(arena->chunks);
+    jsonp_free(arena);
+}
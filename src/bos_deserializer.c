@@ -26,6 +26,7 @@
 
 #include "bosjansson.h"
 #include "strbuffer.h"
+#include "intern.h"
 #include "utf.h"
 
 /*** error reporting ***/
@@ -55,6 +56,9 @@ typedef struct {
     unsigned char *pos;
     uint32_t read;
     uint32_t size;
+    intern_t keys;
+    json_arena_t *arena;
+    size_t flags;
 } buffer_t;
 
 static JSON_INLINE void read_buffer(buffer_t *buffer, void *destination, size_t size) {
@@ -68,6 +72,8 @@ static int buffer_init(buffer_t *buffer, const void *data)
     buffer->data = data;
     buffer->pos = (void *)data;
     buffer->read = 0;
+    buffer->arena = NULL;
+    buffer->flags = 0;
     read_buffer(buffer, &buffer->size, sizeof(uint32_t));
     return 0;
 }
@@ -88,49 +94,49 @@ static json_t *read_bool(buffer_t *buffer) {
 static json_t *read_int8(buffer_t *buffer) {
     int8_t number;
     read_buffer(buffer, &number, sizeof(int8_t));
-    return json_integer((json_int_t)number);
+    return jsonp_integer_shared(buffer->arena, (json_int_t)number, buffer->flags);
 }
 
 static json_t *read_int16(buffer_t *buffer) {
     int16_t number;
     read_buffer(buffer, &number, sizeof(int16_t));
-    return json_integer((json_int_t)number);
+    return jsonp_integer_shared(buffer->arena, (json_int_t)number, buffer->flags);
 }
 
 static json_t *read_int32(buffer_t *buffer) {
     int32_t number;
     read_buffer(buffer, &number, sizeof(int32_t));
-    return json_integer((json_int_t)number);
+    return jsonp_integer_shared(buffer->arena, (json_int_t)number, buffer->flags);
 }
 
 static json_t *read_int64(buffer_t *buffer) {
     int64_t number;
     read_buffer(buffer, &number, sizeof(int64_t));
-    return json_integer((json_int_t)number);
+    return jsonp_integer_shared(buffer->arena, (json_int_t)number, buffer->flags);
 }
 
 static json_t *read_uint8(buffer_t *buffer) {
     uint8_t number;
     read_buffer(buffer, &number, sizeof(uint8_t));
-    return json_integer((json_int_t)number);
+    return jsonp_integer_shared(buffer->arena, (json_int_t)number, buffer->flags);
 }
 
 static json_t *read_uint16(buffer_t *buffer) {
     uint16_t number;
     read_buffer(buffer, &number, sizeof(uint16_t));
-    return json_integer((json_int_t)number);
+    return jsonp_integer_shared(buffer->arena, (json_int_t)number, buffer->flags);
 }
 
 static json_t *read_uint32(buffer_t *buffer) {
     uint32_t number;
     read_buffer(buffer, &number, sizeof(uint32_t));
-    return json_integer((json_int_t)number);
+    return jsonp_integer_shared(buffer->arena, (json_int_t)number, buffer->flags);
 }
 
 static json_t *read_uint64(buffer_t *buffer) {
     int64_t number;
     read_buffer(buffer, &number, sizeof(uint64_t));
-    return json_integer((json_int_t)number);
+    return jsonp_integer_shared(buffer->arena, (json_int_t)number, buffer->flags);
 }
 
 static size_t read_uvarint(buffer_t *buffer) {
@@ -163,56 +169,58 @@ static size_t read_uvarint(buffer_t *buffer) {
 static json_t *read_real32(buffer_t *buffer) {
     float number;
     read_buffer(buffer, &number, sizeof(float));
-    return json_real((double)number);
+    return json_real_in(buffer->arena, (double)number);
 }
 
 static json_t *read_real64(buffer_t *buffer) {
     double number;
     read_buffer(buffer, &number, sizeof(double));
-    return json_real(number);
+    return json_real_in(buffer->arena, number);
 }
 
-static char *read_raw_string(buffer_t *buffer) {
+/* Strings are used in place, up to the first NUL byte */
+static const char *read_raw_string(buffer_t *buffer, size_t *len) {
 
-    size_t len = read_uvarint(buffer);
+    size_t size = read_uvarint(buffer);
+    const char *str = (const char *)buffer->pos;
+    const char *nul = memchr(str, '\0', size);
 
-    if (len > 0) {
-        char *utf8String = (char*)jsonp_malloc(sizeof(char) * (len + 1));
-        read_buffer(buffer, utf8String, sizeof(char) * len);
-        memset(utf8String + len, (char)0, sizeof(char));
-        return utf8String;
-    }
-    else {
-        return "";
-    }
+    buffer->pos += size;
+    buffer->read += (uint32_t)size;
+
+    *len = nul ? (size_t)(nul - str) : size;
+    return str;
 }
 
 static json_t *read_string(buffer_t *buffer) {
-    char *str = read_raw_string(buffer);
-    json_t *ret = json_string(str);
-    jsonp_free(str);
-    return ret;
+    size_t len;
+    const char *str = read_raw_string(buffer, &len);
+    return json_stringn_in(buffer->arena, str, len);
 }
 
 static json_t *read_bytes(buffer_t *buffer) {
 
     size_t len = read_uvarint(buffer);
-    void *bytes = jsonp_malloc(len);
-    read_buffer(buffer, bytes, len);
-    return json_bytes(bytes, len);
+    json_t *bytes = jsonp_bytes_in(buffer->arena, buffer->pos, len);
+
+    buffer->pos += len;
+    buffer->read += (uint32_t)len;
+    return bytes;
 }
 
 static json_t *read_array(buffer_t *buffer, json_error_t *error) {
 
     size_t len = read_uvarint(buffer);
-    json_array_t *array = json_to_array(json_array());
+    json_array_t *array = json_to_array(json_array_in(buffer->arena));
 
     for (unsigned int i = 0; i < len; ++i) {
         json_t *entry = read_value(buffer, error);
-        if (entry == NULL)
+        if (entry == NULL) {
+            json_decref(&array->json);
             return NULL;
+        }
 
-        json_array_append(&array->json, entry);
+        json_array_append_new(&array->json, entry);
     }
 
     return &array->json;
@@ -221,20 +229,43 @@ static json_t *read_array(buffer_t *buffer, json_error_t *error) {
 static json_t *read_obj(buffer_t *buffer, json_error_t *error) {
 
     size_t len = read_uvarint(buffer);
-    json_object_t *object = json_to_object(json_object());
+    json_t *object = json_object_in(buffer->arena);
 
     for (unsigned int i = 0; i < len; ++i) {
 
-        char *key = read_raw_string(buffer);
-        json_t *entry = read_value(buffer, error);
-        if (entry == NULL)
-            return NULL;
+        size_t key_len;
+        const char *key = read_raw_string(buffer, &key_len);
+        size_t hash = hashtable_hash(key, key_len);
+        const intern_key_t *interned = intern_key(&buffer->keys, key, key_len, hash);
+        json_t *entry;
 
-        json_object_set(&object->json, key, entry);
-        jsonp_free(key);
+        entry = read_value(buffer, error);
+        if (entry == NULL) {
+            json_decref(object);
+            return NULL;
+        }
+
+        if (interned) {
+            /* invalid keys are skipped, like json_object_set() does */
+            if (interned->valid)
+                jsonp_object_set_hashed(object, interned->key, interned->len,
+                                        interned->hash, entry);
+            else
+                json_decref(entry);
+        }
+        else if (utf8_check_string(key, key_len)) {
+            char *copy = jsonp_strndup(key, key_len);
+            if (copy)
+                jsonp_object_set_hashed(object, copy, key_len, hash, entry);
+            else
+                json_decref(entry);
+            jsonp_free(copy);
+        }
+        else
+            json_decref(entry);
     }
 
-    return &object->json;
+    return object;
 }
 
 static json_t *read_value(buffer_t *buffer, json_error_t *error) {
@@ -295,9 +326,22 @@ static json_t *read_data(buffer_t *buffer, bos_data_type data_type, json_error_t
 }
 
 json_t *bos_deserialize(const void *data, json_error_t *error) {
+    return bos_deserialize_ex(data, 0, NULL, error);
+}
+
+json_t *bos_deserialize_arena(const void *data, json_arena_t *arena, json_error_t *error) {
+    return bos_deserialize_ex(data, 0, arena, error);
+}
+
+json_t *bos_deserialize_ex(const void *data, size_t flags, json_arena_t *arena,
+                           json_error_t *error) {
 
     buffer_t buffer;
+    json_t *result;
+
     buffer_init(&buffer, data);
+    buffer.arena = arena;
+    buffer.flags = flags;
     jsonp_error_init(error, "<bos_deserialize>");
 
     if (buffer.size < 5) {
@@ -305,7 +349,11 @@ json_t *bos_deserialize(const void *data, json_error_t *error) {
         return NULL;
     }
 
-    return read_value(&buffer, error);
+    intern_init(&buffer.keys);
+    result = read_value(&buffer, error);
+    intern_close(&buffer.keys);
+
+    return result;
 }
 
 /*** validation ***/
@@ -62,27 +62,26 @@ static int write_value(json_t *value, buffer_t *buffer, json_error_t *error);
 
 static int ensure_buffer_size(buffer_t *buffer, size_t amount, json_error_t *error)
 {
-    void *old_data = buffer->data;
     size_t new_size = max(buffer->size + amount, buffer->size * 2);
+    void *new_data;
 
     if(buffer->size + amount <= buffer->allocated)
         return TRUE;
 
-    buffer->data = jsonp_malloc(new_size * sizeof(uint8_t));
-    if(!buffer->data) {
+    new_data = jsonp_realloc(buffer->data, buffer->allocated, new_size * sizeof(uint8_t));
+    if(!new_data) {
         error_set(error, json_error_out_of_memory, "failed to allocate additional buffer memory");
         return FALSE;
     }
 
+    buffer->data = new_data;
     buffer->allocated = new_size;
     buffer->pos = (unsigned char *)buffer->data + buffer->size;
-    memcpy(buffer->data, old_data, buffer->size);
-    jsonp_free(old_data);
     return TRUE;
 }
 
 static JSON_INLINE int write_buffer(buffer_t *buffer, const void *source, size_t len, json_error_t *error) {
-    if (!ensure_buffer_size(buffer, buffer->size + len, error))
+    if (!ensure_buffer_size(buffer, len, error))
         return FALSE;
     memcpy(buffer->pos, source, len);
     buffer->pos += len;
@@ -91,7 +90,7 @@ static JSON_INLINE int write_buffer(buffer_t *buffer, const void *source, size_t
 }
 
 static JSON_INLINE int write_buffer_byte(buffer_t *buffer, int value, json_error_t *error) {
-    if (!ensure_buffer_size(buffer, buffer->size + 1, error))
+    if (!ensure_buffer_size(buffer, 1, error))
         return FALSE;
     *((uint8_t *)buffer->pos) = (uint8_t)value;
     buffer->pos += 1;
@@ -108,51 +107,52 @@ static int buffer_init(buffer_t *buffer)
     return 0;
 }
 
-static bos_data_type get_data_type(json_t *value) {
+static bos_data_type get_integer_type(json_int_t integer) {
 
-    if (json_is_object(value))
-        return BOS_OBJ;
+    if (integer < 0) {
 
-    if (json_is_null(value))
-        return BOS_NULL;
+        if (integer >= INT8_MIN)
+            return BOS_INT8;
 
-    if (json_is_boolean(value))
-        return BOS_BOOL;
+        if (integer >= INT16_MIN)
+            return BOS_INT16;
 
-    if (json_is_string(value))
-        return BOS_STRING;
+        if (integer >= INT32_MIN)
+            return BOS_INT32;
 
-    if (json_is_number(value)) {
+        return BOS_INT64;
+    }
 
-        if (json_is_integer(value)) {
+    if (integer <= 255)
+        return BOS_UINT8;
 
-            json_int_t integer = json_to_integer(value)->value;
+    if (integer <= 65535)
+        return BOS_UINT16;
 
-            if (integer < 0) {
+    if (integer <= 4294967295)
+        return BOS_UINT32;
 
-                if (integer >= INT8_MIN)
-                    return BOS_INT8;
+    return BOS_UINT64;
+}
 
-                if (integer >= INT16_MIN)
-                    return BOS_INT16;
+static bos_data_type get_data_type(json_t *value) {
 
-                if (integer >= INT32_MIN)
-                    return BOS_INT32;
+    if (json_is_object(value))
+        return BOS_OBJ;
 
-                return BOS_INT64;
-            }
+    if (json_is_null(value))
+        return BOS_NULL;
 
-            if (integer <= 255)
-                return BOS_UINT8;
+    if (json_is_boolean(value))
+        return BOS_BOOL;
 
-            if (integer <= 65535)
-                return BOS_UINT16;
+    if (json_is_string(value))
+        return BOS_STRING;
 
-            if (integer <= 4294967295)
-                return BOS_UINT32;
+    if (json_is_number(value)) {
 
-            return BOS_UINT64;
-        }
+        if (json_is_integer(value))
+            return get_integer_type(json_to_integer(value)->value);
         else {
             return BOS_FLOAT;
         }
@@ -173,112 +173,107 @@ static int write_null(buffer_t *buffer, json_error_t *error) {
     return write_buffer_byte(buffer, 0, error);
 }
 
-static int write_bool(json_t *value, buffer_t *buffer, json_error_t *error) {
+static int write_bool(int value, buffer_t *buffer, json_error_t *error) {
     if (!write_buffer_byte(buffer, BOS_BOOL, error)) return FALSE;
-    if (!write_buffer_byte(buffer, json_is_true(value) ? (uint8_t)1 : (uint8_t)0, error)) return FALSE;
-    return TRUE;
-}
-
-static int write_int8(json_t *value, buffer_t *buffer, json_error_t *error) {
-    if (!write_buffer_byte(buffer, BOS_INT8, error)) return FALSE;
-    if (!write_buffer_byte(buffer, (int8_t)json_to_integer(value)->value, error)) return FALSE;
+    if (!write_buffer_byte(buffer, value ? (uint8_t)1 : (uint8_t)0, error)) return FALSE;
     return TRUE;
 }
 
-static int write_int16(json_t *value, buffer_t *buffer, json_error_t *error) {
-    int16_t integer = (int16_t)json_to_integer(value)->value;
-    if (!write_buffer_byte(buffer, BOS_INT16, error)) return FALSE;
-    if (!write_buffer(buffer, &integer, 2, error)) return FALSE;
-    return TRUE;
-}
-
-static int write_int32(json_t *value, buffer_t *buffer, json_error_t *error) {
-    int32_t integer = (int32_t)json_to_integer(value)->value;
-    if (!write_buffer_byte(buffer, BOS_INT32, error)) return FALSE;
-    if (!write_buffer(buffer, &integer, 4, error)) return FALSE;
-    return TRUE;
-}
-
-static int write_int64(json_t *value, buffer_t *buffer, json_error_t *error) {
-    int64_t integer = (int64_t)json_to_integer(value)->value;
-    if (!write_buffer_byte(buffer, BOS_INT64, error)) return FALSE;
-    if (!write_buffer(buffer, &integer, 8, error)) return FALSE;
-    return TRUE;
-}
+/* integer is written with the type returned by get_integer_type() */
+static int write_integer(json_int_t integer, buffer_t *buffer, json_error_t *error) {
 
-static int write_uint8(json_t *value, buffer_t *buffer, json_error_t *error) {
-    uint8_t integer = (uint8_t)json_to_integer(value)->value;
-    if (!write_buffer_byte(buffer, BOS_UINT8, error)) return FALSE;
-    if (!write_buffer(buffer, &integer, 1, error)) return FALSE;
-    return TRUE;
-}
+    bos_data_type data_type = get_integer_type(integer);
 
-static int write_uint16(json_t *value, buffer_t *buffer, json_error_t *error) {
-    uint16_t integer = (uint16_t)json_to_integer(value)->value;
-    if (!write_buffer_byte(buffer, BOS_UINT16, error)) return FALSE;
-    if (!write_buffer(buffer, &integer, 2, error)) return FALSE;
-    return TRUE;
-}
+    if (!write_buffer_byte(buffer, data_type, error)) return FALSE;
 
-static int write_uint32(json_t *value, buffer_t *buffer, json_error_t *error) {
-    uint32_t integer = (uint32_t)json_to_integer(value)->value;
-    if (!write_buffer_byte(buffer, BOS_UINT32, error)) return FALSE;
-    if (!write_buffer(buffer, &integer, 4, error)) return FALSE;
-    return TRUE;
-}
+    switch (data_type) {
 
-static int write_uint64(json_t *value, buffer_t *buffer, json_error_t *error) {
-    uint64_t integer = (uint64_t)json_to_integer(value)->value;
-    if (!write_buffer_byte(buffer, BOS_UINT64, error)) return FALSE;
-    if (!write_buffer(buffer, &integer, 8, error)) return FALSE;
-    return TRUE;
+        case BOS_INT8: {
+            int8_t integer8 = (int8_t)integer;
+            return write_buffer(buffer, &integer8, 1, error);
+        }
+        case BOS_INT16: {
+            int16_t integer16 = (int16_t)integer;
+            return write_buffer(buffer, &integer16, 2, error);
+        }
+        case BOS_INT32: {
+            int32_t integer32 = (int32_t)integer;
+            return write_buffer(buffer, &integer32, 4, error);
+        }
+        case BOS_INT64: {
+            int64_t integer64 = (int64_t)integer;
+            return write_buffer(buffer, &integer64, 8, error);
+        }
+        case BOS_UINT8: {
+            uint8_t integer8 = (uint8_t)integer;
+            return write_buffer(buffer, &integer8, 1, error);
+        }
+        case BOS_UINT16: {
+            uint16_t integer16 = (uint16_t)integer;
+            return write_buffer(buffer, &integer16, 2, error);
+        }
+        case BOS_UINT32: {
+            uint32_t integer32 = (uint32_t)integer;
+            return write_buffer(buffer, &integer32, 4, error);
+        }
+        default: {
+            uint64_t integer64 = (uint64_t)integer;
+            return write_buffer(buffer, &integer64, 8, error);
+        }
+    }
 }
 
-static int write_uvarint(unsigned int value, buffer_t *buffer, json_error_t *error) {
+/* Encode value to out, which must have room for 9 bytes. Returns the
+   number of bytes used. */
+static size_t encode_uvarint(size_t value, unsigned char *out) {
 
     if (value < 0xFD) {
-        uint8_t integer8 = (uint8_t)value;
-        if (!write_buffer(buffer, &integer8, 1, error)) return FALSE;
+        out[0] = (uint8_t)value;
+        return 1;
 
     } else if (value <= 0xFFFF) {
 
         uint16_t integer16 = (uint16_t)value;
-        if (!write_buffer_byte(buffer, 0xFD, error)) return FALSE;
-        if (!write_buffer(buffer, &integer16, 2, error)) return FALSE;
+        out[0] = 0xFD;
+        memcpy(out + 1, &integer16, 2);
+        return 3;
 
     } else if (value <= 0xFFFFFFFF) {
 
         uint32_t integer32 = (uint32_t)value;
-        if (!write_buffer_byte(buffer, 0xFE, error)) return FALSE;
-        if (!write_buffer(buffer, &integer32, 4, error)) return FALSE;
+        out[0] = 0xFE;
+        memcpy(out + 1, &integer32, 4);
+        return 5;
 
     } else {
 
         uint64_t integer64 = (uint64_t)value;
-        if (!write_buffer_byte(buffer, 0xFF, error)) return FALSE;
-        if (!write_buffer(buffer, &integer64, 8, error)) return FALSE;
+        out[0] = 0xFF;
+        memcpy(out + 1, &integer64, 8);
+        return 9;
     }
-    return TRUE;
 }
 
-static int write_real32(json_t *value, buffer_t *buffer, json_error_t *error) {
-    float real = (float)json_to_real(value)->value;
+static int write_uvarint(size_t value, buffer_t *buffer, json_error_t *error) {
+    unsigned char encoded[9];
+    return write_buffer(buffer, encoded, encode_uvarint(value, encoded), error);
+}
+
+static int write_real32(double value, buffer_t *buffer, json_error_t *error) {
+    float real = (float)value;
     if (!write_buffer_byte(buffer, BOS_FLOAT, error)) return FALSE;
     if (!write_buffer(buffer, &real, 4, error)) return FALSE;
     return TRUE;
 }
 
-static int write_real64(json_t *value, buffer_t *buffer, json_error_t *error) {
-    double real = json_to_real(value)->value;
+static int write_real64(double value, buffer_t *buffer, json_error_t *error) {
+    double real = value;
     if (!write_buffer_byte(buffer, BOS_DOUBLE, error)) return FALSE;
     if (!write_buffer(buffer, &real, 8, error)) return FALSE;
     return TRUE;
 }
 
-static int write_string(json_t *value, buffer_t *buffer, json_error_t *error) {
-
-    size_t len = json_string_length(value);
-    const char *str = json_string_value(value);
+static int write_string(const char *str, size_t len, buffer_t *buffer, json_error_t *error) {
 
     if (!write_buffer_byte(buffer, BOS_STRING, error)) return FALSE;
     if (!write_uvarint(len, buffer, error)) return FALSE;
@@ -287,9 +282,8 @@ static int write_string(json_t *value, buffer_t *buffer, json_error_t *error) {
     return TRUE;
 }
 
-static int write_key_string(const char *str, buffer_t *buffer, json_error_t *error) {
+static int write_key_string(const char *str, size_t len, buffer_t *buffer, json_error_t *error) {
 
-    size_t len = strlen(str);
     if (len > 255) {
         error_set(error, json_error_invalid_argument, "key string is too long");
         return FALSE;
@@ -343,7 +337,7 @@ static int write_obj(json_t *value, buffer_t *buffer, json_error_t *error) {
             const char *key = json_object_iter_key(iter);
             json_t *entry_value = json_object_iter_value(iter);
 
-            if (!write_key_string(key, buffer, error)) return FALSE;
+            if (!write_key_string(key, strlen(key), buffer, error)) return FALSE;
 
             if (!write_value(entry_value, buffer, error)) return FALSE;
 
@@ -364,40 +358,27 @@ static int write_value(json_t *value, buffer_t *buffer, json_error_t *error) {
             return write_null(buffer, error);
 
         case BOS_BOOL:
-            return write_bool(value, buffer, error);
+            return write_bool(json_is_true(value), buffer, error);
 
         case BOS_INT8:
-            return write_int8(value, buffer, error);
-
         case BOS_INT16:
-            return write_int16(value, buffer, error);
-
         case BOS_INT32:
-            return write_int32(value, buffer, error);
-
         case BOS_INT64:
-            return write_int64(value, buffer, error);
-
         case BOS_UINT8:
-            return write_uint8(value, buffer, error);
-
         case BOS_UINT16:
-            return write_uint16(value, buffer, error);
-
         case BOS_UINT32:
-            return write_uint32(value, buffer, error);
-
         case BOS_UINT64:
-            return write_uint64(value, buffer, error);
+            return write_integer(json_to_integer(value)->value, buffer, error);
 
         case BOS_FLOAT:
-            return write_real32(value, buffer, error);
+            return write_real32(json_to_real(value)->value, buffer, error);
 
         case BOS_DOUBLE:
-            return write_real64(value, buffer, error);
+            return write_real64(json_to_real(value)->value, buffer, error);
 
         case BOS_STRING:
-            return write_string(value, buffer, error);
+            return write_string(json_string_value(value), json_string_length(value),
+                                buffer, error);
 
         case BOS_BYTES:
             return write_bytes(value, buffer, error);
@@ -443,6 +424,223 @@ bos_t *bos_serialize(json_t *value, json_error_t *error) {
     return result;
 }
 
+/*** transcoder ***/
+
+/* An open container: where its count goes, and how many entries
+   (values of an array, keys of an object) it has so far */
+typedef struct {
+    size_t offset;
+    size_t count;
+    int is_object;
+} frame_t;
+
+typedef struct {
+    buffer_t buffer;
+    frame_t *stack;
+    size_t depth;
+    size_t stack_size;
+    int failed;
+    json_error_t error;
+} transcoder_t;
+
+static int transcode_failed(transcoder_t *t) {
+    t->failed = 1;
+    return -1;
+}
+
+/* Count a value of an enclosing array. Object entries are counted by
+   their keys. */
+static JSON_INLINE void transcode_entry(transcoder_t *t) {
+    if (t->depth > 0 && !t->stack[t->depth - 1].is_object)
+        t->stack[t->depth - 1].count++;
+}
+
+static int transcode_start(transcoder_t *t, bos_data_type data_type) {
+
+    frame_t *frame;
+
+    transcode_entry(t);
+
+    if (t->depth == t->stack_size) {
+        size_t new_size = max(t->stack_size * 2, 16);
+        frame_t *new_stack = jsonp_realloc(t->stack, t->stack_size * sizeof(frame_t),
+                                           new_size * sizeof(frame_t));
+        if (!new_stack) {
+            error_set(&t->error, json_error_out_of_memory, "out of memory");
+            return transcode_failed(t);
+        }
+        t->stack = new_stack;
+        t->stack_size = new_size;
+    }
+
+    /* the count is not known yet. One byte is reserved for it, which
+       is enough for most containers. */
+    if (!write_buffer_byte(&t->buffer, data_type, &t->error) ||
+        !write_buffer_byte(&t->buffer, 0, &t->error))
+        return transcode_failed(t);
+
+    frame = &t->stack[t->depth++];
+    frame->offset = t->buffer.size - 1;
+    frame->count = 0;
+    frame->is_object = data_type == BOS_OBJ;
+    return 0;
+}
+
+/* Back-patch the count of the innermost container */
+static int transcode_end(transcoder_t *t) {
+
+    buffer_t *buffer = &t->buffer;
+    frame_t *frame = &t->stack[--t->depth];
+    unsigned char encoded[9];
+    size_t width = encode_uvarint(frame->count, encoded);
+    unsigned char *count;
+
+    if (width > 1) {
+        /* move the entries to make room for a wider count */
+        if (!ensure_buffer_size(buffer, width - 1, &t->error))
+            return transcode_failed(t);
+
+        count = (unsigned char *)buffer->data + frame->offset;
+        memmove(count + width, count + 1, buffer->size - frame->offset - 1);
+        buffer->pos += width - 1;
+        buffer->size += width - 1;
+    }
+
+    count = (unsigned char *)buffer->data + frame->offset;
+    memcpy(count, encoded, width);
+    return 0;
+}
+
+static int transcode_start_object(void *ctx) {
+    return transcode_start((transcoder_t *)ctx, BOS_OBJ);
+}
+
+static int transcode_start_array(void *ctx) {
+    return transcode_start((transcoder_t *)ctx, BOS_ARRAY);
+}
+
+static int transcode_end_container(void *ctx) {
+    return transcode_end((transcoder_t *)ctx);
+}
+
+static int transcode_key(void *ctx, const char *key, size_t len) {
+    transcoder_t *t = (transcoder_t *)ctx;
+
+    t->stack[t->depth - 1].count++;
+    if (!write_key_string(key, len, &t->buffer, &t->error))
+        return transcode_failed(t);
+    return 0;
+}
+
+static int transcode_string(void *ctx, const char *value, size_t len) {
+    transcoder_t *t = (transcoder_t *)ctx;
+
+    transcode_entry(t);
+    if (!write_string(value, len, &t->buffer, &t->error))
+        return transcode_failed(t);
+    return 0;
+}
+
+static int transcode_integer(void *ctx, json_int_t value) {
+    transcoder_t *t = (transcoder_t *)ctx;
+
+    transcode_entry(t);
+    if (!write_integer(value, &t->buffer, &t->error))
+        return transcode_failed(t);
+    return 0;
+}
+
+static int transcode_real(void *ctx, double value) {
+    transcoder_t *t = (transcoder_t *)ctx;
+
+    /* reals are written like bos_serialize() writes them */
+    transcode_entry(t);
+    if (!write_real32(value, &t->buffer, &t->error))
+        return transcode_failed(t);
+    return 0;
+}
+
+static int transcode_boolean(void *ctx, int value) {
+    transcoder_t *t = (transcoder_t *)ctx;
+
+    transcode_entry(t);
+    if (!write_bool(value, &t->buffer, &t->error))
+        return transcode_failed(t);
+    return 0;
+}
+
+static int transcode_null(void *ctx) {
+    transcoder_t *t = (transcoder_t *)ctx;
+
+    transcode_entry(t);
+    if (!write_null(&t->buffer, &t->error))
+        return transcode_failed(t);
+    return 0;
+}
+
+static const json_handler_t transcode_handler = {
+    transcode_start_object,
+    transcode_key,
+    transcode_end_container,
+    transcode_start_array,
+    transcode_end_container,
+    transcode_string,
+    transcode_integer,
+    transcode_real,
+    transcode_boolean,
+    transcode_null
+};
+
+bos_t *bos_from_json(const char *text, size_t len, size_t flags, json_error_t *error) {
+
+    transcoder_t t;
+    uint32_t size;
+    bos_t *result = NULL;
+
+    memset(&t, 0, sizeof(t));
+    buffer_init(&t.buffer);
+    if (!t.buffer.data) {
+        jsonp_error_init(error, "<bos_from_json>");
+        error_set(error, json_error_out_of_memory, "out of memory");
+        return NULL;
+    }
+
+    // leave room for data length integer which will be filled later
+    t.buffer.pos += 4;
+    t.buffer.size = 4;
+
+    if (json_parse_events(text, len, &transcode_handler, &t, flags, error)) {
+        /* report why the transcoder stopped, where the parser stopped */
+        if (t.failed && error) {
+            int line = error->line, column = error->column;
+            size_t position = error->position;
+
+            jsonp_error_init(error, "<buffer>");
+            jsonp_error_set(error, line, column, position,
+                            json_error_code(&t.error), "%s", t.error.text);
+        }
+        goto out;
+    }
+
+    result = (bos_t *)jsonp_malloc(sizeof(bos_t));
+    if (!result) {
+        error_set(error, json_error_out_of_memory, "out of memory");
+        goto out;
+    }
+
+    size = (uint32_t)t.buffer.size;
+    memcpy(t.buffer.data, &size, sizeof(uint32_t));
+
+    result->data = t.buffer.data;
+    result->size = t.buffer.size;
+    t.buffer.data = NULL;
+
+out:
+    jsonp_free(t.buffer.data);
+    jsonp_free(t.stack);
+    return result;
+}
+
 void bos_free(bos_t *ptr) {
     jsonp_free((void *)ptr->data);
     jsonp_free(ptr);
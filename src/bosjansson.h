@@ -71,6 +71,8 @@ typedef struct bos_t {
     uint32_t size;
 } bos_t;
 
+typedef struct json_arena json_arena_t;
+
 #ifndef JANSSON_USING_CMAKE /* disabled if using cmake */
 #if JSON_INTEGER_IS_LONG_LONG
 #ifdef _WIN32
@@ -190,7 +192,8 @@ enum json_error_code {
     json_error_duplicate_key,
     json_error_numeric_overflow,
     json_error_item_not_found,
-    json_error_index_out_of_range
+    json_error_index_out_of_range,
+    json_error_aborted
 };
 
 static JSON_INLINE enum json_error_code json_error_code(const json_error_t *e) {
@@ -217,6 +220,18 @@ const char *json_object_iter_key(void *iter);
 json_t *json_object_iter_value(void *iter);
 int json_object_iter_set_new(json_t *object, void *iter, json_t *value);
 
+/* a key whose length and hash are computed once, for hot lookups */
+typedef struct json_key_t {
+    const char *key;
+    size_t len;
+    size_t hash;
+} json_key_t;
+
+json_key_t json_key_make(const char *key);
+json_t *json_object_get_k(const json_t *object, const json_key_t *key) JANSSON_ATTRS(warn_unused_result);
+int json_object_set_new_k(json_t *object, const json_key_t *key, json_t *value);
+int json_object_del_k(json_t *object, const json_key_t *key);
+
 #define json_object_foreach(object, key, value) \
     for(key = json_object_iter_key(json_object_iter(object)); \
         key && (value = json_object_iter_value(json_object_key_to_iter(key))); \
@@ -246,6 +261,12 @@ int json_object_set_nocheck(json_t *object, const char *key, json_t *value)
     return json_object_set_new_nocheck(object, key, json_incref(value));
 }
 
+static JSON_INLINE
+int json_object_set_k(json_t *object, const json_key_t *key, json_t *value)
+{
+    return json_object_set_new_k(object, key, json_incref(value));
+}
+
 static JSON_INLINE
 int json_object_iter_set(json_t *object, void *iter, json_t *value)
 {
@@ -330,7 +351,10 @@ json_t *json_deep_copy(const json_t *value) JANSSON_ATTRS(warn_unused_result);
 int bos_validate(const void *data, size_t size);
 unsigned int bos_sizeof(const void *data);
 json_t *bos_deserialize(const void *data, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+json_t *bos_deserialize_arena(const void *data, json_arena_t *arena, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+json_t *bos_deserialize_ex(const void *data, size_t flags, json_arena_t *arena, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 bos_t *bos_serialize(json_t *value, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+bos_t *bos_from_json(const char *text, size_t len, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 void bos_free(bos_t *ptr);
 
 /* decoding */
@@ -340,16 +364,56 @@ void bos_free(bos_t *ptr);
 #define JSON_DECODE_ANY         0x4
 #define JSON_DECODE_INT_AS_REAL 0x8
 #define JSON_ALLOW_NUL          0x10
+#define JSON_FAST_PARSE         0x20
+#define JSON_DECODE_LAZY        0x40
+#define JSON_SHARE_INTEGERS     0x80
+#define JSON_LINES_ARENA        0x100
 
 typedef size_t (*json_load_callback_t)(void *buffer, size_t buflen, void *data);
 
 json_t *json_loads(const char *input, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 json_t *json_loadb(const char *buffer, size_t buflen, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+json_t *json_loadb_arena(const char *buffer, size_t buflen, size_t flags, json_arena_t *arena, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 json_t *json_loadf(FILE *input, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 json_t *json_loadfd(int input, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 json_t *json_load_file(const char *path, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 json_t *json_load_callback(json_load_callback_t callback, void *data, size_t flags, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
 
+typedef struct {
+    int (*start_object)(void *ctx);
+    int (*key)(void *ctx, const char *key, size_t len);
+    int (*end_object)(void *ctx);
+    int (*start_array)(void *ctx);
+    int (*end_array)(void *ctx);
+    int (*string)(void *ctx, const char *value, size_t len);
+    int (*integer)(void *ctx, json_int_t value);
+    int (*real)(void *ctx, double value);
+    int (*boolean)(void *ctx, int value);
+    int (*null)(void *ctx);
+} json_handler_t;
+
+int json_parse_events(const char *input, size_t len, const json_handler_t *handler, void *ctx, size_t flags, json_error_t *error);
+
+typedef struct json_stream json_stream_t;
+
+json_stream_t *json_stream_file(FILE *input, size_t flags) JANSSON_ATTRS(warn_unused_result);
+json_stream_t *json_stream_fd(int input, size_t flags) JANSSON_ATTRS(warn_unused_result);
+json_stream_t *json_stream_callback(json_load_callback_t callback, void *data, size_t flags) JANSSON_ATTRS(warn_unused_result);
+json_t *json_stream_next(json_stream_t *stream, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+int json_stream_eof(const json_stream_t *stream);
+void json_stream_close(json_stream_t *stream);
+
+typedef struct json_parser json_parser_t;
+
+json_parser_t *json_parser_new(size_t flags) JANSSON_ATTRS(warn_unused_result);
+int json_parser_feed(json_parser_t *parser, const char *buffer, size_t buflen);
+json_t *json_parser_result(json_parser_t *parser, json_error_t *error) JANSSON_ATTRS(warn_unused_result);
+void json_parser_free(json_parser_t *parser);
+
+typedef int (*json_lines_callback_t)(size_t index, json_t *value, const json_error_t *error, void *ctx);
+
+int json_load_lines_parallel(const char *buffer, size_t buflen, size_t flags, int nthreads, json_lines_callback_t callback, void *ctx);
+
 
 /* encoding */
 
@@ -363,15 +427,22 @@ json_t *json_load_callback(json_load_callback_t callback, void *data, size_t fla
 #define JSON_ESCAPE_SLASH       0x400
 #define JSON_REAL_PRECISION(n)  (((n) & 0x1F) << 11)
 #define JSON_EMBED              0x10000
+#define JSON_NO_CYCLE_CHECK     0x20000
+#define BOS_BYTES_AS_HEX        0x40000
+#define BOS_BYTES_AS_BASE64     0x80000
+#define BOS_BYTES_AS_ARRAY      0xC0000
 
 typedef int (*json_dump_callback_t)(const char *buffer, size_t size, void *data);
 
 char *json_dumps(const json_t *json, size_t flags) JANSSON_ATTRS(warn_unused_result);
+size_t json_dump_size(const json_t *json, size_t flags);
 size_t json_dumpb(const json_t *json, char *buffer, size_t size, size_t flags);
 int json_dumpf(const json_t *json, FILE *output, size_t flags);
 int json_dumpfd(const json_t *json, int output, size_t flags);
 int json_dump_file(const json_t *json, const char *path, size_t flags);
 int json_dump_callback(const json_t *json, json_dump_callback_t callback, void *data, size_t flags);
+int json_dump_callback_ex(const json_t *json, json_dump_callback_t callback, void *data, size_t flags, size_t buffer_size);
+int bos_to_json(const void *data, size_t size, size_t flags, json_dump_callback_t callback, void *ctx);
 
 /* custom memory allocation */
 
@@ -381,6 +452,30 @@ typedef void (*json_free_t)(void *);
 void json_set_alloc_funcs(json_malloc_t malloc_fn, json_free_t free_fn);
 void json_get_alloc_funcs(json_malloc_t *malloc_fn, json_free_t *free_fn);
 
+typedef void *(*json_malloc_ex_t)(size_t size, void *ctx);
+typedef void *(*json_realloc_ex_t)(void *ptr, size_t size, void *ctx);
+typedef void (*json_free_ex_t)(void *ptr, void *ctx);
+
+void json_set_alloc_funcs_ex(json_malloc_ex_t malloc_fn,
+                             json_realloc_ex_t realloc_fn,
+                             json_free_ex_t free_fn, void *ctx);
+void json_get_alloc_funcs_ex(json_malloc_ex_t *malloc_fn,
+                             json_realloc_ex_t *realloc_fn,
+                             json_free_ex_t *free_fn, void **ctx);
+
+/* arena allocation */
+
+json_arena_t *json_arena_create(size_t chunk_size) JANSSON_ATTRS(warn_unused_result);
+void json_arena_reset(json_arena_t *arena);
+void json_arena_destroy(json_arena_t *arena);
+
+json_t *json_object_in(json_arena_t *arena);
+json_t *json_array_in(json_arena_t *arena);
+json_t *json_string_in(json_arena_t *arena, const char *value);
+json_t *json_stringn_in(json_arena_t *arena, const char *value, size_t len);
+json_t *json_integer_in(json_arena_t *arena, json_int_t value);
+json_t *json_real_in(json_arena_t *arena, double value);
+
 #ifdef __cplusplus
 }
 #endif
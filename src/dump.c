@@ -18,6 +18,9 @@
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "bosjansson.h"
 #include "strbuffer.h"
@@ -28,6 +31,10 @@
 
 #define FLAGS_TO_INDENT(f)      ((f) & 0x1F)
 #define FLAGS_TO_PRECISION(f)   (((f) >> 11) & 0x1F)
+#define FLAGS_TO_BYTES(f)       ((f) & BOS_BYTES_AS_ARRAY)
+
+/* Output buffer size used by json_dumpf() and json_dumpfd() */
+#define DUMP_BUFFER_SIZE        4096
 
 struct buffer {
     const size_t size;
@@ -35,6 +42,16 @@ struct buffer {
     char *data;
 };
 
+/* Collects the small chunks produced by do_dump() and passes them on
+   to the real callback in as few calls as possible */
+struct coalesce {
+    json_dump_callback_t callback;
+    void *data;
+    char *buffer;
+    size_t size;
+    size_t used;
+};
+
 static int dump_to_strbuffer(const char *buffer, size_t size, void *data)
 {
     return strbuffer_append_bytes((strbuffer_t *)data, buffer, size);
@@ -51,6 +68,13 @@ static int dump_to_buffer(const char *buffer, size_t size, void *data)
     return 0;
 }
 
+static int dump_to_counter(const char *buffer, size_t size, void *data)
+{
+    (void)buffer;
+    *(size_t *)data += size;
+    return 0;
+}
+
 static int dump_to_file(const char *buffer, size_t size, void *data)
 {
     FILE *dest = (FILE *)data;
@@ -69,6 +93,36 @@ static int dump_to_fd(const char *buffer, size_t size, void *data)
     return -1;
 }
 
+static int coalesce_flush(struct coalesce *co)
+{
+    size_t used = co->used;
+
+    if(used == 0)
+        return 0;
+
+    co->used = 0;
+    return co->callback(co->buffer, used, co->data);
+}
+
+static int dump_to_coalesce(const char *buffer, size_t size, void *data)
+{
+    struct coalesce *co = (struct coalesce *)data;
+
+    if(size > co->size - co->used) {
+        /* Chunks are never split, so the callback still only sees
+           complete UTF-8 sequences */
+        if(coalesce_flush(co))
+            return -1;
+
+        if(size >= co->size)
+            return co->callback(buffer, size, co->data);
+    }
+
+    memcpy(co->buffer + co->used, buffer, size);
+    co->used += size;
+    return 0;
+}
+
 /* 32 spaces (the maximum indentation size) */
 static const char whitespace[] = "                                ";
 
@@ -98,6 +152,64 @@ static int dump_indent(size_t flags, int depth, int space, json_dump_callback_t
     return 0;
 }
 
+#define SWAR_ONES   0x0101010101010101ULL
+#define SWAR_HIGHS  0x8080808080808080ULL
+
+/* Nonzero if any byte of x is less than n (n <= 0x80) */
+#define SWAR_HAS_LESS(x, n)  (((x) - SWAR_ONES * (n)) & ~(x) & SWAR_HIGHS)
+#define SWAR_HAS_BYTE(x, c)  SWAR_HAS_LESS((x) ^ (SWAR_ONES * (c)), 1)
+
+/* Return a pointer to the first byte in [pos, lim) that is '"', '\\',
+   a control character, non-ASCII, or '/' if escape_slash is set. All
+   other bytes are copied to the output as is. */
+static const char *scan_plain(const char *pos, const char *lim, int escape_slash)
+{
+    /* With escape_slash unset, look for '"' twice instead */
+    const unsigned char slash = escape_slash ? '/' : '"';
+
+#ifdef __SSE2__
+    const __m128i quote_v = _mm_set1_epi8('"');
+    const __m128i backslash_v = _mm_set1_epi8('\\');
+    const __m128i slash_v = _mm_set1_epi8((char)slash);
+    const __m128i space_v = _mm_set1_epi8(0x20);
+
+    while(lim - pos >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)pos);
+
+        /* The signed compare catches both bytes below 0x20 and bytes
+           with the high bit set */
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote_v), _mm_cmpeq_epi8(v, backslash_v)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, slash_v), _mm_cmplt_epi8(v, space_v)));
+        int mask = _mm_movemask_epi8(hits);
+
+        if(mask)
+            return pos + __builtin_ctz(mask);
+        pos += 16;
+    }
+#endif
+
+    while(lim - pos >= 8)
+    {
+        uint64_t x;
+
+        memcpy(&x, pos, sizeof(x));
+        if((x & SWAR_HIGHS) || SWAR_HAS_LESS(x, 0x20) || SWAR_HAS_BYTE(x, '"') ||
+           SWAR_HAS_BYTE(x, '\\') || SWAR_HAS_BYTE(x, slash))
+            break;
+        pos += 8;
+    }
+
+    for(; pos < lim; pos++)
+    {
+        unsigned char c = (unsigned char)*pos;
+        if(c < 0x20 || c >= 0x80 || c == '"' || c == '\\' || c == slash)
+            break;
+    }
+    return pos;
+}
+
 static int dump_string(const char *str, size_t len, json_dump_callback_t dump, void *data, size_t flags)
 {
     const char *pos, *end, *lim;
@@ -114,22 +226,27 @@ static int dump_string(const char *str, size_t len, json_dump_callback_t dump, v
         char seq[13];
         int length;
 
-        while(end < lim)
+        while(1)
         {
-            end = utf8_iterate(pos, lim - pos, &codepoint);
-            if(!end)
-                return -1;
-
-            /* mandatory escape or control char */
-            if(codepoint == '\\' || codepoint == '"' || codepoint < 0x20)
+            pos = scan_plain(pos, lim, flags & JSON_ESCAPE_SLASH);
+            if(pos == lim) {
+                end = pos;
                 break;
+            }
 
-            /* slash */
-            if((flags & JSON_ESCAPE_SLASH) && codepoint == '/')
+            if((unsigned char)*pos < 0x80) {
+                /* mandatory escape, control char or slash */
+                codepoint = (unsigned char)*pos;
+                end = pos + 1;
                 break;
+            }
 
-            /* non-ASCII */
-            if((flags & JSON_ENSURE_ASCII) && codepoint > 0x7F)
+            /* non-ASCII: validate, and escape if requested */
+            end = utf8_iterate(pos, lim - pos, &codepoint);
+            if(!end)
+                return -1;
+
+            if(flags & JSON_ENSURE_ASCII)
                 break;
 
             pos = end;
@@ -191,22 +308,112 @@ static int dump_string(const char *str, size_t len, json_dump_callback_t dump, v
     return dump("\"", 1, data);
 }
 
+static const char hex_digits[] = "0123456789abcdef";
+static const char base64_digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Bytes have no JSON representation of their own. They are dumped the
+   way the BOS_BYTES_AS_* flag asks, or not at all. */
+static int dump_bytes(const unsigned char *bytes, size_t size, size_t flags, int depth,
+                      json_dump_callback_t dump, void *data)
+{
+    char buffer[MAX_INTEGER_STR_LENGTH];
+    size_t i, used = 0;
+
+    switch(FLAGS_TO_BYTES(flags)) {
+        case BOS_BYTES_AS_HEX:
+            if(dump("\"", 1, data))
+                return -1;
+            for(i = 0; i < size; i++) {
+                buffer[used++] = hex_digits[bytes[i] >> 4];
+                buffer[used++] = hex_digits[bytes[i] & 0xF];
+                if(used + 2 > sizeof(buffer)) {
+                    if(dump(buffer, used, data))
+                        return -1;
+                    used = 0;
+                }
+            }
+            if(used && dump(buffer, used, data))
+                return -1;
+            return dump("\"", 1, data);
+
+        case BOS_BYTES_AS_BASE64:
+            if(dump("\"", 1, data))
+                return -1;
+            for(i = 0; i < size; i += 3) {
+                unsigned long triple = (unsigned long)bytes[i] << 16;
+
+                if(i + 1 < size)
+                    triple |= (unsigned long)bytes[i + 1] << 8;
+                if(i + 2 < size)
+                    triple |= bytes[i + 2];
+
+                buffer[used++] = base64_digits[(triple >> 18) & 0x3F];
+                buffer[used++] = base64_digits[(triple >> 12) & 0x3F];
+                buffer[used++] = i + 1 < size ? base64_digits[(triple >> 6) & 0x3F] : '=';
+                buffer[used++] = i + 2 < size ? base64_digits[triple & 0x3F] : '=';
+                if(used + 4 > sizeof(buffer)) {
+                    if(dump(buffer, used, data))
+                        return -1;
+                    used = 0;
+                }
+            }
+            if(used && dump(buffer, used, data))
+                return -1;
+            return dump("\"", 1, data);
+
+        case BOS_BYTES_AS_ARRAY:
+            /* laid out like an array of integers */
+            if(dump("[", 1, data))
+                return -1;
+            if(size == 0)
+                return dump("]", 1, data);
+            if(dump_indent(flags, depth + 1, 0, dump, data))
+                return -1;
+            for(i = 0; i < size; i++) {
+                int length = jsonp_itostr(buffer, sizeof(buffer), bytes[i]);
+                if(length < 0 || dump(buffer, length, data))
+                    return -1;
+
+                if(i < size - 1) {
+                    if(dump(",", 1, data) ||
+                       dump_indent(flags, depth + 1, 1, dump, data))
+                        return -1;
+                }
+                else if(dump_indent(flags, depth, 0, dump, data))
+                    return -1;
+            }
+            return dump("]", 1, data);
+
+        default:
+            return -1;
+    }
+}
+
 static int compare_keys(const void *key1, const void *key2)
 {
     return strcmp(*(const char **)key1, *(const char **)key2);
 }
 
-static int loop_check(hashtable_t *parents, const json_t *json, char *key, size_t key_size)
-{
-    snprintf(key, key_size, "%p", json);
-    if (hashtable_get(parents, key))
-        return -1;
+/* The arrays and objects currently being dumped, innermost first. The
+   entries live in the stack frames of do_dump(). */
+struct parent {
+    const json_t *json;
+    const struct parent *next;
+};
 
-    return hashtable_set(parents, key, json_null());
+static int loop_check(const struct parent *parents, const json_t *json)
+{
+    while(parents) {
+        if(parents->json == json)
+            return -1;
+        parents = parents->next;
+    }
+    return 0;
 }
 
 static int do_dump(const json_t *json, size_t flags, int depth,
-                   hashtable_t *parents, json_dump_callback_t dump, void *data)
+                   const struct parent *parents, json_dump_callback_t dump, void *data)
 {
     int embed = flags & JSON_EMBED;
 
@@ -230,10 +437,9 @@ static int do_dump(const json_t *json, size_t flags, int depth,
             char buffer[MAX_INTEGER_STR_LENGTH];
             int size;
 
-            size = snprintf(buffer, MAX_INTEGER_STR_LENGTH,
-                            "%" JSON_INTEGER_FORMAT,
-                            json_integer_value(json));
-            if(size < 0 || size >= MAX_INTEGER_STR_LENGTH)
+            size = jsonp_itostr(buffer, MAX_INTEGER_STR_LENGTH,
+                                json_integer_value(json));
+            if(size < 0)
                 return -1;
 
             return dump(buffer, size, data);
@@ -260,27 +466,27 @@ static int do_dump(const json_t *json, size_t flags, int depth,
         {
             size_t n;
             size_t i;
-            /* Space for "0x", double the sizeof a pointer for the hex and a terminator. */
-            char key[2 + (sizeof(json) * 2) + 1];
+            struct parent self;
 
             /* detect circular references */
-            if (loop_check(parents, json, key, sizeof(key)))
+            if(!(flags & JSON_NO_CYCLE_CHECK) && loop_check(parents, json))
                 return -1;
 
+            self.json = json;
+            self.next = parents;
+
             n = json_array_size(json);
 
             if(!embed && dump("[", 1, data))
                 return -1;
-            if(n == 0) {
-                hashtable_del(parents, key);
+            if(n == 0)
                 return embed ? 0 : dump("]", 1, data);
-            }
             if(dump_indent(flags, depth + 1, 0, dump, data))
                 return -1;
 
             for(i = 0; i < n; ++i) {
                 if(do_dump(json_array_get(json, i), flags, depth + 1,
-                           parents, dump, data))
+                           &self, dump, data))
                     return -1;
 
                 if(i < n - 1)
@@ -296,7 +502,6 @@ static int do_dump(const json_t *json, size_t flags, int depth,
                 }
             }
 
-            hashtable_del(parents, key);
             return embed ? 0 : dump("]", 1, data);
         }
 
@@ -305,8 +510,7 @@ static int do_dump(const json_t *json, size_t flags, int depth,
             void *iter;
             const char *separator;
             int separator_length;
-            /* Space for "0x", double the sizeof a pointer for the hex and a terminator. */
-            char loop_key[2 + (sizeof(json) * 2) + 1];
+            struct parent self;
 
             if(flags & JSON_COMPACT) {
                 separator = ":";
@@ -318,17 +522,18 @@ static int do_dump(const json_t *json, size_t flags, int depth,
             }
 
             /* detect circular references */
-            if (loop_check(parents, json, loop_key, sizeof(loop_key)))
+            if(!(flags & JSON_NO_CYCLE_CHECK) && loop_check(parents, json))
                 return -1;
 
+            self.json = json;
+            self.next = parents;
+
             iter = json_object_iter((json_t *)json);
 
             if(!embed && dump("{", 1, data))
                 return -1;
-            if(!iter) {
-                hashtable_del(parents, loop_key);
+            if(!iter)
                 return embed ? 0 : dump("}", 1, data);
-            }
             if(dump_indent(flags, depth + 1, 0, dump, data))
                 return -1;
 
@@ -364,7 +569,7 @@ static int do_dump(const json_t *json, size_t flags, int depth,
 
                     dump_string(key, strlen(key), dump, data, flags);
                     if(dump(separator, separator_length, data) ||
-                       do_dump(value, flags, depth + 1, parents, dump, data))
+                       do_dump(value, flags, depth + 1, &self, dump, data))
                     {
                         jsonp_free(keys);
                         return -1;
@@ -403,7 +608,7 @@ static int do_dump(const json_t *json, size_t flags, int depth,
                     dump_string(key, strlen(key), dump, data, flags);
                     if(dump(separator, separator_length, data) ||
                        do_dump(json_object_iter_value(iter), flags, depth + 1,
-                               parents, dump, data))
+                               &self, dump, data))
                         return -1;
 
                     if(next)
@@ -422,30 +627,54 @@ static int do_dump(const json_t *json, size_t flags, int depth,
                 }
             }
 
-            hashtable_del(parents, loop_key);
             return embed ? 0 : dump("}", 1, data);
         }
 
+        case JSON_BYTES:
+            return dump_bytes(json_bytes_value(json), json_bytes_size(json),
+                              flags, depth, dump, data);
+
         default:
             /* not reached */
             return -1;
     }
 }
 
+size_t json_dump_size(const json_t *json, size_t flags)
+{
+    size_t size = 0;
+
+    if(json_dump_callback(json, dump_to_counter, (void *)&size, flags))
+        return (size_t)-1;
+
+    return size;
+}
+
 char *json_dumps(const json_t *json, size_t flags)
 {
     strbuffer_t strbuff;
-    char *result;
+    char *result, *trimmed;
+    size_t size, length;
 
     if(strbuffer_init(&strbuff))
         return NULL;
 
-    if(json_dump_callback(json, dump_to_strbuffer, (void *)&strbuff, flags))
-        result = NULL;
-    else
-        result = jsonp_strdup(strbuffer_value(&strbuff));
+    /* The output may be empty, e.g. an empty array with JSON_EMBED */
+    if(json_dump_callback(json, dump_to_strbuffer, (void *)&strbuff, flags)) {
+        strbuffer_close(&strbuff);
+        return NULL;
+    }
 
-    strbuffer_close(&strbuff);
+    size = strbuff.size;
+    length = strbuff.length;
+    result = strbuffer_steal_value(&strbuff);
+
+    /* The buffer grew by doubling; give back the unused part */
+    if(size > length + 1) {
+        trimmed = jsonp_realloc(result, size, length + 1);
+        if(trimmed)
+            result = trimmed;
+    }
     return result;
 }
 
@@ -459,14 +688,35 @@ size_t json_dumpb(const json_t *json, char *buffer, size_t size, size_t flags)
     return buf.used;
 }
 
+static int dump_buffered(const json_t *json, json_dump_callback_t callback, void *data,
+                         size_t flags, char *buffer, size_t buffer_size)
+{
+    struct coalesce co;
+
+    co.callback = callback;
+    co.data = data;
+    co.buffer = buffer;
+    co.size = buffer_size;
+    co.used = 0;
+
+    if(json_dump_callback(json, dump_to_coalesce, (void *)&co, flags))
+        return -1;
+
+    return coalesce_flush(&co);
+}
+
 int json_dumpf(const json_t *json, FILE *output, size_t flags)
 {
-    return json_dump_callback(json, dump_to_file, (void *)output, flags);
+    char buffer[DUMP_BUFFER_SIZE];
+    return dump_buffered(json, dump_to_file, (void *)output, flags,
+                         buffer, sizeof(buffer));
 }
 
 int json_dumpfd(const json_t *json, int output, size_t flags)
 {
-    return json_dump_callback(json, dump_to_fd, (void *)&output, flags);
+    char buffer[DUMP_BUFFER_SIZE];
+    return dump_buffered(json, dump_to_fd, (void *)&output, flags,
+                         buffer, sizeof(buffer));
 }
 
 int json_dump_file(const json_t *json, const char *path, size_t flags)
@@ -487,18 +737,427 @@ int json_dump_file(const json_t *json, const char *path, size_t flags)
 
 int json_dump_callback(const json_t *json, json_dump_callback_t callback, void *data, size_t flags)
 {
-    int res;
-    hashtable_t parents_set;
-
     if(!(flags & JSON_ENCODE_ANY)) {
         if(!json_is_array(json) && !json_is_object(json))
            return -1;
     }
 
-    if (hashtable_init(&parents_set))
+    return do_dump(json, flags, 0, NULL, callback, data);
+}
+
+int json_dump_callback_ex(const json_t *json, json_dump_callback_t callback, void *data,
+                          size_t flags, size_t buffer_size)
+{
+    char *buffer;
+    int res;
+
+    if(buffer_size == 0)
+        return json_dump_callback(json, callback, data, flags);
+
+    buffer = jsonp_malloc(buffer_size);
+    if(!buffer)
         return -1;
-    res = do_dump(json, flags, 0, &parents_set, callback, data);
-    hashtable_close(&parents_set);
 
+    res = dump_buffered(json, callback, data, flags, buffer, buffer_size);
+
+    jsonp_free(buffer);
     return res;
 }
+
+/*** BOS ***/
+
+/* The unread part of the BOS data given to bos_to_json() */
+struct bos_reader {
+    const unsigned char *pos;
+    const unsigned char *end;
+};
+
+/* Keys of an object being dumped with JSON_SORT_KEYS */
+struct bos_entry {
+    const char *key;
+    size_t len;
+    const unsigned char *value;
+};
+
+static int bos_read(struct bos_reader *reader, void *destination, size_t size)
+{
+    if((size_t)(reader->end - reader->pos) < size)
+        return -1;
+
+    memcpy(destination, reader->pos, size);
+    reader->pos += size;
+    return 0;
+}
+
+static int bos_read_uvarint(struct bos_reader *reader, size_t *value)
+{
+    uint8_t type_flag;
+    uint16_t le16;
+    uint32_t le32;
+    uint64_t le64;
+
+    if(bos_read(reader, &type_flag, 1))
+        return -1;
+
+    switch(type_flag) {
+        case 0xFF:
+            if(bos_read(reader, &le64, 8))
+                return -1;
+            *value = (size_t)le64;
+            return 0;
+        case 0xFE:
+            if(bos_read(reader, &le32, 4))
+                return -1;
+            *value = le32;
+            return 0;
+        case 0xFD:
+            if(bos_read(reader, &le16, 2))
+                return -1;
+            *value = le16;
+            return 0;
+        default:
+            *value = type_flag;
+            return 0;
+    }
+}
+
+/* Strings and bytes are used in place */
+static int bos_read_raw(struct bos_reader *reader, const unsigned char **value, size_t *len)
+{
+    if(bos_read_uvarint(reader, len) ||
+       (size_t)(reader->end - reader->pos) < *len)
+        return -1;
+
+    *value = reader->pos;
+    reader->pos += *len;
+    return 0;
+}
+
+/* Like bos_deserialize(), strings end at the first NUL byte */
+static int bos_read_string(struct bos_reader *reader, const char **str, size_t *len)
+{
+    const unsigned char *value;
+    const char *nul;
+
+    if(bos_read_raw(reader, &value, len))
+        return -1;
+
+    *str = (const char *)value;
+    nul = memchr(*str, '\0', *len);
+    if(nul)
+        *len = nul - *str;
+    return 0;
+}
+
+static int compare_bos_entries(const void *entry1, const void *entry2)
+{
+    const struct bos_entry *e1 = (const struct bos_entry *)entry1;
+    const struct bos_entry *e2 = (const struct bos_entry *)entry2;
+    int cmp = memcmp(e1->key, e2->key, e1->len < e2->len ? e1->len : e2->len);
+
+    if(cmp)
+        return cmp;
+    return e1->len < e2->len ? -1 : e1->len > e2->len;
+}
+
+static int bos_skip_value(struct bos_reader *reader, int depth)
+{
+    uint8_t data_type;
+    uint64_t fixed;
+    const unsigned char *raw;
+    size_t len, i;
+
+    if(depth > JSON_PARSER_MAX_DEPTH || bos_read(reader, &data_type, 1))
+        return -1;
+
+    switch(data_type) {
+        case BOS_NULL:
+            return 0;
+        case BOS_BOOL:
+        case BOS_INT8:
+        case BOS_UINT8:
+            return bos_read(reader, &fixed, 1);
+        case BOS_INT16:
+        case BOS_UINT16:
+            return bos_read(reader, &fixed, 2);
+        case BOS_INT32:
+        case BOS_UINT32:
+        case BOS_FLOAT:
+            return bos_read(reader, &fixed, 4);
+        case BOS_INT64:
+        case BOS_UINT64:
+        case BOS_DOUBLE:
+            return bos_read(reader, &fixed, 8);
+        case BOS_STRING:
+        case BOS_BYTES:
+            return bos_read_raw(reader, &raw, &len);
+        case BOS_ARRAY:
+        case BOS_OBJ:
+            if(bos_read_uvarint(reader, &len))
+                return -1;
+            for(i = 0; i < len; i++) {
+                size_t key_len;
+
+                if(data_type == BOS_OBJ && bos_read_raw(reader, &raw, &key_len))
+                    return -1;
+                if(bos_skip_value(reader, depth + 1))
+                    return -1;
+            }
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+static int bos_dump_value(struct bos_reader *reader, size_t flags, int depth,
+                          json_dump_callback_t dump, void *data);
+
+/* Dump the entries of an array or of an object. Object entries with
+   keys that are not valid UTF-8 are left out, like bos_deserialize()
+   leaves them out. */
+static int bos_dump_entries(struct bos_reader *reader, size_t count, int is_object,
+                            size_t flags, int depth, json_dump_callback_t dump, void *data)
+{
+    const char *separator = flags & JSON_COMPACT ? ":" : ": ";
+    size_t i, dumped = 0;
+
+    for(i = 0; i < count; i++) {
+        const char *key;
+        size_t len;
+
+        if(is_object) {
+            if(bos_read_string(reader, &key, &len))
+                return -1;
+
+            if(!utf8_check_string(key, len)) {
+                if(bos_skip_value(reader, depth + 1))
+                    return -1;
+                continue;
+            }
+        }
+
+        if(dumped++ == 0) {
+            if(dump_indent(flags, depth + 1, 0, dump, data))
+                return -1;
+        }
+        else if(dump(",", 1, data) || dump_indent(flags, depth + 1, 1, dump, data))
+            return -1;
+
+        if(is_object) {
+            if(dump_string(key, len, dump, data, flags) ||
+               dump(separator, strlen(separator), data))
+                return -1;
+        }
+
+        if(bos_dump_value(reader, flags, depth + 1, dump, data))
+            return -1;
+    }
+
+    if(dumped && dump_indent(flags, depth, 0, dump, data))
+        return -1;
+    return 0;
+}
+
+/* JSON_SORT_KEYS: find the keys first, then dump the entries in order */
+static int bos_dump_sorted(struct bos_reader *reader, size_t count, size_t flags, int depth,
+                           json_dump_callback_t dump, void *data)
+{
+    struct bos_entry *entries;
+    const char *separator = flags & JSON_COMPACT ? ":" : ": ";
+    struct bos_reader value;
+    size_t i, n = 0;
+    int res = -1;
+
+    /* every entry takes at least two bytes */
+    if(count > (size_t)(reader->end - reader->pos) / 2)
+        return -1;
+
+    entries = jsonp_malloc((count ? count : 1) * sizeof(struct bos_entry));
+    if(!entries)
+        return -1;
+
+    for(i = 0; i < count; i++) {
+        if(bos_read_string(reader, &entries[n].key, &entries[n].len))
+            goto out;
+
+        entries[n].value = reader->pos;
+        if(bos_skip_value(reader, depth + 1))
+            goto out;
+
+        if(utf8_check_string(entries[n].key, entries[n].len))
+            n++;
+    }
+
+    qsort(entries, n, sizeof(struct bos_entry), compare_bos_entries);
+
+    value.end = reader->end;
+    for(i = 0; i < n; i++) {
+        if(i == 0) {
+            if(dump_indent(flags, depth + 1, 0, dump, data))
+                goto out;
+        }
+        else if(dump(",", 1, data) || dump_indent(flags, depth + 1, 1, dump, data))
+            goto out;
+
+        value.pos = entries[i].value;
+        if(dump_string(entries[i].key, entries[i].len, dump, data, flags) ||
+           dump(separator, strlen(separator), data) ||
+           bos_dump_value(&value, flags, depth + 1, dump, data))
+            goto out;
+    }
+
+    if(n && dump_indent(flags, depth, 0, dump, data))
+        goto out;
+    res = 0;
+
+out:
+    jsonp_free(entries);
+    return res;
+}
+
+static int bos_dump_value(struct bos_reader *reader, size_t flags, int depth,
+                          json_dump_callback_t dump, void *data)
+{
+    int embed = flags & JSON_EMBED;
+    char buffer[MAX_REAL_STR_LENGTH];
+    int size;
+    uint8_t data_type;
+    const unsigned char *raw;
+    size_t len;
+
+    flags &= ~JSON_EMBED;
+
+    /* the data may be nested deeper than the stack allows */
+    if(depth > JSON_PARSER_MAX_DEPTH || bos_read(reader, &data_type, 1))
+        return -1;
+
+    switch(data_type) {
+        case BOS_NULL:
+            return dump("null", 4, data);
+
+        case BOS_BOOL:
+        {
+            uint8_t value;
+            if(bos_read(reader, &value, 1))
+                return -1;
+            return value ? dump("true", 4, data) : dump("false", 5, data);
+        }
+
+        case BOS_INT8:
+        case BOS_INT16:
+        case BOS_INT32:
+        case BOS_INT64:
+        case BOS_UINT8:
+        case BOS_UINT16:
+        case BOS_UINT32:
+        case BOS_UINT64:
+        {
+            json_int_t value;
+
+            switch(data_type) {
+                case BOS_INT8: { int8_t v; if(bos_read(reader, &v, 1)) return -1; value = v; break; }
+                case BOS_INT16: { int16_t v; if(bos_read(reader, &v, 2)) return -1; value = v; break; }
+                case BOS_INT32: { int32_t v; if(bos_read(reader, &v, 4)) return -1; value = v; break; }
+                case BOS_UINT8: { uint8_t v; if(bos_read(reader, &v, 1)) return -1; value = v; break; }
+                case BOS_UINT16: { uint16_t v; if(bos_read(reader, &v, 2)) return -1; value = v; break; }
+                case BOS_UINT32: { uint32_t v; if(bos_read(reader, &v, 4)) return -1; value = v; break; }
+                default: { int64_t v; if(bos_read(reader, &v, 8)) return -1; value = (json_int_t)v; break; }
+            }
+
+            size = jsonp_itostr(buffer, MAX_INTEGER_STR_LENGTH, value);
+            if(size < 0)
+                return -1;
+            return dump(buffer, size, data);
+        }
+
+        case BOS_FLOAT:
+        case BOS_DOUBLE:
+        {
+            double value;
+
+            if(data_type == BOS_FLOAT) {
+                float real;
+                if(bos_read(reader, &real, 4))
+                    return -1;
+                value = real;
+            }
+            else if(bos_read(reader, &value, 8))
+                return -1;
+
+            /* NaN and infinity have no JSON representation, see json_real() */
+            if(value - value != 0.0)
+                return -1;
+
+            size = jsonp_dtostr(buffer, MAX_REAL_STR_LENGTH, value,
+                                FLAGS_TO_PRECISION(flags));
+            if(size < 0)
+                return -1;
+            return dump(buffer, size, data);
+        }
+
+        case BOS_STRING:
+        {
+            const char *str;
+            if(bos_read_string(reader, &str, &len))
+                return -1;
+            return dump_string(str, len, dump, data, flags);
+        }
+
+        case BOS_BYTES:
+            if(bos_read_raw(reader, &raw, &len))
+                return -1;
+            return dump_bytes(raw, len, flags, depth, dump, data);
+
+        case BOS_ARRAY:
+            if(bos_read_uvarint(reader, &len))
+                return -1;
+            if(!embed && dump("[", 1, data))
+                return -1;
+            if(bos_dump_entries(reader, len, 0, flags, depth, dump, data))
+                return -1;
+            return embed ? 0 : dump("]", 1, data);
+
+        case BOS_OBJ:
+            if(bos_read_uvarint(reader, &len))
+                return -1;
+            if(!embed && dump("{", 1, data))
+                return -1;
+            if(flags & JSON_SORT_KEYS) {
+                if(bos_dump_sorted(reader, len, flags, depth, dump, data))
+                    return -1;
+            }
+            else if(bos_dump_entries(reader, len, 1, flags, depth, dump, data))
+                return -1;
+            return embed ? 0 : dump("}", 1, data);
+
+        default:
+            return -1;
+    }
+}
+
+int bos_to_json(const void *data, size_t size, size_t flags,
+                json_dump_callback_t callback, void *ctx)
+{
+    struct bos_reader reader;
+    uint32_t data_size;
+    uint8_t data_type;
+
+    if(!data || size < 5)
+        return -1;
+
+    /* the data ends where its size says, or where the buffer does */
+    memcpy(&data_size, data, sizeof(uint32_t));
+    if(data_size < 5)
+        return -1;
+
+    reader.pos = (const unsigned char *)data + 4;
+    reader.end = (const unsigned char *)data + (data_size < size ? data_size : size);
+
+    if(!(flags & JSON_ENCODE_ANY)) {
+        data_type = *reader.pos;
+        if(data_type != BOS_ARRAY && data_type != BOS_OBJ)
+            return -1;
+    }
+
+    return bos_dump_value(&reader, flags, 0, callback, ctx);
+}
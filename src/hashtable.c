@@ -24,188 +24,428 @@
 #define INITIAL_HASHTABLE_ORDER 3
 #endif
 
-typedef struct hashtable_list list_t;
+/* Tables of up to this many keys have no index and are searched
+   linearly */
+#ifndef HASHTABLE_SMALL_SIZE
+#define HASHTABLE_SMALL_SIZE 8
+#endif
+
 typedef struct hashtable_pair pair_t;
-typedef struct hashtable_bucket bucket_t;
+typedef struct hashtable_entry entry_t;
+typedef struct hashtable_small small_t;
 
 extern volatile uint32_t hashtable_seed;
 
-/* Implementation of the hash function */
+/* Implementation of the hash function, chosen at build time */
+#if defined(USE_HASH_LOOKUP3)
 #include "lookup3.h"
+#elif defined(USE_HASH_SIPHASH)
+#include "siphash.h"
+
+/* set with hashtable_seed, see hashtable_seed.c */
+extern uint64_t hashtable_key[2];
+#else
+#include "wyhash.h"
+#endif
+
+/* offsetof(...) returns the size of pair_t without the last, flexible
+   member */
+#define pair_size(pair_)     (offsetof(pair_t, key) + (pair_)->len + 1)
+
+/* Pairs in a pair block are aligned like the block itself */
+#define pair_round(size_)    (((size_) + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1))
+
+/* Small tables whose keys are longer than this on average allocate
+   each pair on its own */
+#define PAIR_BLOCK_MAX_KEY   128
+
+/* The first pair block of a table also has its first entries */
+#define FIRST_CAPACITY       2
+
+/* The layout follows CPython's compact dict: the index is an open
+   addressed table of entry numbers, which are small, and the entries
+   are kept densely in insertion order. At most two thirds of the
+   slots are used, including those of deleted keys.
+
+   Small tables are flat: they have only the entries, which are
+   allocated when the first key is added. Their pairs are carved out
+   of pair blocks. */
+#define INDEX_EMPTY    (-1)
+#define INDEX_DELETED  (-2)
+#define PERTURB_SHIFT  5
 
-#define list_to_pair(list_)  container_of(list_, pair_t, list)
-#define ordered_list_to_pair(list_)  container_of(list_, pair_t, ordered_list)
-#define hash_str(key)        ((size_t)hashlittle((key), strlen(key), hashtable_seed))
+#define slots(order_)   ((size_t)1 << (order_))
+#define usable(order_)  (slots(order_) / 3 * 2 + slots(order_) % 3 * 2 / 3)
 
-static JSON_INLINE void list_init(list_t *list)
+static JSON_INLINE size_t index_width(size_t order)
 {
-    list->next = list;
-    list->prev = list;
+    if(order < 8)
+        return 1;
+    if(order < 16)
+        return 2;
+    if(order < 32)
+        return 4;
+    return 8;
 }
 
-static JSON_INLINE void list_insert(list_t *list, list_t *node)
+/* order 0 means that there is no index */
+static JSON_INLINE size_t index_size(size_t order)
 {
-    node->next = list;
-    node->prev = list->prev;
-    list->prev->next = node;
-    list->prev = node;
+    return order ? slots(order) * index_width(order) : 0;
 }
 
-static JSON_INLINE void list_remove(list_t *list)
+static JSON_INLINE size_t block_size(size_t order, size_t capacity)
 {
-    list->prev->next = list->next;
-    list->next->prev = list->prev;
+    return index_size(order) + capacity * sizeof(entry_t);
 }
 
-static JSON_INLINE int bucket_is_empty(hashtable_t *hashtable, bucket_t *bucket)
+static JSON_INLINE ptrdiff_t get_index(const hashtable_t *hashtable, size_t slot)
 {
-    return bucket->first == &hashtable->list && bucket->first == bucket->last;
+    switch(index_width(hashtable->order)) {
+        case 1: return ((const int8_t *)hashtable->indices)[slot];
+        case 2: return ((const int16_t *)hashtable->indices)[slot];
+        case 4: return ((const int32_t *)hashtable->indices)[slot];
+        default: return (ptrdiff_t)((const int64_t *)hashtable->indices)[slot];
+    }
 }
 
-static void insert_to_bucket(hashtable_t *hashtable, bucket_t *bucket,
-                             list_t *list)
+static JSON_INLINE void set_index(hashtable_t *hashtable, size_t slot, ptrdiff_t index)
 {
-    if(bucket_is_empty(hashtable, bucket))
-    {
-        list_insert(&hashtable->list, list);
-        bucket->first = bucket->last = list;
-    }
-    else
-    {
-        list_insert(bucket->first, list);
-        bucket->first = list;
+    switch(index_width(hashtable->order)) {
+        case 1: ((int8_t *)hashtable->indices)[slot] = (int8_t)index; break;
+        case 2: ((int16_t *)hashtable->indices)[slot] = (int16_t)index; break;
+        case 4: ((int32_t *)hashtable->indices)[slot] = (int32_t)index; break;
+        default: ((int64_t *)hashtable->indices)[slot] = (int64_t)index; break;
     }
 }
 
-static pair_t *hashtable_find_pair(hashtable_t *hashtable, bucket_t *bucket,
-                                   const char *key, size_t hash)
+static JSON_INLINE void *hashtable_block(hashtable_t *hashtable)
 {
-    list_t *list;
-    pair_t *pair;
+    return hashtable->order ? hashtable->indices : (void *)hashtable->entries;
+}
+
+/* whether the entries are in the first pair block */
+static JSON_INLINE int hashtable_entries_inline(const hashtable_t *hashtable)
+{
+    return !hashtable->order && hashtable->capacity &&
+           hashtable->capacity <= FIRST_CAPACITY;
+}
 
-    if(bucket_is_empty(hashtable, bucket))
+static void hashtable_set_block(hashtable_t *hashtable, void *block,
+                                size_t order, size_t capacity)
+{
+    hashtable->order = order;
+    hashtable->capacity = capacity;
+    hashtable->indices = order ? block : NULL;
+    hashtable->entries = (entry_t *)((char *)block + index_size(order));
+}
+
+/* all bits set is INDEX_EMPTY in any width */
+static void hashtable_clear_index(hashtable_t *hashtable)
+{
+    memset(hashtable->indices, 0xff, index_size(hashtable->order));
+}
+
+/* The lengths are compared first, so that memcmp() reads no further
+   than the end of either key */
+static JSON_INLINE int pair_equal(const pair_t *pair, const char *key, size_t len)
+{
+    return pair->len == len && memcmp(pair->key, key, len) == 0;
+}
+
+/* The probing loop of hashtable_find_pair() for one index width */
+#define FIND_PAIR(type_)                                                  \
+    do {                                                                  \
+        const type_ *indices = (const type_ *)hashtable->indices;        \
+        while(1) {                                                        \
+            ptrdiff_t index = indices[i];                                 \
+            if(index == INDEX_EMPTY)                                      \
+                return NULL;                                              \
+            if(index >= 0) {                                              \
+                entry_t *entry = &hashtable->entries[index];              \
+                if(entry->hash == hash &&                                 \
+                   pair_equal(entry->pair, key, len)) {                   \
+                    if(slot)                                              \
+                        *slot = i;                                        \
+                    return entry->pair;                                   \
+                }                                                         \
+            }                                                             \
+            perturb >>= PERTURB_SHIFT;                                    \
+            i = (i * 5 + perturb + 1) & mask;                             \
+        }                                                                 \
+    } while(0)
+
+static pair_t *hashtable_find_pair(hashtable_t *hashtable, const char *key,
+                                   size_t len, size_t hash, size_t *slot)
+{
+    size_t mask = slots(hashtable->order) - 1;
+    size_t perturb = hash;
+    size_t i = hash & mask;
+
+    if(!hashtable->order) {
+        for(i = 0; i < hashtable->used; i++) {
+            entry_t *entry = &hashtable->entries[i];
+            if(entry->hash == hash && entry->pair &&
+               pair_equal(entry->pair, key, len))
+                return entry->pair;
+        }
         return NULL;
+    }
 
-    list = bucket->first;
-    while(1)
-    {
-        pair = list_to_pair(list);
-        if(pair->hash == hash && strcmp(pair->key, key) == 0)
-            return pair;
+    switch(index_width(hashtable->order)) {
+        case 1: FIND_PAIR(int8_t);
+        case 2: FIND_PAIR(int16_t);
+        case 4: FIND_PAIR(int32_t);
+        default: FIND_PAIR(int64_t);
+    }
+}
 
-        if(list == bucket->last)
-            break;
+static size_t hashtable_find_empty_slot(hashtable_t *hashtable, size_t hash)
+{
+    size_t mask = slots(hashtable->order) - 1;
+    size_t perturb = hash;
+    size_t i = hash & mask;
 
-        list = list->next;
+    while(get_index(hashtable, i) != INDEX_EMPTY) {
+        perturb >>= PERTURB_SHIFT;
+        i = (i * 5 + perturb + 1) & mask;
     }
+    return i;
+}
 
-    return NULL;
+/* Drop the entries of deleted keys and index the rest again, if the
+   table has an index */
+static void hashtable_build_index(hashtable_t *hashtable)
+{
+    size_t i, used = 0;
+
+    for(i = 0; i < hashtable->used; i++) {
+        entry_t entry = hashtable->entries[i];
+        if(!entry.pair)
+            continue;
+
+        entry.pair->index = used;
+        hashtable->entries[used++] = entry;
+    }
+    hashtable->used = used;
+
+    if(!hashtable->order)
+        return;
+
+    hashtable_clear_index(hashtable);
+    for(i = 0; i < used; i++) {
+        size_t slot = hashtable_find_empty_slot(hashtable, hashtable->entries[i].hash);
+        set_index(hashtable, slot, (ptrdiff_t)i);
+    }
 }
 
-/* returns 0 on success, -1 if key was not found */
-static int hashtable_do_del(hashtable_t *hashtable,
-                            const char *key, size_t hash)
+/* Add a pair block with room for count more pairs, and for the given
+   number of entries in front of them. The size of the pairs is guessed
+   from the keys so far and the one of len bytes that is being added.
+   Without a block, or if a pair doesn't fit, the pair is allocated on
+   its own, so this only fails if there are entries. */
+static small_t *hashtable_add_pair_block(hashtable_t *hashtable, size_t entries,
+                                         size_t count, size_t len)
 {
-    pair_t *pair;
-    bucket_t *bucket;
-    size_t index;
+    size_t i, total = len, average, size;
+    small_t *small;
 
-    index = hash & hashmask(hashtable->order);
-    bucket = &hashtable->buckets[index];
+    for(i = 0; i < hashtable->used; i++) {
+        if(hashtable->entries[i].pair)
+            total += hashtable->entries[i].pair->len;
+    }
+    average = (total + hashtable->size) / (hashtable->size + 1);
+    if(average > PAIR_BLOCK_MAX_KEY)
+        count = 0;
 
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
-    if(!pair)
-        return -1;
+    if(!entries && !count)
+        return NULL;
 
-    if(&pair->list == bucket->first && &pair->list == bucket->last)
-        bucket->first = bucket->last = &hashtable->list;
+    size = sizeof(small_t) + entries * sizeof(entry_t) +
+           count * pair_round(offsetof(pair_t, key) + average + 1);
+    small = jsonp_arena_malloc(hashtable->arena, size);
+    if(!small)
+        return NULL;
 
-    else if(&pair->list == bucket->first)
-        bucket->first = pair->list.next;
+    small->next = hashtable->small;
+    small->size = (unsigned int)size;
+    small->pos = (unsigned int)(sizeof(small_t) + entries * sizeof(entry_t));
+    hashtable->small = small;
+    return small;
+}
 
-    else if(&pair->list == bucket->last)
-        bucket->last = pair->list.prev;
+/* Make room for one more entry, for a key of len bytes */
+static int hashtable_do_rehash(hashtable_t *hashtable, size_t len)
+{
+    size_t old_order = hashtable->order;
+    size_t old_capacity = hashtable->capacity;
+    size_t new_order = old_order;
+    size_t new_capacity;
+    char *block;
+
+    if(!old_order && hashtable->size < HASHTABLE_SMALL_SIZE) {
+        /* stay flat, growing unless deleted keys leave room */
+        if(!old_capacity) {
+            small_t *small = hashtable_add_pair_block(hashtable, FIRST_CAPACITY,
+                                                      FIRST_CAPACITY, len);
+            if(!small)
+                return -1;
+
+            hashtable_set_block(hashtable, small + 1, 0, FIRST_CAPACITY);
+            return 0;
+        }
 
-    list_remove(&pair->list);
-    list_remove(&pair->ordered_list);
-    json_decref(pair->value);
+        new_capacity = old_capacity;
+        if(hashtable->size == old_capacity) {
+            /* 2, 4, 6, 8 */
+            new_capacity = old_capacity < 4 ? old_capacity * 2 :
+                old_capacity + old_capacity / 2;
+            if(new_capacity > HASHTABLE_SMALL_SIZE)
+                new_capacity = HASHTABLE_SMALL_SIZE;
+        }
+    }
+    else {
+        /* grow unless deleted keys leave room for as many keys again */
+        if(!new_order)
+            new_order = INITIAL_HASHTABLE_ORDER;
+        while(usable(new_order) < hashtable->size * 2) {
+            new_order++;
+            if(new_order >= sizeof(size_t) * 8 - 5)
+                return -1;
+        }
+        new_capacity = usable(new_order);
+    }
 
-    jsonp_free(pair);
-    hashtable->size--;
+    if(hashtable_entries_inline(hashtable) &&
+       (new_order != old_order || new_capacity != old_capacity)) {
+        /* the first pair block is kept for its pairs */
+        block = jsonp_arena_malloc(hashtable->arena,
+                                   block_size(new_order, new_capacity));
+        if(!block)
+            return -1;
+
+        memcpy(block + index_size(new_order), hashtable->entries,
+               hashtable->used * sizeof(entry_t));
+        hashtable_set_block(hashtable, block, new_order, new_capacity);
+    }
+    else if(new_order != old_order || new_capacity != old_capacity) {
+        /* the entries start further into a larger block, and the
+           index is built again anyway */
+        block = jsonp_arena_realloc(hashtable->arena, hashtable_block(hashtable),
+                                    block_size(old_order, old_capacity),
+                                    block_size(new_order, new_capacity));
+        if(!block)
+            return -1;
+
+        memmove(block + index_size(new_order), block + index_size(old_order),
+                hashtable->used * sizeof(entry_t));
+        hashtable_set_block(hashtable, block, new_order, new_capacity);
+    }
 
+    /* the pairs of keys that don't fit in a small table any more are
+       allocated on their own */
+    if(!new_order && new_capacity != old_capacity)
+        hashtable_add_pair_block(hashtable, 0, new_capacity - hashtable->size, len);
+
+
+    hashtable_build_index(hashtable);
     return 0;
 }
 
-static void hashtable_do_clear(hashtable_t *hashtable)
+static pair_t *hashtable_new_pair(hashtable_t *hashtable, size_t len)
 {
-    list_t *list, *next;
+    size_t size = pair_round(offsetof(pair_t, key) + len + 1);
+    small_t *small = hashtable->small;
     pair_t *pair;
 
-    for(list = hashtable->list.next; list != &hashtable->list; list = next)
-    {
-        next = list->next;
-        pair = list_to_pair(list);
-        json_decref(pair->value);
-        jsonp_free(pair);
+    if(small && size <= small->size - small->pos) {
+        pair = (pair_t *)((char *)small + small->pos);
+        small->pos += (unsigned int)size;
+        pair->in_block = 1;
+        return pair;
     }
+
+    pair = jsonp_arena_malloc(hashtable->arena, offsetof(pair_t, key) + len + 1);
+    if(pair)
+        pair->in_block = 0;
+    return pair;
 }
 
-static int hashtable_do_rehash(hashtable_t *hashtable)
+/* pairs in pair blocks go with the blocks */
+static void hashtable_free_pair(hashtable_t *hashtable, pair_t *pair)
 {
-    list_t *list, *next;
-    pair_t *pair;
-    size_t i, index, new_size, new_order;
-    struct hashtable_bucket *new_buckets;
+    if(!pair->in_block)
+        jsonp_arena_free(hashtable->arena, pair, pair_size(pair));
+}
 
-    new_order = hashtable->order + 1;
-    new_size = hashsize(new_order);
+/* returns 0 on success, -1 if key was not found */
+static int hashtable_do_del(hashtable_t *hashtable,
+                            const char *key, size_t len, size_t hash)
+{
+    pair_t *pair;
+    size_t slot;
 
-    new_buckets = jsonp_malloc(new_size * sizeof(bucket_t));
-    if(!new_buckets)
+    pair = hashtable_find_pair(hashtable, key, len, hash, &slot);
+    if(!pair)
         return -1;
 
-    jsonp_free(hashtable->buckets);
-    hashtable->buckets = new_buckets;
-    hashtable->order = new_order;
+    if(hashtable->order)
+        set_index(hashtable, slot, INDEX_DELETED);
+    hashtable->entries[pair->index].pair = NULL;
+    json_decref(pair->value);
+
+    hashtable_free_pair(hashtable, pair);
+    hashtable->size--;
 
-    for(i = 0; i < hashsize(hashtable->order); i++)
+    return 0;
+}
+
+static void hashtable_do_clear(hashtable_t *hashtable)
+{
+    size_t i;
+
+    for(i = 0; i < hashtable->used; i++)
     {
-        hashtable->buckets[i].first = hashtable->buckets[i].last =
-            &hashtable->list;
+        pair_t *pair = hashtable->entries[i].pair;
+        if(!pair)
+            continue;
+
+        json_decref(pair->value);
+        hashtable_free_pair(hashtable, pair);
     }
+}
 
-    list = hashtable->list.next;
-    list_init(&hashtable->list);
+static void hashtable_free_blocks(hashtable_t *hashtable)
+{
+    small_t *small = hashtable->small;
 
-    for(; list != &hashtable->list; list = next) {
-        next = list->next;
-        pair = list_to_pair(list);
-        index = pair->hash % new_size;
-        insert_to_bucket(hashtable, &hashtable->buckets[index], &pair->list);
-    }
+    if(!hashtable_entries_inline(hashtable))
+        jsonp_arena_free(hashtable->arena, hashtable_block(hashtable),
+                         block_size(hashtable->order, hashtable->capacity));
 
-    return 0;
+    while(small) {
+        small_t *next = small->next;
+        jsonp_arena_free(hashtable->arena, small, small->size);
+        small = next;
+    }
 }
 
-
-int hashtable_init(hashtable_t *hashtable)
+static void hashtable_reset(hashtable_t *hashtable)
 {
-    size_t i;
-
     hashtable->size = 0;
-    hashtable->order = INITIAL_HASHTABLE_ORDER;
-    hashtable->buckets = jsonp_malloc(hashsize(hashtable->order) * sizeof(bucket_t));
-    if(!hashtable->buckets)
-        return -1;
+    hashtable->used = 0;
+    hashtable->capacity = 0;
+    hashtable->order = 0;
+    hashtable->indices = NULL;
+    hashtable->entries = NULL;
+    hashtable->small = NULL;
+}
 
-    list_init(&hashtable->list);
-    list_init(&hashtable->ordered_list);
 
-    for(i = 0; i < hashsize(hashtable->order); i++)
-    {
-        hashtable->buckets[i].first = hashtable->buckets[i].last =
-            &hashtable->list;
-    }
+int hashtable_init(hashtable_t *hashtable, json_arena_t *arena)
+{
+    hashtable->arena = arena;
+    hashtable_reset(hashtable);
 
     return 0;
 }
@@ -213,70 +453,88 @@ int hashtable_init(hashtable_t *hashtable)
 void hashtable_close(hashtable_t *hashtable)
 {
     hashtable_do_clear(hashtable);
-    jsonp_free(hashtable->buckets);
+    hashtable_free_blocks(hashtable);
 }
 
-int hashtable_set(hashtable_t *hashtable, const char *key, json_t *value)
+size_t hashtable_hash(const char *key, size_t len)
 {
-    pair_t *pair;
-    bucket_t *bucket;
-    size_t hash, index;
+#if defined(USE_HASH_LOOKUP3)
+    return (size_t)hashlittle(key, len, hashtable_seed);
+#elif defined(USE_HASH_SIPHASH)
+    return (size_t)siphash(key, len, hashtable_key[0], hashtable_key[1]);
+#else
+    return (size_t)wyhash(key, len, hashtable_seed);
+#endif
+}
 
-    /* rehash if the load ratio exceeds 1 */
-    if(hashtable->size >= hashsize(hashtable->order))
-        if(hashtable_do_rehash(hashtable))
-            return -1;
+int hashtable_set(hashtable_t *hashtable, const char *key, json_t *value)
+{
+    size_t len = strlen(key);
+    return hashtable_set_hashed(hashtable, key, len, hashtable_hash(key, len), value);
+}
 
-    hash = hash_str(key);
-    index = hash & hashmask(hashtable->order);
-    bucket = &hashtable->buckets[index];
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
+int hashtable_set_hashed(hashtable_t *hashtable, const char *key, size_t len,
+                         size_t hash, json_t *value)
+{
+    pair_t *pair;
+    entry_t *entry;
+    size_t slot;
 
+    pair = hashtable_find_pair(hashtable, key, len, hash, NULL);
     if(pair)
     {
         json_decref(pair->value);
         pair->value = value;
+        return 0;
     }
-    else
-    {
-        /* offsetof(...) returns the size of pair_t without the last,
-           flexible member. This way, the correct amount is
-           allocated. */
 
-        size_t len = strlen(key);
-        if(len >= (size_t)-1 - offsetof(pair_t, key)) {
-            /* Avoid an overflow if the key is very long */
-            return -1;
-        }
+    /* offsetof(...) returns the size of pair_t without the last,
+       flexible member. This way, the correct amount is allocated. */
 
-        pair = jsonp_malloc(offsetof(pair_t, key) + len + 1);
-        if(!pair)
+    if(len >= (size_t)-1 - offsetof(pair_t, key) - sizeof(size_t)) {
+        /* Avoid an overflow if the key is very long */
+        return -1;
+    }
+
+    if(hashtable->used >= hashtable->capacity)
+        if(hashtable_do_rehash(hashtable, len))
             return -1;
 
-        pair->hash = hash;
-        strncpy(pair->key, key, len + 1);
-        pair->value = value;
-        list_init(&pair->list);
-        list_init(&pair->ordered_list);
+    pair = hashtable_new_pair(hashtable, len);
+    if(!pair)
+        return -1;
+
+    memcpy(pair->key, key, len);
+    pair->key[len] = '\0';
+    pair->value = value;
+    pair->index = hashtable->used;
+    pair->len = len;
 
-        insert_to_bucket(hashtable, bucket, &pair->list);
-        list_insert(&hashtable->ordered_list, &pair->ordered_list);
+    entry = &hashtable->entries[hashtable->used++];
+    entry->hash = hash;
+    entry->pair = pair;
 
-        hashtable->size++;
+    if(hashtable->order) {
+        slot = hashtable_find_empty_slot(hashtable, hash);
+        set_index(hashtable, slot, (ptrdiff_t)pair->index);
     }
+
+    hashtable->size++;
     return 0;
 }
 
 void *hashtable_get(hashtable_t *hashtable, const char *key)
 {
-    pair_t *pair;
-    size_t hash;
-    bucket_t *bucket;
+    size_t len = strlen(key);
+    return hashtable_get_hashed(hashtable, key, len, hashtable_hash(key, len));
+}
 
-    hash = hash_str(key);
-    bucket = &hashtable->buckets[hash & hashmask(hashtable->order)];
+void *hashtable_get_hashed(hashtable_t *hashtable, const char *key, size_t len,
+                           size_t hash)
+{
+    pair_t *pair;
 
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
+    pair = hashtable_find_pair(hashtable, key, len, hash, NULL);
     if(!pair)
         return NULL;
 
@@ -285,71 +543,66 @@ void *hashtable_get(hashtable_t *hashtable, const char *key)
 
 int hashtable_del(hashtable_t *hashtable, const char *key)
 {
-    size_t hash = hash_str(key);
-    return hashtable_do_del(hashtable, key, hash);
+    size_t len = strlen(key);
+    return hashtable_do_del(hashtable, key, len, hashtable_hash(key, len));
 }
 
-void hashtable_clear(hashtable_t *hashtable)
+int hashtable_del_hashed(hashtable_t *hashtable, const char *key, size_t len,
+                         size_t hash)
 {
-    size_t i;
+    return hashtable_do_del(hashtable, key, len, hash);
+}
 
+void hashtable_clear(hashtable_t *hashtable)
+{
+    /* the pairs may be in the pair blocks, so these go too */
     hashtable_do_clear(hashtable);
+    hashtable_free_blocks(hashtable);
+    hashtable_reset(hashtable);
+}
 
-    for(i = 0; i < hashsize(hashtable->order); i++)
-    {
-        hashtable->buckets[i].first = hashtable->buckets[i].last =
-            &hashtable->list;
+/* The first pair from the entry at index on */
+static void *hashtable_iter_from(hashtable_t *hashtable, size_t index)
+{
+    for(; index < hashtable->used; index++) {
+        if(hashtable->entries[index].pair)
+            return hashtable->entries[index].pair;
     }
-
-    list_init(&hashtable->list);
-    list_init(&hashtable->ordered_list);
-    hashtable->size = 0;
+    return NULL;
 }
 
 void *hashtable_iter(hashtable_t *hashtable)
 {
-    return hashtable_iter_next(hashtable, &hashtable->ordered_list);
+    return hashtable_iter_from(hashtable, 0);
 }
 
 void *hashtable_iter_at(hashtable_t *hashtable, const char *key)
 {
-    pair_t *pair;
-    size_t hash;
-    bucket_t *bucket;
-
-    hash = hash_str(key);
-    bucket = &hashtable->buckets[hash & hashmask(hashtable->order)];
-
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
-    if(!pair)
-        return NULL;
-
-    return &pair->ordered_list;
+    size_t len = strlen(key);
+    return hashtable_find_pair(hashtable, key, len, hashtable_hash(key, len), NULL);
 }
 
 void *hashtable_iter_next(hashtable_t *hashtable, void *iter)
 {
-    list_t *list = (list_t *)iter;
-    if(list->next == &hashtable->ordered_list)
-        return NULL;
-    return list->next;
+    pair_t *pair = (pair_t *)iter;
+    return hashtable_iter_from(hashtable, pair->index + 1);
 }
 
 void *hashtable_iter_key(void *iter)
 {
-    pair_t *pair = ordered_list_to_pair((list_t *)iter);
+    pair_t *pair = (pair_t *)iter;
     return pair->key;
 }
 
 void *hashtable_iter_value(void *iter)
 {
-    pair_t *pair = ordered_list_to_pair((list_t *)iter);
+    pair_t *pair = (pair_t *)iter;
     return pair->value;
 }
 
 void hashtable_iter_set(void *iter, json_t *value)
 {
-    pair_t *pair = ordered_list_to_pair((list_t *)iter);
+    pair_t *pair = (pair_t *)iter;
 
     json_decref(pair->value);
     pair->value = value;
@@ -11,51 +11,63 @@
 #include <stdlib.h>
 #include "bosjansson.h"
 
-struct hashtable_list {
-    struct hashtable_list *prev;
-    struct hashtable_list *next;
-};
-
 /* "pair" may be a bit confusing a name, but think of it as a
-   key-value pair. In this case, it just encodes some extra data,
-   too */
+   key-value pair. Pairs don't move, so that a pair, or its key, can
+   be used as an iterator while other keys are added and deleted */
 struct hashtable_pair {
-    struct hashtable_list list;
-    struct hashtable_list ordered_list;
-    size_t hash;
     json_t *value;
+    size_t index;  /* of the pair's entry */
+    size_t len;    /* of the key */
+    char in_block; /* in a pair block, not allocated on its own */
     char key[1];
 };
 
-struct hashtable_bucket {
-    struct hashtable_list *first;
-    struct hashtable_list *last;
+/* The entries are in insertion order. A deleted key leaves an entry
+   without a pair until the entries are compacted. */
+struct hashtable_entry {
+    size_t hash;
+    struct hashtable_pair *pair;
+};
+
+/* A small table carves the pairs of its keys out of pair blocks, one
+   for each time its entries grow, so that the pairs don't move. The
+   first block also has the first two entries. */
+struct hashtable_small {
+    struct hashtable_small *next;  /* the previous block */
+    unsigned int size;  /* of the block, which is small */
+    unsigned int pos;   /* where the next pair goes */
 };
 
 typedef struct hashtable {
-    size_t size;
-    struct hashtable_bucket *buckets;
-    size_t order;  /* hashtable has pow(2, order) buckets */
-    struct hashtable_list list;
-    struct hashtable_list ordered_list;
+    size_t size;      /* number of keys */
+    size_t used;      /* number of entries, including deleted ones */
+    size_t capacity;  /* number of entries allocated */
+    size_t order;     /* the index has pow(2, order) slots, or 0 if
+                         the table is small and has no index */
+    void *indices;    /* open addressed, of 1 to 8 byte entry numbers */
+    struct hashtable_entry *entries;  /* in the same block as indices,
+                                         or in the first pair block */
+    struct hashtable_small *small;  /* pair blocks, newest first */
+    json_arena_t *arena;  /* where pairs and the blocks live, or NULL */
 } hashtable_t;
 
 
 #define hashtable_key_to_iter(key_) \
-    (&(container_of(key_, struct hashtable_pair, key)->ordered_list))
+    (container_of(key_, struct hashtable_pair, key))
 
 
 /**
  * hashtable_init - Initialize a hashtable object
  *
  * @hashtable: The (statically allocated) hashtable object
+ * @arena: The arena to allocate from, or NULL for the heap
  *
  * Initializes a statically allocated hashtable object. The object
  * should be cleared with hashtable_close when it's no longer used.
  *
  * Returns 0 on success, -1 on error (out of memory).
  */
-int hashtable_init(hashtable_t *hashtable) JANSSON_ATTRS(warn_unused_result);
+int hashtable_init(hashtable_t *hashtable, json_arena_t *arena) JANSSON_ATTRS(warn_unused_result);
 
 /**
  * hashtable_close - Release all resources used by a hashtable object
@@ -83,6 +95,32 @@ void hashtable_close(hashtable_t *hashtable);
  */
 int hashtable_set(hashtable_t *hashtable, const char *key, json_t *value);
 
+/**
+ * hashtable_set_hashed - Add/modify value in hashtable with a known hash
+ *
+ * @hashtable: The hashtable object
+ * @key: The key
+ * @len: The length of the key, which need not be NUL terminated
+ * @hash: The hash of the key, as returned by hashtable_hash()
+ * @value: The value
+ *
+ * Like hashtable_set(), but doesn't measure and hash the key again.
+ *
+ * Returns 0 on success, -1 on failure (out of memory).
+ */
+int hashtable_set_hashed(hashtable_t *hashtable, const char *key, size_t len,
+                         size_t hash, json_t *value);
+
+/**
+ * hashtable_hash - Hash a key
+ *
+ * @key: The key
+ * @len: The length of the key
+ *
+ * Returns the hash used for the key in all hashtables.
+ */
+size_t hashtable_hash(const char *key, size_t len);
+
 /**
  * hashtable_get - Get a value associated with a key
  *
@@ -93,6 +131,19 @@ int hashtable_set(hashtable_t *hashtable, const char *key, json_t *value);
  */
 void *hashtable_get(hashtable_t *hashtable, const char *key);
 
+/**
+ * hashtable_get_hashed - Get a value associated with a key with a known hash
+ *
+ * @hashtable: The hashtable object
+ * @key: The key
+ * @len: The length of the key, which need not be NUL terminated
+ * @hash: The hash of the key, as returned by hashtable_hash()
+ *
+ * Returns value if it is found, or NULL otherwise.
+ */
+void *hashtable_get_hashed(hashtable_t *hashtable, const char *key, size_t len,
+                           size_t hash);
+
 /**
  * hashtable_del - Remove a value from the hashtable
  *
@@ -103,6 +154,19 @@ void *hashtable_get(hashtable_t *hashtable, const char *key);
  */
 int hashtable_del(hashtable_t *hashtable, const char *key);
 
+/**
+ * hashtable_del_hashed - Remove a value with a known hash
+ *
+ * @hashtable: The hashtable object
+ * @key: The key
+ * @len: The length of the key, which need not be NUL terminated
+ * @hash: The hash of the key, as returned by hashtable_hash()
+ *
+ * Returns 0 on success, or -1 if the key was not found.
+ */
+int hashtable_del_hashed(hashtable_t *hashtable, const char *key, size_t len,
+                         size_t hash);
+
 /**
  * hashtable_clear - Clear hashtable
  *
@@ -119,7 +183,7 @@ void hashtable_clear(hashtable_t *hashtable);
  *
  * Returns an opaque iterator to the first element in the hashtable.
  * The iterator should be passed to hashtable_iter_* functions.
- * The hashtable items are not iterated over in any particular order.
+ * The hashtable items are iterated over in the order they were added.
  *
  * There's no need to free the iterator in any way. The iterator is
  * valid as long as the item that is referenced by the iterator is not
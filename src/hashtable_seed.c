@@ -1,5 +1,5 @@
 /* Generate sizeof(uint32_t) bytes of as random data as possible to seed
-   the hash function.
+   the hash function, and a 128-bit key for SipHash.
 */
 
 #ifdef HAVE_CONFIG_H
@@ -59,11 +59,10 @@ static uint32_t buf_to_uint32(char *data) {
 
 /* /dev/urandom */
 #if !defined(_WIN32) && defined(USE_URANDOM)
-static int seed_from_urandom(uint32_t *seed) {
+static int random_from_urandom(char *data, size_t size) {
     /* Use unbuffered I/O if we have open(), close() and read(). Otherwise
        fall back to fopen() */
 
-    char data[sizeof(uint32_t)];
     int ok;
 
 #if defined(HAVE_OPEN) && defined(HAVE_CLOSE) && defined(HAVE_READ)
@@ -72,7 +71,7 @@ static int seed_from_urandom(uint32_t *seed) {
     if (urandom == -1)
         return 1;
 
-    ok = read(urandom, data, sizeof(uint32_t)) == sizeof(uint32_t);
+    ok = read(urandom, data, size) == (ssize_t)size;
     close(urandom);
 #else
     FILE *urandom;
@@ -81,14 +80,13 @@ static int seed_from_urandom(uint32_t *seed) {
     if (!urandom)
         return 1;
 
-    ok = fread(data, 1, sizeof(uint32_t), urandom) == sizeof(uint32_t);
+    ok = fread(data, 1, size, urandom) == size;
     fclose(urandom);
 #endif
 
     if (!ok)
         return 1;
 
-    *seed = buf_to_uint32(data);
     return 0;
 }
 #endif
@@ -101,14 +99,13 @@ typedef BOOL (WINAPI *CRYPTACQUIRECONTEXTA)(HCRYPTPROV *phProv, LPCSTR pszContai
 typedef BOOL (WINAPI *CRYPTGENRANDOM)(HCRYPTPROV hProv, DWORD dwLen, BYTE *pbBuffer);
 typedef BOOL (WINAPI *CRYPTRELEASECONTEXT)(HCRYPTPROV hProv, DWORD dwFlags);
 
-static int seed_from_windows_cryptoapi(uint32_t *seed)
+static int random_from_windows_cryptoapi(char *data, size_t size)
 {
     HINSTANCE hAdvAPI32 = NULL;
     CRYPTACQUIRECONTEXTA pCryptAcquireContext = NULL;
     CRYPTGENRANDOM pCryptGenRandom = NULL;
     CRYPTRELEASECONTEXT pCryptReleaseContext = NULL;
     HCRYPTPROV hCryptProv = 0;
-    BYTE data[sizeof(uint32_t)];
     int ok;
 
     hAdvAPI32 = GetModuleHandle(TEXT("advapi32.dll"));
@@ -130,17 +127,33 @@ static int seed_from_windows_cryptoapi(uint32_t *seed)
     if (!pCryptAcquireContext(&hCryptProv, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT))
         return 1;
 
-    ok = pCryptGenRandom(hCryptProv, sizeof(uint32_t), data);
+    ok = pCryptGenRandom(hCryptProv, (DWORD)size, (BYTE *)data);
     pCryptReleaseContext(hCryptProv, 0);
 
     if (!ok)
         return 1;
 
-    *seed = buf_to_uint32((char *)data);
     return 0;
 }
 #endif
 
+/* Returns 0 on success, or 1 if no source of randomness is available */
+static int random_bytes(char *data, size_t size) {
+#if !defined(_WIN32) && defined(USE_URANDOM)
+    if (random_from_urandom(data, size) == 0)
+        return 0;
+#endif
+
+#if defined(_WIN32) && defined(USE_WINDOWS_CRYPTOAPI)
+    if (random_from_windows_cryptoapi(data, size) == 0)
+        return 0;
+#endif
+
+    (void)data;
+    (void)size;
+    return 1;
+}
+
 /* gettimeofday() and getpid() */
 static int seed_from_timestamp_and_pid(uint32_t *seed) {
 #ifdef HAVE_GETTIMEOFDAY
@@ -165,19 +178,11 @@ static int seed_from_timestamp_and_pid(uint32_t *seed) {
 
 static uint32_t generate_seed() {
     uint32_t seed = 0;
-    int done = 0;
-
-#if !defined(_WIN32) && defined(USE_URANDOM)
-    if (seed_from_urandom(&seed) == 0)
-        done = 1;
-#endif
-
-#if defined(_WIN32) && defined(USE_WINDOWS_CRYPTOAPI)
-    if (seed_from_windows_cryptoapi(&seed) == 0)
-        done = 1;
-#endif
+    char data[sizeof(uint32_t)];
 
-    if (!done) {
+    if (random_bytes(data, sizeof(data)) == 0)
+        seed = buf_to_uint32(data);
+    else {
         /* Fall back to timestamp and PID if no better randomness is
            available */
         seed_from_timestamp_and_pid(&seed);
@@ -193,6 +198,41 @@ static uint32_t generate_seed() {
 
 volatile uint32_t hashtable_seed = 0;
 
+#ifdef USE_HASH_SIPHASH
+/* The key of SipHash. It is set before hashtable_seed, so it is ready
+   once the seed is. */
+uint64_t hashtable_key[2];
+
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* A key spread from the 32-bit seed could be found by trying every
+   seed, so the key is random unless the seed was chosen by the user,
+   who then wants repeatable hashes */
+static void generate_key(uint32_t seed, int chosen) {
+    char data[2 * sizeof(uint64_t)];
+    uint64_t state = seed;
+    size_t i;
+
+    if (!chosen && random_bytes(data, sizeof(data)) == 0) {
+        hashtable_key[0] = hashtable_key[1] = 0;
+        for (i = 0; i < sizeof(data); i++)
+            hashtable_key[i / 8] = (hashtable_key[i / 8] << 8) | (unsigned char)data[i];
+        return;
+    }
+
+    /* no better randomness is available if not chosen */
+    hashtable_key[0] = splitmix64(&state);
+    hashtable_key[1] = splitmix64(&state);
+}
+#else
+#define generate_key(seed, chosen) ((void)0)
+#endif
+
 #if defined(HAVE_ATOMIC_BUILTINS) && (defined(HAVE_SCHED_YIELD) || !defined(_WIN32))
 static volatile char seed_initialized = 0;
 
@@ -204,6 +244,7 @@ void json_object_seed(size_t seed) {
             /* Do the seeding ourselves */
             if (new_seed == 0)
                 new_seed = generate_seed();
+            generate_key(new_seed, seed != 0);
 
             __atomic_store_n(&hashtable_seed, new_seed, __ATOMIC_RELEASE);
         } else {
@@ -217,29 +258,30 @@ void json_object_seed(size_t seed) {
     }
 }
 #elif defined(HAVE_SYNC_BUILTINS) && (defined(HAVE_SCHED_YIELD) || !defined(_WIN32))
+static volatile char seed_initialized = 0;
+
 void json_object_seed(size_t seed) {
     uint32_t new_seed = (uint32_t)seed;
 
     if (hashtable_seed == 0) {
-        if (new_seed == 0) {
-            /* Explicit synchronization fences are not supported by the
-               __sync builtins, so every thread getting here has to
-               generate the seed value.
-            */
-            new_seed = generate_seed();
-        }
+        /* One thread seeds, so that the key and the seed go together */
+        if (__sync_bool_compare_and_swap(&seed_initialized, 0, 1)) {
+            if (new_seed == 0)
+                new_seed = generate_seed();
+            generate_key(new_seed, seed != 0);
 
-        do {
-            if (__sync_bool_compare_and_swap(&hashtable_seed, 0, new_seed)) {
-                /* We were the first to seed */
-                break;
-            } else {
-                /* Wait for another thread to do the seeding */
+            /* the key is written before the seed */
+            __sync_synchronize();
+            hashtable_seed = new_seed;
+        } else {
+            /* Wait for another thread to do the seeding */
+            while(hashtable_seed == 0) {
 #ifdef HAVE_SCHED_YIELD
                 sched_yield();
 #endif
             }
-        } while(hashtable_seed == 0);
+            __sync_synchronize();
+        }
     }
 }
 #elif defined(_WIN32)
@@ -252,7 +294,9 @@ void json_object_seed(size_t seed) {
             /* Do the seeding ourselves */
             if (new_seed == 0)
                 new_seed = generate_seed();
+            generate_key(new_seed, seed != 0);
 
+            MemoryBarrier();
             hashtable_seed = new_seed;
         } else {
             /* Wait for another thread to do the seeding */
@@ -270,6 +314,7 @@ void json_object_seed(size_t seed) {
     if (hashtable_seed == 0) {
         if (new_seed == 0)
             new_seed = generate_seed();
+        generate_key(new_seed, seed != 0);
 
         hashtable_seed = new_seed;
     }
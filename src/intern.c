@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* Per-document key interning. Arrays of objects of the same shape
+   repeat the same keys over and over; the decoders look each key up
+   here, so that it is copied out of the input and UTF-8 checked once
+   per distinct key instead of once per object.
+
+   The objects still copy the key into their pairs, which live in the
+   object's own block while it is small. json_object_key_to_iter()
+   finds a pair from its key, so a key can't be shared between
+   objects. */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <string.h>
+#include "jansson_private.h"
+#include "intern.h"
+#include "utf.h"
+
+#define INTERN_INITIAL_ORDER  5
+
+/* Documents with many distinct keys (e.g. objects used as maps) would
+   only fill the table with keys that are never seen again */
+#define INTERN_MAX_KEYS  4096
+
+void intern_init(intern_t *intern)
+{
+    intern->buckets = NULL;
+    intern->order = 0;
+    intern->size = 0;
+}
+
+void intern_close(intern_t *intern)
+{
+    size_t i;
+
+    if(!intern->buckets)
+        return;
+
+    for(i = 0; i < ((size_t)1 << intern->order); i++) {
+        intern_key_t *key = intern->buckets[i];
+        while(key) {
+            intern_key_t *next = key->next;
+            jsonp_free(key);
+            key = next;
+        }
+    }
+    jsonp_free(intern->buckets);
+}
+
+static int intern_grow(intern_t *intern)
+{
+    size_t new_order = intern->buckets ? intern->order + 1 : INTERN_INITIAL_ORDER;
+    size_t new_size = (size_t)1 << new_order;
+    intern_key_t **new_buckets;
+    size_t i;
+
+    new_buckets = jsonp_malloc(new_size * sizeof(intern_key_t *));
+    if(!new_buckets)
+        return -1;
+    memset(new_buckets, 0, new_size * sizeof(intern_key_t *));
+
+    if(intern->buckets) {
+        for(i = 0; i < ((size_t)1 << intern->order); i++) {
+            intern_key_t *key = intern->buckets[i];
+            while(key) {
+                intern_key_t *next = key->next;
+                size_t index = key->hash & (new_size - 1);
+
+                key->next = new_buckets[index];
+                new_buckets[index] = key;
+                key = next;
+            }
+        }
+        jsonp_free(intern->buckets);
+    }
+
+    intern->buckets = new_buckets;
+    intern->order = new_order;
+    return 0;
+}
+
+const intern_key_t *intern_key(intern_t *intern, const char *key, size_t len,
+                               size_t hash)
+{
+    intern_key_t *record;
+    size_t index;
+
+    if(intern->buckets) {
+        record = intern->buckets[hash & (((size_t)1 << intern->order) - 1)];
+        for(; record; record = record->next) {
+            if(record->hash == hash && record->len == len &&
+               memcmp(record->key, key, len) == 0)
+                return record;
+        }
+    }
+
+    if(intern->size >= INTERN_MAX_KEYS)
+        return NULL;
+
+    if(!intern->buckets || intern->size >= ((size_t)1 << intern->order)) {
+        if(intern_grow(intern))
+            return NULL;
+    }
+
+    record = jsonp_malloc(offsetof(intern_key_t, key) + len + 1);
+    if(!record)
+        return NULL;
+
+    record->hash = hash;
+    record->len = len;
+    record->valid = utf8_check_string(key, len);
+    memcpy(record->key, key, len);
+    record->key[len] = '\0';
+
+    index = hash & (((size_t)1 << intern->order) - 1);
+    record->next = intern->buckets[index];
+    intern->buckets[index] = record;
+    intern->size++;
+
+    return record;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdlib.h>
+
+/* A distinct object key seen while decoding a document. The hash is
+   the one hashtable_set_hashed() expects, and valid tells whether the
+   key is valid UTF-8. */
+typedef struct intern_key {
+    struct intern_key *next;
+    size_t hash;
+    size_t len;
+    int valid;
+    char key[1];
+} intern_key_t;
+
+typedef struct {
+    intern_key_t **buckets;
+    size_t order;    /* intern table has pow(2, order) buckets */
+    size_t size;
+} intern_t;
+
+/* The table allocates nothing until the first key is added */
+void intern_init(intern_t *intern);
+void intern_close(intern_t *intern);
+
+/* Return the record of a key, adding it on first sight. The hash must
+   be hashtable_hash(key, len). Returns NULL
+   if the table is full or out of memory, in which case the caller
+   should handle the key on its own. */
+const intern_key_t *intern_key(intern_t *intern, const char *key, size_t len,
+                               size_t hash);
+
+#endif
@@ -55,9 +55,14 @@ typedef enum {
     BOS_OBJ    = 0x0F
 } bos_data_type;
 
+/* Input text shared by the containers of a JSON_DECODE_LAZY value */
+typedef struct lazy_text lazy_text_t;
+
 typedef struct {
     json_t json;
     hashtable_t hashtable;
+    lazy_text_t *lazy;
+    size_t lazy_pos;
 } json_object_t;
 
 typedef struct {
@@ -65,12 +70,23 @@ typedef struct {
     size_t size;
     size_t entries;
     json_t **table;
+    json_arena_t *arena;
+    lazy_text_t *lazy;
+    size_t lazy_pos;
 } json_array_t;
 
+/* Strings are allocated together with their node, in data. value
+   points to data, or to a separate buffer when the string was adopted
+   (jsonp_stringn_nocheck_own()) or changed from or to a value of
+   JSON_STRING_INLINE bytes or more. data always has room for at least
+   JSON_STRING_INLINE bytes. */
+#define JSON_STRING_INLINE 16
+
 typedef struct {
     json_t json;
     char *value;
     size_t length;
+    char data[1];
 } json_string_t;
 
 typedef struct {
@@ -96,9 +112,40 @@ typedef struct {
 #define json_to_integer(json_) container_of(json_, json_integer_t, json)
 #define json_to_bytes(json_)   container_of(json_, json_bytes_t, json)
 
+/* Return a shared integer if flags has JSON_SHARE_INTEGERS and value
+   is between JSON_SMALL_INTEGER_MIN and JSON_SMALL_INTEGER_MAX, and a
+   new one in arena otherwise */
+json_t *jsonp_integer_shared(json_arena_t *arena, json_int_t value, size_t flags);
+
 /* Create a string by taking ownership of an existing buffer */
 json_t *jsonp_stringn_nocheck_own(const char *value, size_t len);
 
+/* Create a valid string or a copy of bytes in arena, or on the heap
+   if arena is NULL */
+json_t *jsonp_stringn_nocheck_in(json_arena_t *arena, const char *value, size_t len);
+json_t *jsonp_bytes_in(json_arena_t *arena, const void *value, size_t size);
+
+/* Get or set a valid key whose length and hash (see hashtable_hash()) are
+   already known. The key need not be NUL terminated, unless the object
+   is lazy. Steals the reference to value. */
+json_t *jsonp_object_get_hashed(const json_t *json, const char *key, size_t len,
+                                size_t hash);
+int jsonp_object_set_hashed(json_t *json, const char *key, size_t len,
+                            size_t hash, json_t *value);
+
+/* Decode valid input with JSON_FAST_PARSE. Returns NULL on any error
+   without setting an error message. */
+json_t *jsonp_loadb_fast(const char *buffer, size_t buflen, size_t flags,
+                         json_arena_t *arena);
+
+/* Lazy decoding with JSON_DECODE_LAZY. The load functions decode the
+   members of a lazy container and make it a normal one. */
+json_t *jsonp_loadb_lazy(const char *buffer, size_t buflen, size_t flags, json_error_t *error);
+json_t *jsonp_lazy_object_get(json_object_t *object, const char *key);
+int jsonp_lazy_load_object(json_object_t *object);
+int jsonp_lazy_load_array(json_array_t *array);
+void jsonp_lazy_release(lazy_text_t *text);
+
 /* Error message formatting */
 void jsonp_error_init(json_error_t *error, const char *source);
 void jsonp_error_set_source(json_error_t *error, const char *source);
@@ -109,17 +156,46 @@ void jsonp_error_vset(json_error_t *error, int line, int column,
                       size_t position, enum json_error_code code,
                       const char *msg, va_list ap);
 
-/* Locale independent string<->double conversions */
-int jsonp_strtod(strbuffer_t *strbuffer, double *out);
+/* Locale independent string<->number conversions. The input must be
+   a valid JSON number of len bytes; -1 is returned on overflow. */
+int jsonp_strtoint(const char *str, size_t len, json_int_t *out);
+int jsonp_strtod(const char *str, size_t len, double *out);
+int jsonp_itostr(char *buffer, size_t size, json_int_t value);
 int jsonp_dtostr(char *buffer, size_t size, double value, int prec);
 
 /* Wrappers for custom memory functions */
 void* jsonp_malloc(size_t size) JANSSON_ATTRS(warn_unused_result);
 void jsonp_free(void *ptr);
+
+/* Grow or shrink a block of old_size bytes. On failure, NULL is
+   returned and ptr is left alone. */
+void *jsonp_realloc(void *ptr, size_t old_size, size_t new_size) JANSSON_ATTRS(warn_unused_result);
 char *jsonp_strndup(const char *str, size_t length) JANSSON_ATTRS(warn_unused_result);
 char *jsonp_strdup(const char *str) JANSSON_ATTRS(warn_unused_result);
 char *jsonp_strndup(const char *str, size_t len) JANSSON_ATTRS(warn_unused_result);
 
+/* Whether malloc() and free() are used, see json_set_alloc_funcs() */
+int jsonp_alloc_funcs_default(void);
+
+/* Allocation of values and their tables, which are freed with the
+   size they were allocated with. These use per-thread pools when
+   built with USE_POOL_ALLOC, unless other allocation functions are
+   set. */
+void *jsonp_node_malloc(size_t size) JANSSON_ATTRS(warn_unused_result);
+void *jsonp_node_realloc(void *ptr, size_t old_size, size_t new_size) JANSSON_ATTRS(warn_unused_result);
+void jsonp_node_free(void *ptr, size_t size);
+
+/* Arena allocation. With a NULL arena, these are jsonp_node_malloc(),
+   jsonp_node_realloc() and jsonp_node_free(); otherwise freeing does
+   nothing, and the last allocation grows in place. Containers
+   are registered with their arena, which is told with
+   jsonp_arena_hold() when one of them takes a value from outside the
+   arena. */
+void *jsonp_arena_malloc(json_arena_t *arena, size_t size) JANSSON_ATTRS(warn_unused_result);
+void *jsonp_arena_realloc(json_arena_t *arena, void *ptr, size_t old_size, size_t new_size) JANSSON_ATTRS(warn_unused_result);
+void jsonp_arena_free(json_arena_t *arena, void *ptr, size_t size);
+int jsonp_arena_add_container(json_arena_t *arena, json_t *json);
+void jsonp_arena_hold(json_arena_t *arena);
 
 /* Windows compatibility */
 #if defined(_WIN32) || defined(WIN32)
@@ -23,6 +23,7 @@
 
 #include "bosjansson.h"
 #include "strbuffer.h"
+#include "intern.h"
 #include "utf.h"
 
 #define STREAM_STATE_OK        0
@@ -54,6 +55,9 @@ typedef int (*get_func)(void *data);
 typedef struct {
     get_func get;
     void *data;
+    const char *text;   /* the whole input, if it is in memory */
+    size_t text_len;    /* its length, or (size_t)-1 if NUL ends it */
+    size_t *text_pos;   /* the position of get in text */
     char buffer[5];
     size_t buffer_pos;
     int state;
@@ -65,17 +69,24 @@ typedef struct {
 typedef struct {
     stream_t stream;
     strbuffer_t saved_text;
+    const char *span;       /* the number token, if it was scanned in */
+    size_t span_len;        /* stream.text instead of saved_text */
     size_t flags;
     size_t depth;
     int token;
     union {
         struct {
-            char *val;
+            char *val;      /* points to string_buffer */
             size_t len;
+            int nul;        /* whether val contains a NUL byte */
         } string;
         json_int_t integer;
         double real;
     } value;
+    char *string_buffer;
+    size_t string_buffer_size;
+    intern_t keys;
+    json_arena_t *arena;    /* where values are created, or NULL */
 } lex_t;
 
 #define stream_to_lex(stream) container_of(stream, lex_t, stream)
@@ -106,16 +117,22 @@ static void error_set(json_error_t *error, const lex_t *lex,
     if(lex)
     {
         const char *saved_text = strbuffer_value(&lex->saved_text);
+        size_t saved_len = lex->saved_text.length;
+
+        if(lex->span) {
+            saved_text = lex->span;
+            saved_len = lex->span_len;
+        }
 
         line = lex->stream.line;
         col = lex->stream.column;
         pos = lex->stream.position;
 
-        if(saved_text && saved_text[0])
+        if(saved_len && saved_text[0])
         {
-            if(lex->saved_text.length <= 20) {
+            if(saved_len <= 20) {
                 snprintf(msg_with_context, JSON_ERROR_TEXT_LENGTH,
-                         "%s near '%s'", msg_text, saved_text);
+                         "%s near '%.*s'", msg_text, (int)saved_len, saved_text);
                 msg_with_context[JSON_ERROR_TEXT_LENGTH - 1] = '\0';
                 result = msg_with_context;
             }
@@ -150,6 +167,9 @@ stream_init(stream_t *stream, get_func get, void *data)
 {
     stream->get = get;
     stream->data = data;
+    stream->text = NULL;
+    stream->text_len = 0;
+    stream->text_pos = NULL;
     stream->buffer[0] = '\0';
     stream->buffer_pos = 0;
 
@@ -159,6 +179,15 @@ stream_init(stream_t *stream, get_func get, void *data)
     stream->position = 0;
 }
 
+/* Let the lexer read the input of get directly, at *pos */
+static void
+stream_set_text(stream_t *stream, const char *text, size_t len, size_t *pos)
+{
+    stream->text = text;
+    stream->text_len = len;
+    stream->text_pos = pos;
+}
+
 static int stream_get(stream_t *stream, json_error_t *error)
 {
     int c;
@@ -295,7 +324,6 @@ static void lex_save_cached(lex_t *lex)
 
 static void lex_free_string(lex_t *lex)
 {
-    jsonp_free(lex->value.string.val);
     lex->value.string.val = NULL;
     lex->value.string.len = 0;
 }
@@ -324,11 +352,11 @@ static int32_t decode_unicode_escape(const char *str)
     return value;
 }
 
+static void lex_decode_string(lex_t *lex, json_error_t *error);
+
 static void lex_scan_string(lex_t *lex, json_error_t *error)
 {
     int c;
-    const char *p;
-    char *t;
     int i;
 
     lex->value.string.val = NULL;
@@ -379,18 +407,48 @@ static void lex_scan_string(lex_t *lex, json_error_t *error)
             c = lex_get_save(lex, error);
     }
 
+    lex_decode_string(lex, error);
+    return;
+
+out:
+    lex_free_string(lex);
+}
+
+/* Decode the string token in saved_text, quotes included, to
+   lex->value.string. The token must already be known to be well
+   formed apart from its Unicode escapes. */
+static void lex_decode_string(lex_t *lex, json_error_t *error)
+{
+    const char *p;
+    char *t;
+
+    lex->value.string.val = NULL;
+    lex->value.string.nul = 0;
+    lex->token = TOKEN_INVALID;
+
     /* the actual value is at most of the same length as the source
        string, because:
          - shortcut escapes (e.g. "\t") (length 2) are converted to 1 byte
          - a single \uXXXX escape (length 6) is converted to at most 3 bytes
          - two \uXXXX escapes (length 12) forming an UTF-16 surrogate pair
            are converted to 4 bytes
+
+       The buffer is reused for all strings, so that keys need no
+       allocation of their own.
     */
-    t = jsonp_malloc(lex->saved_text.length + 1);
-    if(!t) {
-        /* this is not very nice, since TOKEN_INVALID is returned */
-        goto out;
+    if(lex->saved_text.length + 1 > lex->string_buffer_size) {
+        size_t new_size = max(lex->saved_text.length + 1, lex->string_buffer_size * 2);
+
+        jsonp_free(lex->string_buffer);
+        lex->string_buffer_size = 0;
+        lex->string_buffer = jsonp_malloc(new_size);
+        if(!lex->string_buffer) {
+            /* this is not very nice, since TOKEN_INVALID is returned */
+            goto out;
+        }
+        lex->string_buffer_size = new_size;
     }
+    t = lex->string_buffer;
     lex->value.string.val = t;
 
     /* + 1 to skip the " */
@@ -448,6 +506,11 @@ static void lex_scan_string(lex_t *lex, json_error_t *error)
                     goto out;
                 }
 
+                /* raw NUL bytes are invalid, so this is the only
+                   way for a string to contain one */
+                if(value == 0)
+                    lex->value.string.nul = 1;
+
                 if(utf8_encode(value, t, &length))
                     assert(0);
                 t += length;
@@ -479,26 +542,130 @@ out:
     lex_free_string(lex);
 }
 
-#ifndef JANSSON_USING_CMAKE /* disabled if using cmake */
-#if JSON_INTEGER_IS_LONG_LONG
-#ifdef _MSC_VER  /* Microsoft Visual Studio */
-#define json_strtoint     _strtoi64
-#else
-#define json_strtoint     strtoll
-#endif
-#else
-#define json_strtoint     strtol
-#endif
-#endif
+/* Convert the number token in span or saved_text to lex->value */
+static int lex_convert_number(lex_t *lex, int is_real, json_error_t *error)
+{
+    const char *text = strbuffer_value(&lex->saved_text);
+    size_t len = lex->saved_text.length;
 
-static int lex_scan_number(lex_t *lex, int c, json_error_t *error)
+    if(lex->span) {
+        text = lex->span;
+        len = lex->span_len;
+    }
+
+    if(!is_real) {
+        json_int_t intval;
+
+        if(jsonp_strtoint(text, len, &intval)) {
+            if(text[0] == '-')
+                error_set(error, lex, json_error_numeric_overflow, "too big negative integer");
+            else
+                error_set(error, lex, json_error_numeric_overflow, "too big integer");
+            return -1;
+        }
+
+        lex->token = TOKEN_INTEGER;
+        lex->value.integer = intval;
+    }
+    else {
+        double doubleval;
+
+        if(jsonp_strtod(text, len, &doubleval)) {
+            error_set(error, lex, json_error_numeric_overflow, "real number overflow");
+            return -1;
+        }
+
+        lex->token = TOKEN_REAL;
+        lex->value.real = doubleval;
+    }
+
+    return 0;
+}
+
+/* Scan a number that starts with the character just read, in the
+   input itself. Returns 1 without reading anything if the number is
+   malformed, so that lex_scan_number() reports the error as usual. */
+static int lex_scan_number_span(lex_t *lex, json_error_t *error)
 {
-    const char *saved_text;
-    char *end;
-    double doubleval;
+    stream_t *stream = &lex->stream;
+    const char *start = stream->text + *stream->text_pos - 1;
+    const char *p = start;
+    size_t remaining = stream->text_len - (*stream->text_pos - 1);
+    int is_real = (lex->flags & JSON_DECODE_INT_AS_REAL) != 0;
+
+#define span_digit(p_) ((size_t)((p_) - start) < remaining && l_isdigit(*(p_)))
+#define span_is(p_, c_) ((size_t)((p_) - start) < remaining && *(p_) == (c_))
+
+    /* the character was read alone, so nothing is cached */
+    assert(stream->buffer[stream->buffer_pos] == '\0');
+
+    if(*p == '-')
+        p++;
+
+    if(span_is(p, '0')) {
+        p++;
+        if(span_digit(p))
+            return 1;
+    }
+    else if(span_digit(p)) {
+        do
+            p++;
+        while(span_digit(p));
+    }
+    else
+        return 1;
 
+    if(span_is(p, '.')) {
+        p++;
+        if(!span_digit(p))
+            return 1;
+        do
+            p++;
+        while(span_digit(p));
+        is_real = 1;
+    }
+
+    if(span_is(p, 'e') || span_is(p, 'E')) {
+        p++;
+        if(span_is(p, '+') || span_is(p, '-'))
+            p++;
+        if(!span_digit(p))
+            return 1;
+        do
+            p++;
+        while(span_digit(p));
+        is_real = 1;
+    }
+
+    /* reading a byte of a UTF-8 sequence next is an error, which
+       lex_scan_number() reports in the context of the number */
+    if((size_t)(p - start) < remaining && (unsigned char)*p >= 0x80)
+        return 1;
+
+#undef span_digit
+#undef span_is
+
+    /* the number is ASCII on one line */
+    *stream->text_pos += p - start - 1;
+    stream->position += p - start - 1;
+    stream->column += (int)(p - start - 1);
+
+    strbuffer_clear(&lex->saved_text);
+    lex->span = start;
+    lex->span_len = p - start;
+    return lex_convert_number(lex, is_real, error);
+}
+
+static int lex_scan_number(lex_t *lex, int c, json_error_t *error)
+{
     lex->token = TOKEN_INVALID;
 
+    if(lex->stream.text) {
+        int result = lex_scan_number_span(lex, error);
+        if(result <= 0)
+            return result;
+    }
+
     if(c == '-')
         c = lex_get_save(lex, error);
 
@@ -522,27 +689,8 @@ static int lex_scan_number(lex_t *lex, int c, json_error_t *error)
     if(!(lex->flags & JSON_DECODE_INT_AS_REAL) &&
        c != '.' && c != 'E' && c != 'e')
     {
-        json_int_t intval;
-
         lex_unget_unsave(lex, c);
-
-        saved_text = strbuffer_value(&lex->saved_text);
-
-        errno = 0;
-        intval = json_strtoint(saved_text, &end, 10);
-        if(errno == ERANGE) {
-            if(intval < 0)
-                error_set(error, lex, json_error_numeric_overflow, "too big negative integer");
-            else
-                error_set(error, lex, json_error_numeric_overflow, "too big integer");
-            goto out;
-        }
-
-        assert(end == saved_text + lex->saved_text.length);
-
-        lex->token = TOKEN_INTEGER;
-        lex->value.integer = intval;
-        return 0;
+        return lex_convert_number(lex, 0, error);
     }
 
     if(c == '.') {
@@ -574,15 +722,7 @@ static int lex_scan_number(lex_t *lex, int c, json_error_t *error)
     }
 
     lex_unget_unsave(lex, c);
-
-    if(jsonp_strtod(&lex->saved_text, &doubleval)) {
-        error_set(error, lex, json_error_numeric_overflow, "real number overflow");
-        goto out;
-    }
-
-    lex->token = TOKEN_REAL;
-    lex->value.real = doubleval;
-    return 0;
+    return lex_convert_number(lex, 1, error);
 
 out:
     return -1;
@@ -593,6 +733,7 @@ static int lex_scan(lex_t *lex, json_error_t *error)
     int c;
 
     strbuffer_clear(&lex->saved_text);
+    lex->span = NULL;
 
     if(lex->token == TOKEN_STRING)
         lex_free_string(lex);
@@ -656,14 +797,13 @@ out:
     return lex->token;
 }
 
-static char *lex_steal_string(lex_t *lex, size_t *out_len)
+/* Return a copy of the string token that the caller must free */
+static char *lex_dup_string(lex_t *lex, size_t *out_len)
 {
     char *result = NULL;
     if(lex->token == TOKEN_STRING) {
-        result = lex->value.string.val;
+        result = jsonp_strndup(lex->value.string.val, lex->value.string.len);
         *out_len = lex->value.string.len;
-        lex->value.string.val = NULL;
-        lex->value.string.len = 0;
     }
     return result;
 }
@@ -674,8 +814,13 @@ static int lex_init(lex_t *lex, get_func get, size_t flags, void *data)
     if(strbuffer_init(&lex->saved_text))
         return -1;
 
+    lex->span = NULL;
     lex->flags = flags;
     lex->token = TOKEN_INVALID;
+    lex->string_buffer = NULL;
+    lex->string_buffer_size = 0;
+    intern_init(&lex->keys);
+    lex->arena = NULL;
     return 0;
 }
 
@@ -684,6 +829,8 @@ static void lex_close(lex_t *lex)
     if(lex->token == TOKEN_STRING)
         lex_free_string(lex);
     strbuffer_close(&lex->saved_text);
+    jsonp_free(lex->string_buffer);
+    intern_close(&lex->keys);
 }
 
 
@@ -691,9 +838,51 @@ static void lex_close(lex_t *lex)
 
 static json_t *parse_value(lex_t *lex, size_t flags, json_error_t *error);
 
+/* Create the value of a string, number, true, false or null token */
+static json_t *parse_scalar(lex_t *lex, size_t flags, json_error_t *error)
+{
+    switch(lex->token) {
+        case TOKEN_STRING: {
+            const char *value = lex->value.string.val;
+            size_t len = lex->value.string.len;
+            json_t *json;
+
+            if(!(flags & JSON_ALLOW_NUL)) {
+                if(lex->value.string.nul) {
+                    error_set(error, lex, json_error_null_character, "\\u0000 is not allowed without JSON_ALLOW_NUL");
+                    return NULL;
+                }
+            }
+
+            json = jsonp_stringn_nocheck_in(lex->arena, value, len);
+            lex_free_string(lex);
+            return json;
+        }
+
+        case TOKEN_INTEGER:
+            return jsonp_integer_shared(lex->arena, lex->value.integer, lex->flags);
+
+        case TOKEN_REAL:
+            return json_real_in(lex->arena, lex->value.real);
+
+        case TOKEN_TRUE:
+            return json_true();
+
+        case TOKEN_FALSE:
+            return json_false();
+
+        case TOKEN_NULL:
+            return json_null();
+
+        default:
+            /* not reached */
+            return NULL;
+    }
+}
+
 static json_t *parse_object(lex_t *lex, size_t flags, json_error_t *error)
 {
-    json_t *object = json_object();
+    json_t *object = json_object_in(lex->arena);
     if(!object)
         return NULL;
 
@@ -702,35 +891,48 @@ static json_t *parse_object(lex_t *lex, size_t flags, json_error_t *error)
         return object;
 
     while(1) {
-        char *key;
-        size_t len;
+        const char *key;
+        const intern_key_t *interned;
+        char *copy = NULL;
+        size_t len, hash;
         json_t *value;
+        int res;
 
         if(lex->token != TOKEN_STRING) {
             error_set(error, lex, json_error_invalid_syntax, "string or '}' expected");
             goto error;
         }
 
-        key = lex_steal_string(lex, &len);
-        if(!key)
-            return NULL;
-        if (memchr(key, '\0', len)) {
-            jsonp_free(key);
+        key = lex->value.string.val;
+        len = lex->value.string.len;
+        if(lex->value.string.nul) {
             error_set(error, lex, json_error_null_byte_in_key, "NUL byte in object key not supported");
             goto error;
         }
 
+        /* the one pass over the key: the hash serves the duplicate
+           check, the intern table and the insertion */
+        hash = hashtable_hash(key, len);
+
         if(flags & JSON_REJECT_DUPLICATES) {
-            if(json_object_get(object, key)) {
-                jsonp_free(key);
+            if(jsonp_object_get_hashed(object, key, len, hash)) {
                 error_set(error, lex, json_error_duplicate_key, "duplicate object key");
                 goto error;
             }
         }
 
+        /* The token is overwritten by the next string, so the key is
+           interned or copied before scanning on */
+        interned = intern_key(&lex->keys, key, len, hash);
+        if(!interned) {
+            copy = jsonp_strndup(key, len);
+            if(!copy)
+                goto error;
+        }
+
         lex_scan(lex, error);
         if(lex->token != ':') {
-            jsonp_free(key);
+            jsonp_free(copy);
             error_set(error, lex, json_error_invalid_syntax, "':' expected");
             goto error;
         }
@@ -738,16 +940,19 @@ static json_t *parse_object(lex_t *lex, size_t flags, json_error_t *error)
         lex_scan(lex, error);
         value = parse_value(lex, flags, error);
         if(!value) {
-            jsonp_free(key);
+            jsonp_free(copy);
             goto error;
         }
 
-        if(json_object_set_new_nocheck(object, key, value)) {
-            jsonp_free(key);
-            goto error;
-        }
+        if(interned)
+            res = jsonp_object_set_hashed(object, interned->key, interned->len,
+                                          interned->hash, value);
+        else
+            res = jsonp_object_set_hashed(object, copy, len, hash, value);
 
-        jsonp_free(key);
+        jsonp_free(copy);
+        if(res)
+            goto error;
 
         lex_scan(lex, error);
         if(lex->token != ',')
@@ -770,7 +975,7 @@ error:
 
 static json_t *parse_array(lex_t *lex, size_t flags, json_error_t *error)
 {
-    json_t *array = json_array();
+    json_t *array = json_array_in(lex->arena);
     if(!array)
         return NULL;
 
@@ -817,43 +1022,13 @@ static json_t *parse_value(lex_t *lex, size_t flags, json_error_t *error)
     }
 
     switch(lex->token) {
-        case TOKEN_STRING: {
-            const char *value = lex->value.string.val;
-            size_t len = lex->value.string.len;
-
-            if(!(flags & JSON_ALLOW_NUL)) {
-                if(memchr(value, '\0', len)) {
-                    error_set(error, lex, json_error_null_character, "\\u0000 is not allowed without JSON_ALLOW_NUL");
-                    return NULL;
-                }
-            }
-
-            json = jsonp_stringn_nocheck_own(value, len);
-            lex->value.string.val = NULL;
-            lex->value.string.len = 0;
-            break;
-        }
-
-        case TOKEN_INTEGER: {
-            json = json_integer(lex->value.integer);
-            break;
-        }
-
-        case TOKEN_REAL: {
-            json = json_real(lex->value.real);
-            break;
-        }
-
+        case TOKEN_STRING:
+        case TOKEN_INTEGER:
+        case TOKEN_REAL:
         case TOKEN_TRUE:
-            json = json_true();
-            break;
-
         case TOKEN_FALSE:
-            json = json_false();
-            break;
-
         case TOKEN_NULL:
-            json = json_null();
+            json = parse_scalar(lex, flags, error);
             break;
 
         case '{':
@@ -953,6 +1128,7 @@ json_t *json_loads(const char *string, size_t flags, json_error_t *error)
 
     if(lex_init(&lex, string_get, flags, (void *)&stream_data))
         return NULL;
+    stream_set_text(&lex.stream, string, (size_t)-1, &stream_data.pos);
 
     result = parse_json(&lex, flags, error);
 
@@ -979,7 +1155,8 @@ static int buffer_get(void *data)
     return (unsigned char)c;
 }
 
-json_t *json_loadb(const char *buffer, size_t buflen, size_t flags, json_error_t *error)
+static json_t *loadb(const char *buffer, size_t buflen, size_t flags,
+                     json_arena_t *arena, json_error_t *error)
 {
     lex_t lex;
     json_t *result;
@@ -992,12 +1169,29 @@ json_t *json_loadb(const char *buffer, size_t buflen, size_t flags, json_error_t
         return NULL;
     }
 
+    /* lazy containers are decoded later on the heap, so arena loads
+       decode everything up front */
+    if((flags & JSON_DECODE_LAZY) && !arena)
+        return jsonp_loadb_lazy(buffer, buflen, flags, error);
+
+    if((flags & JSON_FAST_PARSE) && !(flags & JSON_DISABLE_EOF_CHECK)) {
+        /* On failure, decode again with the lexer to report the error */
+        result = jsonp_loadb_fast(buffer, buflen, flags, arena);
+        if(result) {
+            if(error)
+                error->position = (int)buflen;
+            return result;
+        }
+    }
+
     stream_data.data = buffer;
     stream_data.pos = 0;
     stream_data.len = buflen;
 
     if(lex_init(&lex, buffer_get, flags, (void *)&stream_data))
         return NULL;
+    stream_set_text(&lex.stream, buffer, buflen, &stream_data.pos);
+    lex.arena = arena;
 
     result = parse_json(&lex, flags, error);
 
@@ -1005,6 +1199,17 @@ json_t *json_loadb(const char *buffer, size_t buflen, size_t flags, json_error_t
     return result;
 }
 
+json_t *json_loadb(const char *buffer, size_t buflen, size_t flags, json_error_t *error)
+{
+    return loadb(buffer, buflen, flags, NULL, error);
+}
+
+json_t *json_loadb_arena(const char *buffer, size_t buflen, size_t flags,
+                         json_arena_t *arena, json_error_t *error)
+{
+    return loadb(buffer, buflen, flags, arena, error);
+}
+
 json_t *json_loadf(FILE *input, size_t flags, json_error_t *error)
 {
     lex_t lex;
@@ -1151,3 +1356,1172 @@ json_t *json_load_callback(json_load_callback_t callback, void *arg, size_t flag
     lex_close(&lex);
     return result;
 }
+
+
+/*** event parser ***/
+
+typedef struct {
+    const json_handler_t *handler;
+    void *ctx;
+    size_t flags;
+} events_t;
+
+static int events_aborted(lex_t *lex, json_error_t *error)
+{
+    error_set(error, lex, json_error_aborted, "aborted by handler");
+    return -1;
+}
+
+static int events_value(lex_t *lex, events_t *events, json_error_t *error);
+
+static int events_object(lex_t *lex, events_t *events, json_error_t *error)
+{
+    const json_handler_t *handler = events->handler;
+    json_t *keys = NULL;
+    int res = -1;
+
+    if(handler->start_object && handler->start_object(events->ctx))
+        return events_aborted(lex, error);
+
+    if(events->flags & JSON_REJECT_DUPLICATES) {
+        /* the keys seen so far, only needed for the check */
+        keys = json_object();
+        if(!keys)
+            return -1;
+    }
+
+    lex_scan(lex, error);
+    if(lex->token == '}')
+        goto end;
+
+    while(1) {
+        const char *key;
+        size_t len;
+
+        if(lex->token != TOKEN_STRING) {
+            error_set(error, lex, json_error_invalid_syntax, "string or '}' expected");
+            goto out;
+        }
+
+        key = lex->value.string.val;
+        len = lex->value.string.len;
+        if(lex->value.string.nul) {
+            error_set(error, lex, json_error_null_byte_in_key, "NUL byte in object key not supported");
+            goto out;
+        }
+
+        if(keys) {
+            size_t hash = hashtable_hash(key, len);
+
+            if(jsonp_object_get_hashed(keys, key, len, hash)) {
+                error_set(error, lex, json_error_duplicate_key, "duplicate object key");
+                goto out;
+            }
+            if(jsonp_object_set_hashed(keys, key, len, hash, json_null()))
+                goto out;
+        }
+
+        if(handler->key && handler->key(events->ctx, key, len)) {
+            events_aborted(lex, error);
+            goto out;
+        }
+
+        lex_scan(lex, error);
+        if(lex->token != ':') {
+            error_set(error, lex, json_error_invalid_syntax, "':' expected");
+            goto out;
+        }
+
+        lex_scan(lex, error);
+        if(events_value(lex, events, error))
+            goto out;
+
+        lex_scan(lex, error);
+        if(lex->token != ',')
+            break;
+
+        lex_scan(lex, error);
+    }
+
+    if(lex->token != '}') {
+        error_set(error, lex, json_error_invalid_syntax, "'}' expected");
+        goto out;
+    }
+
+end:
+    if(handler->end_object && handler->end_object(events->ctx)) {
+        events_aborted(lex, error);
+        goto out;
+    }
+    res = 0;
+
+out:
+    json_decref(keys);
+    return res;
+}
+
+static int events_array(lex_t *lex, events_t *events, json_error_t *error)
+{
+    const json_handler_t *handler = events->handler;
+
+    if(handler->start_array && handler->start_array(events->ctx))
+        return events_aborted(lex, error);
+
+    lex_scan(lex, error);
+    if(lex->token != ']') {
+        while(lex->token) {
+            if(events_value(lex, events, error))
+                return -1;
+
+            lex_scan(lex, error);
+            if(lex->token != ',')
+                break;
+
+            lex_scan(lex, error);
+        }
+
+        if(lex->token != ']') {
+            error_set(error, lex, json_error_invalid_syntax, "']' expected");
+            return -1;
+        }
+    }
+
+    if(handler->end_array && handler->end_array(events->ctx))
+        return events_aborted(lex, error);
+    return 0;
+}
+
+static int events_value(lex_t *lex, events_t *events, json_error_t *error)
+{
+    const json_handler_t *handler = events->handler;
+    void *ctx = events->ctx;
+    int res;
+
+    lex->depth++;
+    if(lex->depth > JSON_PARSER_MAX_DEPTH) {
+        error_set(error, lex, json_error_stack_overflow, "maximum parsing depth reached");
+        return -1;
+    }
+
+    switch(lex->token) {
+        case TOKEN_STRING: {
+            const char *value = lex->value.string.val;
+            size_t len = lex->value.string.len;
+
+            if(!(events->flags & JSON_ALLOW_NUL)) {
+                if(lex->value.string.nul) {
+                    error_set(error, lex, json_error_null_character, "\\u0000 is not allowed without JSON_ALLOW_NUL");
+                    return -1;
+                }
+            }
+
+            res = handler->string ? handler->string(ctx, value, len) : 0;
+            break;
+        }
+
+        case TOKEN_INTEGER:
+            res = handler->integer ? handler->integer(ctx, lex->value.integer) : 0;
+            break;
+
+        case TOKEN_REAL:
+            res = handler->real ? handler->real(ctx, lex->value.real) : 0;
+            break;
+
+        case TOKEN_TRUE:
+        case TOKEN_FALSE:
+            res = handler->boolean ? handler->boolean(ctx, lex->token == TOKEN_TRUE) : 0;
+            break;
+
+        case TOKEN_NULL:
+            res = handler->null ? handler->null(ctx) : 0;
+            break;
+
+        case '{':
+            if(events_object(lex, events, error))
+                return -1;
+            res = 0;
+            break;
+
+        case '[':
+            if(events_array(lex, events, error))
+                return -1;
+            res = 0;
+            break;
+
+        case TOKEN_INVALID:
+            error_set(error, lex, json_error_invalid_syntax, "invalid token");
+            return -1;
+
+        default:
+            error_set(error, lex, json_error_invalid_syntax, "unexpected token");
+            return -1;
+    }
+
+    if(res)
+        return events_aborted(lex, error);
+
+    lex->depth--;
+    return 0;
+}
+
+int json_parse_events(const char *input, size_t len, const json_handler_t *handler,
+                      void *ctx, size_t flags, json_error_t *error)
+{
+    lex_t lex;
+    buffer_data_t stream_data;
+    events_t events;
+    int res = -1;
+
+    jsonp_error_init(error, "<buffer>");
+
+    if(input == NULL || handler == NULL) {
+        error_set(error, NULL, json_error_invalid_argument, "wrong arguments");
+        return -1;
+    }
+
+    stream_data.data = input;
+    stream_data.pos = 0;
+    stream_data.len = len;
+
+    if(lex_init(&lex, buffer_get, flags, (void *)&stream_data))
+        return -1;
+    stream_set_text(&lex.stream, input, len, &stream_data.pos);
+
+    events.handler = handler;
+    events.ctx = ctx;
+    events.flags = flags;
+
+    lex.depth = 0;
+
+    lex_scan(&lex, error);
+    if(!(flags & JSON_DECODE_ANY)) {
+        if(lex.token != '[' && lex.token != '{') {
+            error_set(error, &lex, json_error_invalid_syntax, "'[' or '{' expected");
+            goto out;
+        }
+    }
+
+    if(events_value(&lex, &events, error))
+        goto out;
+
+    if(!(flags & JSON_DISABLE_EOF_CHECK)) {
+        lex_scan(&lex, error);
+        if(lex.token != TOKEN_EOF) {
+            error_set(error, &lex, json_error_end_of_input_expected, "end of file expected");
+            goto out;
+        }
+    }
+
+    if(error) {
+        /* Save the position even though there was no error */
+        error->position = (int)lex.stream.position;
+    }
+    res = 0;
+
+out:
+    lex_close(&lex);
+    return res;
+}
+
+/*** streaming reader ***/
+
+#define JSON_STREAM_BUFFER_SIZE 65536
+
+struct json_stream {
+    lex_t lex;
+    const char *source;
+    size_t flags;
+    int eof;
+
+    /* input: exactly one of these is used */
+    FILE *file;
+    int fd;
+    json_load_callback_t callback;
+    void *arg;
+
+    size_t len;
+    size_t pos;
+    char data[JSON_STREAM_BUFFER_SIZE];
+};
+
+static int json_stream_fill(json_stream_t *stream)
+{
+    size_t len = 0;
+
+    if(stream->callback) {
+        len = stream->callback(stream->data, JSON_STREAM_BUFFER_SIZE, stream->arg);
+        if(len == (size_t)-1)
+            len = 0;
+    }
+    else if(stream->file) {
+        len = fread(stream->data, 1, JSON_STREAM_BUFFER_SIZE, stream->file);
+    }
+#ifdef HAVE_UNISTD_H
+    else {
+        ssize_t res;
+
+        do
+            res = read(stream->fd, stream->data, JSON_STREAM_BUFFER_SIZE);
+        while(res < 0 && errno == EINTR);
+
+        if(res > 0)
+            len = (size_t)res;
+    }
+#endif
+
+    stream->pos = 0;
+    stream->len = len;
+    return len ? 0 : -1;
+}
+
+static int json_stream_get(void *data)
+{
+    json_stream_t *stream = (json_stream_t *)data;
+
+    if(stream->pos >= stream->len) {
+        if(json_stream_fill(stream))
+            return EOF;
+    }
+
+    return (unsigned char)stream->data[stream->pos++];
+}
+
+static json_stream_t *json_stream_new(const char *source, size_t flags)
+{
+    json_stream_t *stream = jsonp_malloc(sizeof(json_stream_t));
+    if(!stream)
+        return NULL;
+
+    stream->source = source;
+    stream->flags = flags;
+    stream->eof = 0;
+    stream->file = NULL;
+    stream->fd = -1;
+    stream->callback = NULL;
+    stream->arg = NULL;
+    stream->len = 0;
+    stream->pos = 0;
+
+    if(lex_init(&stream->lex, json_stream_get, flags, stream)) {
+        jsonp_free(stream);
+        return NULL;
+    }
+
+    return stream;
+}
+
+json_stream_t *json_stream_file(FILE *input, size_t flags)
+{
+    json_stream_t *stream;
+
+    if(input == NULL)
+        return NULL;
+
+    stream = json_stream_new(input == stdin ? "<stdin>" : "<stream>", flags);
+    if(stream)
+        stream->file = input;
+    return stream;
+}
+
+json_stream_t *json_stream_fd(int input, size_t flags)
+{
+    json_stream_t *stream;
+    const char *source;
+
+    if(input < 0)
+        return NULL;
+
+#ifdef HAVE_UNISTD_H
+    if(input == STDIN_FILENO)
+        source = "<stdin>";
+    else
+#endif
+        source = "<stream>";
+
+    stream = json_stream_new(source, flags);
+    if(stream)
+        stream->fd = input;
+    return stream;
+}
+
+json_stream_t *json_stream_callback(json_load_callback_t callback, void *arg, size_t flags)
+{
+    json_stream_t *stream;
+
+    if(callback == NULL)
+        return NULL;
+
+    stream = json_stream_new("<callback>", flags);
+    if(stream) {
+        stream->callback = callback;
+        stream->arg = arg;
+    }
+    return stream;
+}
+
+json_t *json_stream_next(json_stream_t *stream, json_error_t *error)
+{
+    lex_t *lex;
+    json_t *result;
+
+    if(stream == NULL) {
+        jsonp_error_init(error, "<stream>");
+        error_set(error, NULL, json_error_invalid_argument, "wrong arguments");
+        return NULL;
+    }
+
+    lex = &stream->lex;
+    jsonp_error_init(error, stream->source);
+
+    if(stream->eof)
+        return NULL;
+
+    lex->depth = 0;
+
+    lex_scan(lex, error);
+    if(lex->token == TOKEN_EOF) {
+        stream->eof = 1;
+        return NULL;
+    }
+
+    if(!(stream->flags & JSON_DECODE_ANY)) {
+        if(lex->token != '[' && lex->token != '{') {
+            error_set(error, lex, json_error_invalid_syntax, "'[' or '{' expected");
+            return NULL;
+        }
+    }
+
+    result = parse_value(lex, stream->flags, error);
+    if(!result)
+        return NULL;
+
+    if(error) {
+        /* Save the position even though there was no error */
+        error->position = (int)lex->stream.position;
+    }
+
+    return result;
+}
+
+int json_stream_eof(const json_stream_t *stream)
+{
+    return stream ? stream->eof : 0;
+}
+
+void json_stream_close(json_stream_t *stream)
+{
+    if(!stream)
+        return;
+
+    lex_close(&stream->lex);
+    jsonp_free(stream);
+}
+
+
+/*** push parser ***/
+
+/* Scanner states. Numbers and literals have no end marker, so they
+   are only finished when the next character arrives. */
+#define SCAN_NONE          0
+#define SCAN_STRING        1
+#define SCAN_ESCAPE        2    /* after a backslash */
+#define SCAN_UNICODE       3    /* in the hex digits of \uXXXX */
+#define SCAN_MINUS         4    /* after a leading minus sign */
+#define SCAN_ZERO          5    /* integer part is 0 */
+#define SCAN_INTEGER       6
+#define SCAN_DOT           7
+#define SCAN_FRACTION      8
+#define SCAN_EXP           9    /* after 'e' or 'E' */
+#define SCAN_EXP_SIGN     10
+#define SCAN_EXP_DIGITS   11
+#define SCAN_LITERAL      12
+
+/* What the parser expects next */
+#define EXPECT_VALUE         0    /* the top-level value */
+#define EXPECT_DONE          1
+#define EXPECT_ARRAY_FIRST   2    /* a value or ']' */
+#define EXPECT_ARRAY_VALUE   3    /* a value after ',' */
+#define EXPECT_ARRAY_NEXT    4    /* ',' or ']' */
+#define EXPECT_OBJECT_FIRST  5    /* a key or '}' */
+#define EXPECT_OBJECT_KEY    6    /* a key after ',' */
+#define EXPECT_OBJECT_COLON  7
+#define EXPECT_OBJECT_VALUE  8
+#define EXPECT_OBJECT_NEXT   9    /* ',' or '}' */
+
+#define PARSER_MIN_FRAMES   16
+
+/* An array or object that is still open */
+typedef struct {
+    json_t *container;
+    char *key;          /* key of the next member of an object */
+} parser_frame_t;
+
+struct json_parser {
+    lex_t lex;
+    size_t flags;
+    json_error_t error;
+    int failed;
+
+    int scan;
+    int unicode_left;
+    char utf8[4];
+    size_t utf8_have;
+    size_t utf8_need;
+
+    int expect;
+    parser_frame_t *frames;
+    size_t depth;
+    size_t frames_size;
+    json_t *result;
+};
+
+static void parser_count(lex_t *lex, int c, size_t len)
+{
+    lex->stream.position += len;
+    if(c == '\n') {
+        lex->stream.line++;
+        lex->stream.column = 0;
+    }
+    else
+        lex->stream.column++;
+}
+
+/* Add a finished value to the innermost open container */
+static int parser_add(json_parser_t *parser, json_t *value)
+{
+    parser_frame_t *frame;
+
+    if(parser->depth == 0) {
+        parser->result = value;
+        parser->expect = EXPECT_DONE;
+        return 0;
+    }
+
+    frame = &parser->frames[parser->depth - 1];
+    if(json_is_array(frame->container)) {
+        if(json_array_append_new(frame->container, value))
+            return -1;
+        parser->expect = EXPECT_ARRAY_NEXT;
+    }
+    else {
+        int res = json_object_set_new_nocheck(frame->container, frame->key, value);
+
+        jsonp_free(frame->key);
+        frame->key = NULL;
+        if(res)
+            return -1;
+        parser->expect = EXPECT_OBJECT_NEXT;
+    }
+    return 0;
+}
+
+static int parser_open(json_parser_t *parser, json_t *container)
+{
+    if(!container)
+        return -1;
+
+    if(parser->depth == parser->frames_size) {
+        size_t new_size = parser->frames_size * 2;
+        parser_frame_t *new_frames = jsonp_realloc(parser->frames,
+                                                   parser->frames_size * sizeof(parser_frame_t),
+                                                   new_size * sizeof(parser_frame_t));
+        if(!new_frames) {
+            json_decref(container);
+            return -1;
+        }
+
+        parser->frames = new_frames;
+        parser->frames_size = new_size;
+    }
+
+    parser->frames[parser->depth].container = container;
+    parser->frames[parser->depth].key = NULL;
+    parser->depth++;
+
+    parser->expect = json_is_array(container) ? EXPECT_ARRAY_FIRST : EXPECT_OBJECT_FIRST;
+    return 0;
+}
+
+static int parser_close(json_parser_t *parser)
+{
+    parser->depth--;
+    return parser_add(parser, parser->frames[parser->depth].container);
+}
+
+static int parser_value(json_parser_t *parser)
+{
+    lex_t *lex = &parser->lex;
+    json_t *value;
+
+    if(parser->depth + 1 > JSON_PARSER_MAX_DEPTH) {
+        error_set(&parser->error, lex, json_error_stack_overflow, "maximum parsing depth reached");
+        return -1;
+    }
+
+    switch(lex->token) {
+        case '{':
+            return parser_open(parser, json_object());
+
+        case '[':
+            return parser_open(parser, json_array());
+
+        case TOKEN_STRING:
+        case TOKEN_INTEGER:
+        case TOKEN_REAL:
+        case TOKEN_TRUE:
+        case TOKEN_FALSE:
+        case TOKEN_NULL:
+            value = parse_scalar(lex, parser->flags, &parser->error);
+            if(!value)
+                return -1;
+            return parser_add(parser, value);
+
+        case TOKEN_INVALID:
+            error_set(&parser->error, lex, json_error_invalid_syntax, "invalid token");
+            return -1;
+
+        default:
+            error_set(&parser->error, lex, json_error_invalid_syntax, "unexpected token");
+            return -1;
+    }
+}
+
+/* Feed the token in lex to the parser. The errors are the same as the
+   ones of parse_json(). */
+static int parser_token(json_parser_t *parser)
+{
+    lex_t *lex = &parser->lex;
+    json_error_t *error = &parser->error;
+    parser_frame_t *frame = parser->depth ? &parser->frames[parser->depth - 1] : NULL;
+    char *key;
+    size_t len;
+
+    switch(parser->expect) {
+        case EXPECT_VALUE:
+            if(!(parser->flags & JSON_DECODE_ANY)) {
+                if(lex->token != '[' && lex->token != '{') {
+                    error_set(error, lex, json_error_invalid_syntax, "'[' or '{' expected");
+                    return -1;
+                }
+            }
+            return parser_value(parser);
+
+        case EXPECT_DONE:
+            if(lex->token != TOKEN_EOF) {
+                error_set(error, lex, json_error_end_of_input_expected, "end of file expected");
+                return -1;
+            }
+            return 0;
+
+        case EXPECT_ARRAY_FIRST:
+            if(lex->token == ']')
+                return parser_close(parser);
+            /* fall through */
+
+        case EXPECT_ARRAY_VALUE:
+            if(lex->token == TOKEN_EOF) {
+                error_set(error, lex, json_error_invalid_syntax, "']' expected");
+                return -1;
+            }
+            return parser_value(parser);
+
+        case EXPECT_ARRAY_NEXT:
+            if(lex->token == ',') {
+                parser->expect = EXPECT_ARRAY_VALUE;
+                return 0;
+            }
+            if(lex->token == ']')
+                return parser_close(parser);
+            error_set(error, lex, json_error_invalid_syntax, "']' expected");
+            return -1;
+
+        case EXPECT_OBJECT_FIRST:
+            if(lex->token == '}')
+                return parser_close(parser);
+            /* fall through */
+
+        case EXPECT_OBJECT_KEY:
+            if(lex->token != TOKEN_STRING) {
+                error_set(error, lex, json_error_invalid_syntax, "string or '}' expected");
+                return -1;
+            }
+
+            key = lex_dup_string(lex, &len);
+            if(!key)
+                return -1;
+            if(lex->value.string.nul) {
+                jsonp_free(key);
+                error_set(error, lex, json_error_null_byte_in_key, "NUL byte in object key not supported");
+                return -1;
+            }
+
+            if(parser->flags & JSON_REJECT_DUPLICATES) {
+                if(json_object_get(frame->container, key)) {
+                    jsonp_free(key);
+                    error_set(error, lex, json_error_duplicate_key, "duplicate object key");
+                    return -1;
+                }
+            }
+
+            frame->key = key;
+            parser->expect = EXPECT_OBJECT_COLON;
+            return 0;
+
+        case EXPECT_OBJECT_COLON:
+            if(lex->token != ':') {
+                error_set(error, lex, json_error_invalid_syntax, "':' expected");
+                return -1;
+            }
+            parser->expect = EXPECT_OBJECT_VALUE;
+            return 0;
+
+        case EXPECT_OBJECT_VALUE:
+            return parser_value(parser);
+
+        case EXPECT_OBJECT_NEXT:
+            if(lex->token == ',') {
+                parser->expect = EXPECT_OBJECT_KEY;
+                return 0;
+            }
+            if(lex->token == '}')
+                return parser_close(parser);
+            error_set(error, lex, json_error_invalid_syntax, "'}' expected");
+            return -1;
+
+        default:
+            /* not reached */
+            return -1;
+    }
+}
+
+static int parser_dispatch(json_parser_t *parser)
+{
+    int res = parser_token(parser);
+
+    if(parser->lex.token == TOKEN_STRING)
+        lex_free_string(&parser->lex);
+    return res;
+}
+
+/* Finish a pending number or literal. The character that ended it has
+   not been counted or saved. */
+static int parser_end_token(json_parser_t *parser)
+{
+    lex_t *lex = &parser->lex;
+    int scan = parser->scan;
+
+    parser->scan = SCAN_NONE;
+    lex->token = TOKEN_INVALID;
+
+    switch(scan) {
+        case SCAN_ZERO:
+        case SCAN_INTEGER:
+            lex_convert_number(lex, (parser->flags & JSON_DECODE_INT_AS_REAL) != 0,
+                               &parser->error);
+            break;
+
+        case SCAN_FRACTION:
+        case SCAN_EXP_DIGITS:
+            lex_convert_number(lex, 1, &parser->error);
+            break;
+
+        case SCAN_LITERAL: {
+            const char *saved_text = strbuffer_value(&lex->saved_text);
+
+            if(strcmp(saved_text, "true") == 0)
+                lex->token = TOKEN_TRUE;
+            else if(strcmp(saved_text, "false") == 0)
+                lex->token = TOKEN_FALSE;
+            else if(strcmp(saved_text, "null") == 0)
+                lex->token = TOKEN_NULL;
+            break;
+        }
+
+        default:
+            /* SCAN_MINUS, SCAN_DOT, SCAN_EXP, SCAN_EXP_SIGN */
+            break;
+    }
+
+    return parser_dispatch(parser);
+}
+
+/* Return the scanner state after the number character c, or SCAN_NONE
+   if c ends the number */
+static int parser_number_state(int scan, int c)
+{
+    switch(scan) {
+        case SCAN_MINUS:
+            if(c == '0')
+                return SCAN_ZERO;
+            return l_isdigit(c) ? SCAN_INTEGER : SCAN_NONE;
+
+        case SCAN_ZERO:
+        case SCAN_INTEGER:
+            if(scan == SCAN_INTEGER && l_isdigit(c))
+                return SCAN_INTEGER;
+            if(c == '.')
+                return SCAN_DOT;
+            if(c == 'e' || c == 'E')
+                return SCAN_EXP;
+            return SCAN_NONE;
+
+        case SCAN_DOT:
+        case SCAN_FRACTION:
+            if(l_isdigit(c))
+                return SCAN_FRACTION;
+            if(scan == SCAN_FRACTION && (c == 'e' || c == 'E'))
+                return SCAN_EXP;
+            return SCAN_NONE;
+
+        case SCAN_EXP:
+            if(c == '+' || c == '-')
+                return SCAN_EXP_SIGN;
+            /* fall through */
+
+        case SCAN_EXP_SIGN:
+        case SCAN_EXP_DIGITS:
+            return l_isdigit(c) ? SCAN_EXP_DIGITS : SCAN_NONE;
+
+        default:
+            return SCAN_NONE;
+    }
+}
+
+/* Feed one character (a complete UTF-8 sequence) to the scanner */
+static int parser_char(json_parser_t *parser, const char *seq, size_t len)
+{
+    lex_t *lex = &parser->lex;
+    json_error_t *error = &parser->error;
+    int c = (unsigned char)seq[0];
+
+    if(parser->scan >= SCAN_MINUS) {
+        int next;
+
+        if(parser->scan == SCAN_LITERAL)
+            next = l_isalpha(c) ? SCAN_LITERAL : SCAN_NONE;
+        else if(parser->scan == SCAN_ZERO && l_isdigit(c))
+            next = -1;  /* leading zero: "0" is an invalid token */
+        else
+            next = parser_number_state(parser->scan, c);
+
+        if(next > SCAN_NONE) {
+            parser_count(lex, c, len);
+            strbuffer_append_byte(&lex->saved_text, c);
+            parser->scan = next;
+            return 0;
+        }
+
+        if(next < 0) {
+            parser->scan = SCAN_NONE;
+            lex->token = TOKEN_INVALID;
+            return parser_dispatch(parser);
+        }
+
+        if(parser_end_token(parser))
+            return -1;
+
+        /* c is not part of the input any more */
+        if(parser->expect == EXPECT_DONE && (parser->flags & JSON_DISABLE_EOF_CHECK))
+            return 0;
+    }
+
+    switch(parser->scan) {
+        case SCAN_NONE:
+            parser_count(lex, c, len);
+            if(c == ' ' || c == '\t' || c == '\n' || c == '\r')
+                return 0;
+
+            strbuffer_clear(&lex->saved_text);
+            strbuffer_append_bytes(&lex->saved_text, seq, len);
+
+            if(c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',') {
+                lex->token = c;
+                return parser_dispatch(parser);
+            }
+
+            if(c == '"')
+                parser->scan = SCAN_STRING;
+            else if(c == '-')
+                parser->scan = SCAN_MINUS;
+            else if(c == '0')
+                parser->scan = SCAN_ZERO;
+            else if(l_isdigit(c))
+                parser->scan = SCAN_INTEGER;
+            else if(l_isalpha(c))
+                parser->scan = SCAN_LITERAL;
+            else {
+                lex->token = TOKEN_INVALID;
+                return parser_dispatch(parser);
+            }
+            return 0;
+
+        case SCAN_STRING:
+            if(0 <= c && c <= 0x1F) {
+                /* control character */
+                if(c == '\n')
+                    error_set(error, lex, json_error_invalid_syntax, "unexpected newline");
+                else
+                    error_set(error, lex, json_error_invalid_syntax, "control character 0x%x", c);
+                return -1;
+            }
+
+            parser_count(lex, c, len);
+            strbuffer_append_bytes(&lex->saved_text, seq, len);
+
+            if(c == '\\')
+                parser->scan = SCAN_ESCAPE;
+            else if(c == '"') {
+                parser->scan = SCAN_NONE;
+                lex_decode_string(lex, error);
+                return parser_dispatch(parser);
+            }
+            return 0;
+
+        case SCAN_ESCAPE:
+            /* only ASCII is valid here, and parse_json() reports only
+               the first byte of anything else */
+            parser_count(lex, c, 1);
+            strbuffer_append_byte(&lex->saved_text, c);
+
+            if(c == 'u') {
+                parser->scan = SCAN_UNICODE;
+                parser->unicode_left = 4;
+            }
+            else if(c == '"' || c == '\\' || c == '/' || c == 'b' ||
+                    c == 'f' || c == 'n' || c == 'r' || c == 't')
+                parser->scan = SCAN_STRING;
+            else {
+                error_set(error, lex, json_error_invalid_syntax, "invalid escape");
+                return -1;
+            }
+            return 0;
+
+        case SCAN_UNICODE:
+            parser_count(lex, c, 1);
+            strbuffer_append_byte(&lex->saved_text, c);
+
+            if(!l_isxdigit(c)) {
+                error_set(error, lex, json_error_invalid_syntax, "invalid escape");
+                return -1;
+            }
+            if(--parser->unicode_left == 0)
+                parser->scan = SCAN_STRING;
+            return 0;
+
+        default:
+            /* not reached */
+            return -1;
+    }
+}
+
+static int parser_utf8_error(json_parser_t *parser, int c)
+{
+    lex_t *lex = &parser->lex;
+
+    if(parser->scan == SCAN_NONE)
+        strbuffer_clear(&lex->saved_text);
+
+    lex->stream.state = STREAM_STATE_ERROR;
+    error_set(&parser->error, lex, json_error_invalid_utf8, "unable to decode byte 0x%x", c);
+
+    /* A pending number or literal is still finished, as it may be the
+       whole value with JSON_DISABLE_EOF_CHECK */
+    if(parser->scan >= SCAN_MINUS) {
+        parser_end_token(parser);
+        if(parser->expect == EXPECT_DONE && (parser->flags & JSON_DISABLE_EOF_CHECK))
+            return 0;
+    }
+    return -1;
+}
+
+json_parser_t *json_parser_new(size_t flags)
+{
+    json_parser_t *parser = jsonp_malloc(sizeof(json_parser_t));
+    if(!parser)
+        return NULL;
+
+    parser->frames = jsonp_malloc(PARSER_MIN_FRAMES * sizeof(parser_frame_t));
+    if(!parser->frames) {
+        jsonp_free(parser);
+        return NULL;
+    }
+
+    if(lex_init(&parser->lex, NULL, flags, NULL)) {
+        jsonp_free(parser->frames);
+        jsonp_free(parser);
+        return NULL;
+    }
+
+    jsonp_error_init(&parser->error, "<parser>");
+    parser->flags = flags;
+    parser->failed = 0;
+    parser->scan = SCAN_NONE;
+    parser->unicode_left = 0;
+    parser->utf8_have = 0;
+    parser->utf8_need = 0;
+    parser->expect = EXPECT_VALUE;
+    parser->depth = 0;
+    parser->frames_size = PARSER_MIN_FRAMES;
+    parser->result = NULL;
+    return parser;
+}
+
+int json_parser_feed(json_parser_t *parser, const char *buffer, size_t buflen)
+{
+    lex_t *lex;
+    size_t i = 0;
+
+    if(!parser || parser->failed || (!buffer && buflen))
+        return -1;
+
+    lex = &parser->lex;
+
+    while(i < buflen) {
+        unsigned char c = (unsigned char)buffer[i];
+        int res;
+
+        if(parser->expect == EXPECT_DONE && (parser->flags & JSON_DISABLE_EOF_CHECK))
+            break;
+
+        if(parser->utf8_need) {
+            parser->utf8[parser->utf8_have++] = c;
+            i++;
+            if(parser->utf8_have < parser->utf8_need)
+                continue;
+
+            parser->utf8_need = 0;
+            if(!utf8_check_full(parser->utf8, parser->utf8_have, NULL))
+                res = parser_utf8_error(parser, (unsigned char)parser->utf8[0]);
+            else
+                res = parser_char(parser, parser->utf8, parser->utf8_have);
+        }
+        else if(c >= 0x80) {
+            size_t count = utf8_check_first(c);
+            i++;
+            if(!count)
+                res = parser_utf8_error(parser, c);
+            else {
+                parser->utf8[0] = c;
+                parser->utf8_have = 1;
+                parser->utf8_need = count;
+                res = 0;
+            }
+        }
+        else if(parser->scan == SCAN_STRING) {
+            /* copy runs of plain string characters at once */
+            size_t end = i;
+            while(end < buflen) {
+                unsigned char d = (unsigned char)buffer[end];
+                if(d < 0x20 || d >= 0x80 || d == '"' || d == '\\')
+                    break;
+                end++;
+            }
+
+            if(end > i) {
+                strbuffer_append_bytes(&lex->saved_text, buffer + i, end - i);
+                lex->stream.position += end - i;
+                lex->stream.column += (int)(end - i);
+                i = end;
+                continue;
+            }
+
+            res = parser_char(parser, buffer + i, 1);
+            i++;
+        }
+        else {
+            res = parser_char(parser, buffer + i, 1);
+            i++;
+        }
+
+        if(res) {
+            parser->failed = 1;
+            return -1;
+        }
+    }
+
+    return parser->expect == EXPECT_DONE ? 1 : 0;
+}
+
+/* Signal the end of input: finish the pending token and check that the
+   value is complete */
+static int parser_finish(json_parser_t *parser)
+{
+    lex_t *lex = &parser->lex;
+
+    if(parser->expect == EXPECT_DONE && (parser->flags & JSON_DISABLE_EOF_CHECK))
+        return 0;
+
+    if(parser->utf8_need)
+        return parser_utf8_error(parser, (unsigned char)parser->utf8[0]);
+
+    switch(parser->scan) {
+        case SCAN_NONE:
+            break;
+
+        case SCAN_STRING:
+            error_set(&parser->error, lex, json_error_premature_end_of_input, "premature end of input");
+            return -1;
+
+        case SCAN_ESCAPE:
+        case SCAN_UNICODE:
+            error_set(&parser->error, lex, json_error_invalid_syntax, "invalid escape");
+            return -1;
+
+        default:
+            if(parser_end_token(parser))
+                return -1;
+            break;
+    }
+
+    lex->stream.state = STREAM_STATE_EOF;
+    strbuffer_clear(&lex->saved_text);
+    lex->token = TOKEN_EOF;
+    return parser_dispatch(parser);
+}
+
+json_t *json_parser_result(json_parser_t *parser, json_error_t *error)
+{
+    json_t *result;
+
+    if(!parser) {
+        jsonp_error_init(error, "<parser>");
+        error_set(error, NULL, json_error_invalid_argument, "wrong arguments");
+        return NULL;
+    }
+
+    if(!parser->failed && parser_finish(parser))
+        parser->failed = 1;
+
+    if(parser->failed) {
+        if(error)
+            *error = parser->error;
+        return NULL;
+    }
+
+    if(error) {
+        jsonp_error_init(error, "<parser>");
+        /* Save the position even though there was no error */
+        error->position = (int)parser->lex.stream.position;
+    }
+
+    result = parser->result;
+    parser->result = NULL;
+    return result;
+}
+
+void json_parser_free(json_parser_t *parser)
+{
+    size_t i;
+
+    if(!parser)
+        return;
+
+    for(i = 0; i < parser->depth; i++) {
+        json_decref(parser->frames[i].container);
+        jsonp_free(parser->frames[i].key);
+    }
+    jsonp_free(parser->frames);
+    json_decref(parser->result);
+    lex_close(&parser->lex);
+    jsonp_free(parser);
+}
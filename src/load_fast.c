@@ -0,0 +1,708 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* Two-stage decoder for JSON_FAST_PARSE.
+ *
+ * Stage 1 classifies the input 64 bytes at a time into bitmasks and
+ * records the positions of all structural characters ({}[]:,), of the
+ * opening quotes of strings, and of the first byte of every number or
+ * literal. Stage 2 builds the value by walking these positions.
+ *
+ * This decoder only handles valid input. On anything unexpected it
+ * gives up, and json_loadb() decodes the input again with the regular
+ * lexer to report the error.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "jansson_private.h"
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "utf.h"
+
+#define BLOCK_SIZE  64
+
+/* Byte classes for the scalar version of stage 1 */
+#define CLASS_QUOTE       1
+#define CLASS_BACKSLASH   2
+#define CLASS_OPERATOR    4
+#define CLASS_WHITESPACE  8
+
+typedef struct {
+    const char *input;
+    size_t len;
+    size_t flags;
+
+    uint32_t *index;
+    size_t count;
+    size_t size;
+
+    size_t pos;     /* next entry of index */
+    size_t depth;
+    json_arena_t *arena;
+
+    char *buf;      /* for strings with escapes or non-ASCII bytes */
+    size_t buf_size;
+} fast_parser_t;
+
+typedef struct {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;
+    uint64_t whitespace;
+} block_t;
+
+static unsigned char byte_class(unsigned char c)
+{
+    switch(c) {
+        case '"':
+            return CLASS_QUOTE;
+        case '\\':
+            return CLASS_BACKSLASH;
+        case '{': case '}': case '[': case ']': case ':': case ',':
+            return CLASS_OPERATOR;
+        case ' ': case '\t': case '\n': case '\r':
+            return CLASS_WHITESPACE;
+        default:
+            return 0;
+    }
+}
+
+static void classify_block(const unsigned char *p, block_t *block)
+{
+#ifdef __SSE2__
+    int i;
+
+    block->quote = block->backslash = block->op = block->whitespace = 0;
+
+    for(i = 0; i < BLOCK_SIZE; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        /* '[' | 0x20 == '{' and ']' | 0x20 == '}' */
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')),
+                         _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+
+        block->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+        block->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << i;
+        block->op |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << i;
+        block->whitespace |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << i;
+    }
+#else
+    int i;
+
+    block->quote = block->backslash = block->op = block->whitespace = 0;
+
+    for(i = 0; i < BLOCK_SIZE; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+
+        switch(byte_class(p[i])) {
+            case CLASS_QUOTE:      block->quote |= bit; break;
+            case CLASS_BACKSLASH:  block->backslash |= bit; break;
+            case CLASS_OPERATOR:   block->op |= bit; break;
+            case CLASS_WHITESPACE: block->whitespace |= bit; break;
+        }
+    }
+#endif
+}
+
+/* Return the bits of the characters that are escaped by a backslash.
+   A run of backslashes escapes the character after it if its length
+   is odd. *prev_escaped carries an escape over to the next block. */
+static uint64_t find_escaped(uint64_t backslash, uint64_t *prev_escaped)
+{
+    const uint64_t even_bits = 0x5555555555555555ULL;
+    uint64_t follows_escape, odd_starts, even_sequences;
+
+    backslash &= ~*prev_escaped;
+    follows_escape = (backslash << 1) | *prev_escaped;
+
+    /* Adding the starts of the runs that begin on odd bits carries
+       through each run, which flips the parity for those runs */
+    odd_starts = backslash & ~even_bits & ~follows_escape;
+    even_sequences = odd_starts + backslash;
+    *prev_escaped = even_sequences < backslash;
+
+    return (even_bits ^ (even_sequences << 1)) & follows_escape;
+}
+
+/* Set every bit from a quote up to, but not including, the next one */
+static uint64_t prefix_xor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+static int ctz64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while(!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static int build_index(fast_parser_t *parser)
+{
+    const unsigned char *input = (const unsigned char *)parser->input;
+    size_t len = parser->len;
+    size_t base;
+    uint64_t prev_escaped = 0, prev_in_string = 0, prev_scalar = 0;
+
+    parser->size = len / 4 + BLOCK_SIZE;
+    parser->index = jsonp_malloc(parser->size * sizeof(uint32_t));
+    if(!parser->index)
+        return -1;
+    parser->count = 0;
+
+    for(base = 0; base < len; base += BLOCK_SIZE) {
+        unsigned char padded[BLOCK_SIZE];
+        const unsigned char *p = input + base;
+        block_t block;
+        uint64_t escaped, quote, in_string, scalar, structurals;
+
+        if(len - base < BLOCK_SIZE) {
+            memset(padded, ' ', BLOCK_SIZE);
+            memcpy(padded, p, len - base);
+            p = padded;
+        }
+
+        classify_block(p, &block);
+
+        escaped = find_escaped(block.backslash, &prev_escaped);
+        quote = block.quote & ~escaped;
+        in_string = prefix_xor(quote) ^ prev_in_string;
+        prev_in_string = (uint64_t)0 - (in_string >> 63);
+
+        /* Numbers, literals and any garbage: everything outside strings
+           that is not whitespace, an operator or a closing quote */
+        scalar = ~(block.op | block.whitespace | quote | in_string);
+
+        structurals = (block.op & ~in_string) | (quote & in_string) |
+                      (scalar & ~((scalar << 1) | prev_scalar));
+        prev_scalar = scalar >> 63;
+
+        if(parser->count + BLOCK_SIZE > parser->size) {
+            size_t new_size = parser->size * 2;
+            uint32_t *new_index = jsonp_realloc(parser->index,
+                                                parser->size * sizeof(uint32_t),
+                                                new_size * sizeof(uint32_t));
+            if(!new_index)
+                return -1;
+
+            parser->index = new_index;
+            parser->size = new_size;
+        }
+
+        while(structurals) {
+            parser->index[parser->count++] = (uint32_t)(base + ctz64(structurals));
+            structurals &= structurals - 1;
+        }
+    }
+
+    /* unterminated string */
+    if(prev_in_string)
+        return -1;
+
+    return 0;
+}
+
+
+/*** stage 2 ***/
+
+/* Check that only whitespace separates the token that ended at end
+   from the next structural position */
+static int check_gap(fast_parser_t *parser, size_t end)
+{
+    size_t next = parser->pos < parser->count ? parser->index[parser->pos] : parser->len;
+
+    if(end > next)
+        return -1;
+
+    for(; end < next; end++) {
+        if(byte_class((unsigned char)parser->input[end]) != CLASS_WHITESPACE)
+            return -1;
+    }
+    return 0;
+}
+
+static int32_t decode_hex4(const char *p)
+{
+    int32_t value = 0;
+    int i;
+
+    for(i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if('0' <= c && c <= '9')
+            value += c - '0';
+        else if('a' <= c && c <= 'f')
+            value += c - 'a' + 10;
+        else if('A' <= c && c <= 'F')
+            value += c - 'A' + 10;
+        else
+            return -1;
+    }
+    return value;
+}
+
+/* Return a pointer to the first byte in [p, end) that is '"', '\\',
+   a control character or non-ASCII */
+static const char *scan_plain(const char *p, const char *end)
+{
+#ifdef __SSE2__
+    while(end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+            _mm_cmplt_epi8(v, _mm_set1_epi8(0x20)));
+        int mask = _mm_movemask_epi8(hits);
+
+        if(mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+
+    for(; p < end; p++) {
+        unsigned char c = (unsigned char)*p;
+        if(c < 0x20 || c >= 0x80 || c == '"' || c == '\\')
+            break;
+    }
+    return p;
+}
+
+/* Decode the string whose opening quote is at start, and whose index
+   entry has just been consumed. Returns the value and sets *end past
+   the closing quote. A plain value is returned in the input, without a
+   terminating NUL byte; any other in the parser's buffer, where it is
+   valid until the next string is decoded. */
+static const char *parse_string(fast_parser_t *parser, size_t start,
+                                size_t *out_len, size_t *end)
+{
+    const char *p = parser->input + start + 1;
+    const char *lim;
+    const char *q;
+    char *result, *t;
+
+    /* the closing quote comes before the next structural position */
+    if(parser->pos < parser->count)
+        lim = parser->input + parser->index[parser->pos];
+    else
+        lim = parser->input + parser->len;
+
+    /* Common case: no escapes and no non-ASCII */
+    q = scan_plain(p, lim);
+    if(q < lim && *q == '"') {
+        *out_len = q - p;
+        *end = q + 1 - parser->input;
+        return p;
+    }
+
+    /* The value is at most as long as its text */
+    if(parser->buf_size < (size_t)(lim - p) + 1) {
+        size_t new_size = parser->buf_size * 2;
+        if(new_size < (size_t)(lim - p) + 1)
+            new_size = (size_t)(lim - p) + 1;
+
+        result = jsonp_realloc(parser->buf, parser->buf_size, new_size);
+        if(!result)
+            return NULL;
+        parser->buf = result;
+        parser->buf_size = new_size;
+    }
+    result = t = parser->buf;
+
+    memcpy(t, p, q - p);
+    t += q - p;
+    p = q;
+
+    while(p < lim) {
+        unsigned char c = (unsigned char)*p;
+
+        if(c == '"') {
+            *t = '\0';
+            *out_len = t - result;
+            *end = p + 1 - parser->input;
+            return result;
+        }
+
+        if(c < 0x20)
+            break;
+
+        if(c >= 0x80) {
+            size_t count = utf8_check_first(c);
+            if(!count || (size_t)(lim - p) < count || !utf8_check_full(p, count, NULL))
+                break;
+
+            memcpy(t, p, count);
+            t += count;
+            p += count;
+        }
+        else if(c == '\\') {
+            if(lim - p < 2)
+                break;
+
+            switch(p[1]) {
+                case '"': case '\\': case '/':
+                    *t++ = p[1]; break;
+                case 'b': *t++ = '\b'; break;
+                case 'f': *t++ = '\f'; break;
+                case 'n': *t++ = '\n'; break;
+                case 'r': *t++ = '\r'; break;
+                case 't': *t++ = '\t'; break;
+                case 'u': {
+                    int32_t value;
+                    size_t length;
+
+                    if(lim - p < 6 || (value = decode_hex4(p + 2)) < 0)
+                        goto error;
+                    p += 4;
+
+                    if(0xD800 <= value && value <= 0xDBFF) {
+                        int32_t value2;
+
+                        if(lim - p < 8 || p[2] != '\\' || p[3] != 'u')
+                            goto error;
+                        value2 = decode_hex4(p + 4);
+                        if(value2 < 0xDC00 || value2 > 0xDFFF)
+                            goto error;
+                        p += 6;
+
+                        value = ((value - 0xD800) << 10) + (value2 - 0xDC00) + 0x10000;
+                    }
+                    else if(0xDC00 <= value && value <= 0xDFFF)
+                        goto error;
+
+                    if(utf8_encode(value, t, &length))
+                        goto error;
+                    t += length;
+                    break;
+                }
+                default:
+                    goto error;
+            }
+            p += 2;
+        }
+        else {
+            q = scan_plain(p + 1, lim);
+            memcpy(t, p, q - p);
+            t += q - p;
+            p = q;
+        }
+    }
+
+error:
+    return NULL;
+}
+
+static json_t *parse_number(fast_parser_t *parser, size_t start)
+{
+    const char *input = parser->input;
+    size_t len = parser->len;
+    size_t p = start;
+    int is_real = 0;
+
+    if(input[p] == '-')
+        p++;
+
+    if(p < len && input[p] == '0')
+        p++;
+    else if(p < len && '1' <= input[p] && input[p] <= '9') {
+        while(p < len && '0' <= input[p] && input[p] <= '9')
+            p++;
+    }
+    else
+        return NULL;
+
+    if(p < len && input[p] == '.') {
+        p++;
+        if(p >= len || input[p] < '0' || input[p] > '9')
+            return NULL;
+        while(p < len && '0' <= input[p] && input[p] <= '9')
+            p++;
+        is_real = 1;
+    }
+
+    if(p < len && (input[p] == 'e' || input[p] == 'E')) {
+        p++;
+        if(p < len && (input[p] == '+' || input[p] == '-'))
+            p++;
+        if(p >= len || input[p] < '0' || input[p] > '9')
+            return NULL;
+        while(p < len && '0' <= input[p] && input[p] <= '9')
+            p++;
+        is_real = 1;
+    }
+
+    if(check_gap(parser, p))
+        return NULL;
+
+    if(!is_real && !(parser->flags & JSON_DECODE_INT_AS_REAL)) {
+        json_int_t value;
+        if(jsonp_strtoint(input + start, p - start, &value))
+            return NULL;
+        return jsonp_integer_shared(parser->arena, value, parser->flags);
+    }
+    else {
+        double value;
+        if(jsonp_strtod(input + start, p - start, &value))
+            return NULL;
+        return json_real_in(parser->arena, value);
+    }
+}
+
+static json_t *parse_literal(fast_parser_t *parser, size_t start)
+{
+    static const struct {
+        const char *text;
+        size_t len;
+    } literals[] = {{"true", 4}, {"false", 5}, {"null", 4}};
+    size_t i;
+
+    for(i = 0; i < 3; i++) {
+        if(parser->len - start >= literals[i].len &&
+           memcmp(parser->input + start, literals[i].text, literals[i].len) == 0)
+        {
+            if(check_gap(parser, start + literals[i].len))
+                return NULL;
+
+            switch(i) {
+                case 0: return json_true();
+                case 1: return json_false();
+                default: return json_null();
+            }
+        }
+    }
+    return NULL;
+}
+
+static json_t *parse_value(fast_parser_t *parser);
+
+/* Return the character at the next structural position, or 0 */
+static char next_char(fast_parser_t *parser)
+{
+    if(parser->pos >= parser->count)
+        return 0;
+    return parser->input[parser->index[parser->pos]];
+}
+
+static json_t *parse_object(fast_parser_t *parser)
+{
+    json_t *object = json_object_in(parser->arena);
+    if(!object)
+        return NULL;
+
+    if(next_char(parser) == '}') {
+        parser->pos++;
+        return object;
+    }
+
+    while(1) {
+        const char *key;
+        char *copy = NULL;
+        size_t len, end, hash;
+        json_t *value;
+
+        if(next_char(parser) != '"')
+            goto error;
+
+        key = parse_string(parser, parser->index[parser->pos++], &len, &end);
+        if(!key)
+            goto error;
+        hash = hashtable_hash(key, len);
+
+        if(memchr(key, '\0', len) || check_gap(parser, end) ||
+           ((parser->flags & JSON_REJECT_DUPLICATES) &&
+            jsonp_object_get_hashed(object, key, len, hash)) ||
+           next_char(parser) != ':')
+            goto error;
+        parser->pos++;
+
+        /* the value may decode a string into the buffer of the key */
+        if(key == parser->buf) {
+            key = copy = jsonp_strndup(key, len);
+            if(!copy)
+                goto error;
+        }
+
+        value = parse_value(parser);
+        if(!value || jsonp_object_set_hashed(object, key, len, hash, value)) {
+            jsonp_free(copy);
+            goto error;
+        }
+        jsonp_free(copy);
+
+        if(next_char(parser) != ',')
+            break;
+        parser->pos++;
+    }
+
+    if(next_char(parser) != '}')
+        goto error;
+    parser->pos++;
+    return object;
+
+error:
+    json_decref(object);
+    return NULL;
+}
+
+static json_t *parse_array(fast_parser_t *parser)
+{
+    json_t *array = json_array_in(parser->arena);
+    if(!array)
+        return NULL;
+
+    if(next_char(parser) == ']') {
+        parser->pos++;
+        return array;
+    }
+
+    while(1) {
+        json_t *elem = parse_value(parser);
+        if(!elem || json_array_append_new(array, elem))
+            goto error;
+
+        if(next_char(parser) != ',')
+            break;
+        parser->pos++;
+    }
+
+    if(next_char(parser) != ']')
+        goto error;
+    parser->pos++;
+    return array;
+
+error:
+    json_decref(array);
+    return NULL;
+}
+
+static json_t *parse_value(fast_parser_t *parser)
+{
+    json_t *json;
+    size_t start;
+
+    if(parser->pos >= parser->count)
+        return NULL;
+
+    parser->depth++;
+    if(parser->depth > JSON_PARSER_MAX_DEPTH)
+        return NULL;
+
+    start = parser->index[parser->pos++];
+
+    switch(parser->input[start]) {
+        case '{':
+            json = parse_object(parser);
+            break;
+
+        case '[':
+            json = parse_array(parser);
+            break;
+
+        case '"': {
+            size_t len, end;
+            const char *value = parse_string(parser, start, &len, &end);
+            if(!value)
+                return NULL;
+
+            if((!(parser->flags & JSON_ALLOW_NUL) && memchr(value, '\0', len)) ||
+               check_gap(parser, end))
+                return NULL;
+
+            json = jsonp_stringn_nocheck_in(parser->arena, value, len);
+            break;
+        }
+
+        case '-':
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            json = parse_number(parser, start);
+            break;
+
+        case 't': case 'f': case 'n':
+            json = parse_literal(parser, start);
+            break;
+
+        default:
+            return NULL;
+    }
+
+    parser->depth--;
+    return json;
+}
+
+json_t *jsonp_loadb_fast(const char *buffer, size_t buflen, size_t flags,
+                         json_arena_t *arena)
+{
+    fast_parser_t parser;
+    json_t *result = NULL;
+
+    /* positions are stored in 32 bits */
+    if(buflen >= UINT32_MAX)
+        return NULL;
+
+    parser.input = buffer;
+    parser.len = buflen;
+    parser.flags = flags;
+    parser.index = NULL;
+    parser.pos = 0;
+    parser.depth = 0;
+    parser.arena = arena;
+    parser.buf = NULL;
+    parser.buf_size = 0;
+
+    if(build_index(&parser) || parser.count == 0)
+        goto out;
+
+    if(!(flags & JSON_DECODE_ANY)) {
+        char c = parser.input[parser.index[0]];
+        if(c != '[' && c != '{')
+            goto out;
+    }
+
+    result = parse_value(&parser);
+
+    /* trailing garbage */
+    if(result && parser.pos != parser.count) {
+        json_decref(result);
+        result = NULL;
+    }
+
+out:
+    jsonp_free(parser.index);
+    jsonp_free(parser.buf);
+    return result;
+}
@@ -0,0 +1,457 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* Lazily decoded containers for JSON_DECODE_LAZY.
+ *
+ * The input is validated up front without building any values and
+ * copied into a reference counted text. Objects and arrays only store
+ * the offset of their opening bracket in this text. Their members are
+ * decoded when the container is first accessed; nested containers are
+ * skipped over and stay lazy themselves.
+ *
+ * As the text is known to be valid, the scanning functions below do
+ * not check for errors.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "jansson_private.h"
+
+#include <string.h>
+
+#include "utf.h"
+
+/* Each json_object_get() of a key that hasn't been fetched yet scans
+   the whole object. After this many keys, or after a missing one, the
+   object is decoded instead, so that reading many keys is linear. */
+#define LAZY_OBJECT_SCANS  2
+
+struct lazy_text {
+    size_t refcount;
+    size_t flags;
+    char text[1];
+};
+
+static lazy_text_t *text_incref(lazy_text_t *text)
+{
+    JSON_INTERNAL_INCREF(text);
+    return text;
+}
+
+void jsonp_lazy_release(lazy_text_t *text)
+{
+    if(text && JSON_INTERNAL_DECREF(text) == 0)
+        jsonp_free(text);
+}
+
+static const char *skip_whitespace(const char *p)
+{
+    while(*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        p++;
+    return p;
+}
+
+/* p points to the opening quote. Returns a pointer past the closing
+   quote. */
+static const char *skip_string(const char *p)
+{
+    p++;
+    while(1) {
+        p += strcspn(p, "\"\\");
+        if(*p == '"')
+            return p + 1;
+        p += 2;
+    }
+}
+
+/* Skip a number or a literal */
+static const char *skip_atom(const char *p)
+{
+    return p + strcspn(p, " \t\n\r,]}");
+}
+
+static const char *skip_value(const char *p)
+{
+    size_t depth = 0;
+
+    if(*p == '"')
+        return skip_string(p);
+    if(*p != '{' && *p != '[')
+        return skip_atom(p);
+
+    do {
+        p += strcspn(p, "\"{}[]");
+        switch(*p) {
+            case '"':
+                p = skip_string(p);
+                break;
+            case '{': case '[':
+                depth++;
+                p++;
+                break;
+            default:
+                depth--;
+                p++;
+        }
+    } while(depth > 0);
+
+    return p;
+}
+
+static int32_t decode_hex4(const char *p)
+{
+    int32_t value = 0;
+    int i;
+
+    for(i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if(c <= '9')
+            value += c - '0';
+        else
+            value += (c | 0x20) - 'a' + 10;
+    }
+    return value;
+}
+
+/* Decode the string between p and end, excluding the quotes */
+static char *decode_string(const char *p, const char *end, size_t *len)
+{
+    char *result, *t;
+
+    result = t = jsonp_malloc(end - p + 1);
+    if(!result)
+        return NULL;
+
+    while(p < end) {
+        const char *q = memchr(p, '\\', end - p);
+        if(!q)
+            q = end;
+
+        memcpy(t, p, q - p);
+        t += q - p;
+        p = q;
+        if(p == end)
+            break;
+
+        switch(p[1]) {
+            case 'b': *t++ = '\b'; break;
+            case 'f': *t++ = '\f'; break;
+            case 'n': *t++ = '\n'; break;
+            case 'r': *t++ = '\r'; break;
+            case 't': *t++ = '\t'; break;
+            case 'u': {
+                int32_t value = decode_hex4(p + 2);
+                size_t length;
+
+                if(0xD800 <= value && value <= 0xDBFF) {
+                    int32_t value2 = decode_hex4(p + 8);
+                    value = ((value - 0xD800) << 10) + (value2 - 0xDC00) + 0x10000;
+                    p += 6;
+                }
+                utf8_encode(value, t, &length);
+                t += length;
+                p += 4;
+                break;
+            }
+            default:
+                *t++ = p[1];
+        }
+        p += 2;
+    }
+
+    *t = '\0';
+    *len = t - result;
+    return result;
+}
+
+static json_t *lazy_container(json_t *json, lazy_text_t *text, const char *p)
+{
+    if(!json)
+        return NULL;
+
+    if(json_is_object(json)) {
+        json_to_object(json)->lazy = text_incref(text);
+        json_to_object(json)->lazy_pos = p - text->text;
+    }
+    else {
+        json_to_array(json)->lazy = text_incref(text);
+        json_to_array(json)->lazy_pos = p - text->text;
+    }
+    return json;
+}
+
+/* Decode the value at *pos and advance *pos past it */
+static json_t *lazy_value(lazy_text_t *text, const char **pos)
+{
+    const char *p = *pos;
+    const char *end;
+
+    switch(*p) {
+        case '{':
+            *pos = skip_value(p);
+            return lazy_container(json_object(), text, p);
+
+        case '[':
+            *pos = skip_value(p);
+            return lazy_container(json_array(), text, p);
+
+        case '"': {
+            char *value;
+            size_t len;
+
+            *pos = end = skip_string(p);
+            value = decode_string(p + 1, end - 1, &len);
+            return jsonp_stringn_nocheck_own(value, len);
+        }
+
+        case 't':
+            *pos = p + 4;
+            return json_true();
+
+        case 'f':
+            *pos = p + 5;
+            return json_false();
+
+        case 'n':
+            *pos = p + 4;
+            return json_null();
+
+        default: {
+            size_t len;
+
+            *pos = end = skip_atom(p);
+            len = end - p;
+
+            if(!(text->flags & JSON_DECODE_INT_AS_REAL) && !memchr(p, '.', len) &&
+               !memchr(p, 'e', len) && !memchr(p, 'E', len))
+            {
+                json_int_t value;
+                jsonp_strtoint(p, len, &value);
+                return jsonp_integer_shared(NULL, value, text->flags);
+            }
+            else {
+                double value;
+                jsonp_strtod(p, len, &value);
+                return json_real(value);
+            }
+        }
+    }
+}
+
+/* Compare the undecoded key between p and end with key */
+static int key_equal(const char *p, const char *end, const char *key, size_t key_len)
+{
+    char *decoded;
+    size_t len;
+    int equal;
+
+    if(!memchr(p, '\\', end - p))
+        return (size_t)(end - p) == key_len && memcmp(p, key, key_len) == 0;
+
+    /* escapes only make a key shorter */
+    if((size_t)(end - p) < key_len)
+        return 0;
+
+    decoded = decode_string(p, end, &len);
+    if(!decoded)
+        return 0;
+
+    equal = len == key_len && memcmp(decoded, key, len) == 0;
+    jsonp_free(decoded);
+    return equal;
+}
+
+json_t *jsonp_lazy_object_get(json_object_t *object, const char *key)
+{
+    lazy_text_t *text = object->lazy;
+    const char *p, *found = NULL;
+    size_t key_len;
+    json_t *value;
+
+    value = hashtable_get(&object->hashtable, key);
+    if(value)
+        return value;
+
+    if(object->hashtable.size >= LAZY_OBJECT_SCANS) {
+        if(jsonp_lazy_load_object(object))
+            return NULL;
+        return hashtable_get(&object->hashtable, key);
+    }
+
+    key_len = strlen(key);
+    p = skip_whitespace(text->text + object->lazy_pos + 1);
+
+    /* Find the last occurrence of the key, like json_loadb() does */
+    while(*p == '"') {
+        const char *end = skip_string(p);
+        int match = key_equal(p + 1, end - 1, key, key_len);
+
+        p = skip_whitespace(skip_whitespace(end) + 1);
+        if(match) {
+            found = p;
+            if(text->flags & JSON_REJECT_DUPLICATES)
+                break;
+        }
+
+        p = skip_whitespace(skip_value(p));
+        if(*p != ',')
+            break;
+        p = skip_whitespace(p + 1);
+    }
+
+    /* a missing key would be scanned for again on every call */
+    if(!found) {
+        jsonp_lazy_load_object(object);
+        return NULL;
+    }
+
+    value = lazy_value(text, &found);
+    if(!value)
+        return NULL;
+
+    /* The object keeps the value, so that a borrowed reference can
+       be returned */
+    if(hashtable_set(&object->hashtable, key, value)) {
+        json_decref(value);
+        return NULL;
+    }
+    return value;
+}
+
+int jsonp_lazy_load_object(json_object_t *object)
+{
+    lazy_text_t *text = object->lazy;
+    hashtable_t fetched;
+    const char *p;
+    void *iter;
+    int res = -1;
+
+    /* Values already returned by json_object_get() must stay the same
+       objects, but the members have to be in the order of the input */
+    if(hashtable_init(&fetched, NULL))
+        return -1;
+
+    iter = hashtable_iter(&object->hashtable);
+    while(iter) {
+        json_t *value = hashtable_iter_value(iter);
+        if(hashtable_set(&fetched, hashtable_iter_key(iter), json_incref(value))) {
+            json_decref(value);
+            goto out;
+        }
+        iter = hashtable_iter_next(&object->hashtable, iter);
+    }
+    hashtable_clear(&object->hashtable);
+
+    object->lazy = NULL;
+    p = skip_whitespace(text->text + object->lazy_pos + 1);
+
+    while(*p == '"') {
+        const char *end = skip_string(p);
+        char *key;
+        size_t len;
+        json_t *value;
+
+        key = decode_string(p + 1, end - 1, &len);
+        if(!key)
+            goto out;
+
+        p = skip_whitespace(skip_whitespace(end) + 1);
+
+        value = hashtable_get(&fetched, key);
+        if(value) {
+            json_incref(value);
+            p = skip_value(p);
+        }
+        else
+            value = lazy_value(text, &p);
+
+        if(!value || hashtable_set(&object->hashtable, key, value)) {
+            json_decref(value);
+            jsonp_free(key);
+            goto out;
+        }
+        jsonp_free(key);
+
+        p = skip_whitespace(p);
+        if(*p != ',')
+            break;
+        p = skip_whitespace(p + 1);
+    }
+    res = 0;
+
+out:
+    hashtable_close(&fetched);
+    if(!object->lazy)
+        jsonp_lazy_release(text);
+    return res;
+}
+
+int jsonp_lazy_load_array(json_array_t *array)
+{
+    lazy_text_t *text = array->lazy;
+    const char *p;
+    int res = -1;
+
+    array->lazy = NULL;
+    p = skip_whitespace(text->text + array->lazy_pos + 1);
+
+    if(*p != ']') {
+        while(1) {
+            if(json_array_append_new(&array->json, lazy_value(text, &p)))
+                goto out;
+
+            p = skip_whitespace(p);
+            if(*p != ',')
+                break;
+            p = skip_whitespace(p + 1);
+        }
+    }
+    res = 0;
+
+out:
+    jsonp_lazy_release(text);
+    return res;
+}
+
+json_t *jsonp_loadb_lazy(const char *buffer, size_t buflen, size_t flags, json_error_t *error)
+{
+    static const json_handler_t validator;
+    json_error_t local_error;
+    lazy_text_t *text;
+    const char *p;
+    size_t len;
+    json_t *result;
+
+    if(!error)
+        error = &local_error;
+
+    /* Validate the whole input with the same lexer and error messages
+       as json_loadb() */
+    if(json_parse_events(buffer, buflen, &validator, NULL, flags, error))
+        return NULL;
+
+    /* With JSON_DISABLE_EOF_CHECK the value may end before buflen */
+    len = error->position;
+
+    text = jsonp_malloc(offsetof(lazy_text_t, text) + len + 1);
+    if(!text)
+        return NULL;
+
+    text->refcount = 1;
+    text->flags = flags;
+    memcpy(text->text, buffer, len);
+    text->text[len] = '\0';
+
+    p = skip_whitespace(text->text);
+    result = lazy_value(text, &p);
+
+    jsonp_lazy_release(text);
+    return result;
+}
@@ -0,0 +1,442 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* Parallel decoding of newline delimited JSON.
+ *
+ * The buffer is processed in rounds. Each round cuts a slice of about
+ * LINES_SLICE_SIZE bytes, ending at a newline, for every thread. The
+ * worker threads are started once and woken for every round. They
+ * decode their slices into result arrays, and the calling thread then
+ * passes the results to the callback in input order. Only the values
+ * of one round are alive at a time.
+ *
+ * With JSON_LINES_ARENA, every thread decodes into an arena of its
+ * own, which is reset when the results of its slice are delivered.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "jansson_private.h"
+
+#include <limits.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#define HAVE_THREADS 1
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#elif defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#define HAVE_THREADS 1
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#endif
+
+#define LINES_SLICE_SIZE  (256 * 1024)
+
+typedef struct {
+    json_t *value;
+    json_error_t error;
+    size_t line;        /* line number within the slice, from 0 */
+    size_t offset;      /* offset of the line within the slice */
+} line_result_t;
+
+typedef struct {
+    const char *data;
+    size_t len;
+    size_t flags;
+    json_arena_t *arena;    /* where the values go, or NULL */
+
+    line_result_t *results;
+    size_t count;
+    size_t size;
+    size_t lines;       /* number of lines in the slice */
+    int failed;
+} slice_t;
+
+static int is_blank(const char *p, const char *end)
+{
+    for(; p < end; p++) {
+        if(*p != ' ' && *p != '\t' && *p != '\r')
+            return 0;
+    }
+    return 1;
+}
+
+static int slice_add(slice_t *slice)
+{
+    if(slice->count == slice->size) {
+        size_t new_size = slice->size ? slice->size * 2 : 64;
+        line_result_t *new_results;
+
+        new_results = jsonp_realloc(slice->results,
+                                    slice->size * sizeof(line_result_t),
+                                    new_size * sizeof(line_result_t));
+        if(!new_results)
+            return -1;
+
+        slice->results = new_results;
+        slice->size = new_size;
+    }
+    return 0;
+}
+
+static void decode_slice(slice_t *slice)
+{
+    const char *p = slice->data;
+    const char *end = slice->data + slice->len;
+
+    while(p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if(!eol)
+            eol = end;
+
+        if(!is_blank(p, eol)) {
+            line_result_t *result;
+
+            if(slice_add(slice)) {
+                slice->failed = 1;
+                return;
+            }
+
+            result = &slice->results[slice->count++];
+            result->line = slice->lines;
+            result->offset = p - slice->data;
+            result->value = json_loadb_arena(p, eol - p, slice->flags,
+                                             slice->arena, &result->error);
+        }
+
+        slice->lines++;
+        p = eol + 1;
+    }
+}
+
+#ifdef HAVE_THREADS
+
+/* The worker threads, which wait for a new round to begin */
+typedef struct {
+    mutex_t lock;
+    cond_t wake;        /* a round has begun, or the workers should quit */
+    cond_t done;        /* the last busy worker is done */
+    size_t round;
+    int count;          /* slices in this round */
+    int busy;           /* workers still decoding */
+    int quit;
+    slice_t *slices;
+} workers_t;
+
+typedef struct {
+    workers_t *workers;
+    int index;          /* of the worker's slice */
+    thread_t thread;
+} worker_t;
+
+static void mutex_init(mutex_t *mutex)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+static void mutex_destroy(mutex_t *mutex)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+static void mutex_lock(mutex_t *mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+static void mutex_unlock(mutex_t *mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+static void cond_init(cond_t *cond)
+{
+#ifdef _WIN32
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+static void cond_destroy(cond_t *cond)
+{
+#ifdef _WIN32
+    (void)cond;
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+static void cond_wait(cond_t *cond, mutex_t *mutex)
+{
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+static void cond_broadcast(cond_t *cond)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+static void worker_run(worker_t *worker)
+{
+    workers_t *workers = worker->workers;
+    size_t seen = 0;
+
+    mutex_lock(&workers->lock);
+    while(1) {
+        while(workers->round == seen && !workers->quit)
+            cond_wait(&workers->wake, &workers->lock);
+        if(workers->quit)
+            break;
+
+        seen = workers->round;
+        if(worker->index < workers->count) {
+            mutex_unlock(&workers->lock);
+            decode_slice(&workers->slices[worker->index]);
+            mutex_lock(&workers->lock);
+
+            if(--workers->busy == 0)
+                cond_broadcast(&workers->done);
+        }
+    }
+    mutex_unlock(&workers->lock);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_thread(LPVOID arg)
+#else
+static void *worker_thread(void *arg)
+#endif
+{
+    worker_run(arg);
+    return 0;
+}
+
+static int thread_start(thread_t *thread, worker_t *worker)
+{
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, worker_thread, worker, 0, NULL);
+    return *thread ? 0 : -1;
+#else
+    return pthread_create(thread, NULL, worker_thread, worker) ? -1 : 0;
+#endif
+}
+
+static void thread_join(thread_t thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+/* Decode the first count slices, the first one in the calling thread */
+static void workers_decode(workers_t *workers, int count)
+{
+    mutex_lock(&workers->lock);
+    workers->count = count;
+    workers->busy = count - 1;
+    workers->round++;
+    cond_broadcast(&workers->wake);
+    mutex_unlock(&workers->lock);
+
+    decode_slice(&workers->slices[0]);
+
+    mutex_lock(&workers->lock);
+    while(workers->busy)
+        cond_wait(&workers->done, &workers->lock);
+    mutex_unlock(&workers->lock);
+}
+
+static void workers_stop(workers_t *workers, worker_t *worker, int started)
+{
+    int i;
+
+    mutex_lock(&workers->lock);
+    workers->quit = 1;
+    cond_broadcast(&workers->wake);
+    mutex_unlock(&workers->lock);
+
+    for(i = 0; i < started; i++)
+        thread_join(worker[i].thread);
+
+    cond_destroy(&workers->done);
+    cond_destroy(&workers->wake);
+    mutex_destroy(&workers->lock);
+}
+
+#endif
+
+/* A line or position relative to the whole buffer, which may not fit
+   in the int of json_error_t */
+static int error_int(size_t value)
+{
+    return value > INT_MAX ? INT_MAX : (int)value;
+}
+
+int json_load_lines_parallel(const char *buffer, size_t buflen, size_t flags, int nthreads,
+                             json_lines_callback_t callback, void *ctx)
+{
+    slice_t *slices;
+#ifdef HAVE_THREADS
+    workers_t workers;
+    worker_t *worker;
+#endif
+    size_t pos = 0, index = 0, line = 0;
+    int i, count, started = 0, res = 0;
+
+    if(!buffer || !callback)
+        return -1;
+
+    if(nthreads < 1)
+        nthreads = 1;
+
+    slices = jsonp_malloc(nthreads * sizeof(slice_t));
+    if(!slices)
+        return -1;
+
+    for(i = 0; i < nthreads; i++) {
+        slices[i].arena = NULL;
+        if((flags & JSON_LINES_ARENA) && res == 0) {
+            slices[i].arena = json_arena_create(0);
+            if(!slices[i].arena)
+                res = -1;
+        }
+    }
+
+#ifdef HAVE_THREADS
+    worker = jsonp_malloc(nthreads * sizeof(worker_t));
+    if(!worker)
+        res = -1;
+
+    mutex_init(&workers.lock);
+    cond_init(&workers.wake);
+    cond_init(&workers.done);
+    workers.round = 0;
+    workers.count = 0;
+    workers.busy = 0;
+    workers.quit = 0;
+    workers.slices = slices;
+
+    /* The calling thread decodes the first slice of every round. If a
+       thread cannot be started, fewer slices are cut per round. */
+    for(i = 1; i < nthreads && res == 0; i++) {
+        worker[started].workers = &workers;
+        worker[started].index = i;
+        if(thread_start(&worker[started].thread, &worker[started]))
+            break;
+        started++;
+    }
+#endif
+
+    while(pos < buflen && res == 0) {
+        /* Cut the slices of this round */
+        for(count = 0; count <= started && pos < buflen; count++) {
+            slice_t *slice = &slices[count];
+            size_t end = buflen;
+
+            if(buflen - pos > LINES_SLICE_SIZE) {
+                const char *eol = memchr(buffer + pos + LINES_SLICE_SIZE - 1, '\n',
+                                         buflen - pos - LINES_SLICE_SIZE + 1);
+                if(eol)
+                    end = eol - buffer + 1;
+            }
+
+            slice->data = buffer + pos;
+            slice->len = end - pos;
+            slice->flags = flags;
+            slice->results = NULL;
+            slice->count = slice->size = slice->lines = 0;
+            slice->failed = 0;
+            pos = end;
+        }
+
+#ifdef HAVE_THREADS
+        workers_decode(&workers, count);
+#else
+        decode_slice(&slices[0]);
+#endif
+
+        /* Deliver the results in order */
+        for(i = 0; i < count; i++) {
+            slice_t *slice = &slices[i];
+            size_t j;
+
+            if(slice->failed)
+                res = -1;
+
+            for(j = 0; j < slice->count; j++) {
+                line_result_t *result = &slice->results[j];
+
+                if(res) {
+                    json_decref(result->value);
+                    continue;
+                }
+
+                if(!result->value) {
+                    /* Make the error relative to the whole buffer */
+                    result->error.line = error_int(line + result->line + 1);
+                    result->error.position = error_int(
+                        (size_t)result->error.position +
+                        (size_t)(slice->data - buffer) + result->offset);
+                }
+
+                if(callback(index++, result->value, result->value ? NULL : &result->error, ctx))
+                    res = -1;
+            }
+
+            line += slice->lines;
+            jsonp_free(slice->results);
+            if(slice->arena)
+                json_arena_reset(slice->arena);
+        }
+    }
+
+#ifdef HAVE_THREADS
+    workers_stop(&workers, worker, started);
+    jsonp_free(worker);
+#endif
+    for(i = 0; i < nthreads; i++) {
+        if(slices[i].arena)
+            json_arena_destroy(slices[i].arena);
+    }
+    jsonp_free(slices);
+    return res;
+}
@@ -14,25 +14,66 @@
 
 /* C89 allows these to be macros */
 #undef malloc
+#undef realloc
 #undef free
 
 /* memory function pointers */
 static json_malloc_t do_malloc = malloc;
 static json_free_t do_free = free;
 
+/* set by json_set_alloc_funcs_ex(), which overrides the above */
+static json_malloc_ex_t do_malloc_ex = NULL;
+static json_realloc_ex_t do_realloc_ex = NULL;
+static json_free_ex_t do_free_ex = NULL;
+static void *alloc_ctx = NULL;
+
 void *jsonp_malloc(size_t size)
 {
     if(!size)
         return NULL;
 
+    if(do_malloc_ex)
+        return (*do_malloc_ex)(size, alloc_ctx);
+
     return (*do_malloc)(size);
 }
 
+void *jsonp_realloc(void *ptr, size_t old_size, size_t new_size)
+{
+    void *new_ptr;
+
+    if(!ptr)
+        return jsonp_malloc(new_size);
+
+    if(!new_size)
+        return NULL;
+
+    if(do_realloc_ex)
+        return (*do_realloc_ex)(ptr, new_size, alloc_ctx);
+
+    if(!do_malloc_ex && do_malloc == malloc && do_free == free)
+        return realloc(ptr, new_size);
+
+    /* the functions can't resize, so move to a new block */
+    new_ptr = jsonp_malloc(new_size);
+    if(!new_ptr)
+        return NULL;
+
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    jsonp_free(ptr);
+    return new_ptr;
+}
+
 void jsonp_free(void *ptr)
 {
     if(!ptr)
         return;
 
+    if(do_free_ex) {
+        (*do_free_ex)(ptr, alloc_ctx);
+        return;
+    }
+
     (*do_free)(ptr);
 }
 
@@ -54,10 +95,33 @@ char *jsonp_strndup(const char *str, size_t len)
     return new_str;
 }
 
+int jsonp_alloc_funcs_default(void)
+{
+    return !do_malloc_ex && do_malloc == malloc && do_free == free;
+}
+
 void json_set_alloc_funcs(json_malloc_t malloc_fn, json_free_t free_fn)
 {
     do_malloc = malloc_fn;
     do_free = free_fn;
+
+    do_malloc_ex = NULL;
+    do_realloc_ex = NULL;
+    do_free_ex = NULL;
+    alloc_ctx = NULL;
+}
+
+void json_set_alloc_funcs_ex(json_malloc_ex_t malloc_fn,
+                             json_realloc_ex_t realloc_fn,
+                             json_free_ex_t free_fn, void *ctx)
+{
+    do_malloc_ex = malloc_fn;
+    do_realloc_ex = realloc_fn;
+    do_free_ex = free_fn;
+    alloc_ctx = ctx;
+
+    do_malloc = NULL;
+    do_free = NULL;
 }
 
 void json_get_alloc_funcs(json_malloc_t *malloc_fn, json_free_t *free_fn)
@@ -67,3 +131,17 @@ void json_get_alloc_funcs(json_malloc_t *malloc_fn, json_free_t *free_fn)
     if (free_fn)
         *free_fn = do_free;
 }
+
+void json_get_alloc_funcs_ex(json_malloc_ex_t *malloc_fn,
+                             json_realloc_ex_t *realloc_fn,
+                             json_free_ex_t *free_fn, void **ctx)
+{
+    if (malloc_fn)
+        *malloc_fn = do_malloc_ex;
+    if (realloc_fn)
+        *realloc_fn = do_realloc_ex;
+    if (free_fn)
+        *free_fn = do_free_ex;
+    if (ctx)
+        *ctx = alloc_ctx;
+}
@@ -493,7 +493,7 @@ static int unpack_object(scanner_t *s, json_t *root, va_list *ap)
     */
     hashtable_t key_set;
 
-    if(hashtable_init(&key_set)) {
+    if(hashtable_init(&key_set, NULL)) {
         set_error(s, "<internal>", json_error_out_of_memory, "Out of memory");
         return -1;
     }
@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* Per-thread pools for the small allocations of values: the nodes,
+   object pairs and buckets, and array tables. Their sizes are known
+   when they are freed, so no header is needed per block.
+
+   Every thread has a freelist per size class, refilled from slabs of
+   SLAB_SIZE bytes that hold blocks of one class. Slabs are aligned to
+   their size, so the slab of a block, and the thread that owns it, is
+   found by masking the address. A block freed by another thread is
+   pushed to a lock-free list of its owner, which takes the whole list
+   back when it runs out of blocks of some class.
+
+   The memory is never returned: the pool of a thread that exits is
+   taken over by the next thread that starts allocating. The pools are
+   only used if no custom allocation functions (json_set_alloc_funcs())
+   are set when the first value is created, so that such functions
+   still see every allocation. The choice is kept for the life of the
+   process, because a value may be freed after the functions change. */
+
+#if HAVE_CONFIG_H
+#include <jansson_private_config.h>
+#endif
+
+#include <string.h>
+
+#include "bosjansson.h"
+#include "jansson_private.h"
+
+#if USE_POOL_ALLOC && HAVE___THREAD && HAVE_ATOMIC_BUILTINS && HAVE_PTHREAD_H
+
+#include <pthread.h>
+
+#define GRANULE          16
+#define MAX_SIZE         256
+#define CLASSES          (MAX_SIZE / GRANULE)
+#define SLAB_SIZE        (16 * 1024)
+#define SEGMENT_SLABS    16
+
+#define size_class(size_)  (((size_) - 1) / GRANULE)
+#define slab_of(ptr_)  ((slab_t *)((uintptr_t)(ptr_) & ~(uintptr_t)(SLAB_SIZE - 1)))
+
+typedef struct block {
+    struct block *next;
+} block_t;
+
+typedef struct pool {
+    block_t *free[CLASSES];
+    char *pos[CLASSES];       /* unused part of the current slab */
+    char *end[CLASSES];
+    char *slabs;              /* unused slabs of the current segment */
+    char *slabs_end;
+    block_t *remote;          /* pushed by other threads */
+    struct pool *next_orphan;
+} pool_t;
+
+typedef struct {
+    pool_t *owner;
+    size_t size;
+} slab_t;
+
+#define SLAB_HEADER  (((sizeof(slab_t) + GRANULE - 1) / GRANULE) * GRANULE)
+
+static __thread pool_t *pool_self;
+
+/* 0 until the first allocation, then 1 if the pools are used, -1 if not */
+static int pool_enabled;
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_key;
+static pthread_mutex_t orphans_lock = PTHREAD_MUTEX_INITIALIZER;
+static pool_t *orphans;
+
+static void pool_orphan(void *data)
+{
+    pool_t *pool = data;
+
+    /* blocks freed later in this thread go to the pool's remote list */
+    pool_self = NULL;
+
+    pthread_mutex_lock(&orphans_lock);
+    pool->next_orphan = orphans;
+    orphans = pool;
+    pthread_mutex_unlock(&orphans_lock);
+}
+
+static void pool_init_key(void)
+{
+    pthread_key_create(&pool_key, pool_orphan);
+}
+
+static pool_t *pool_get(void)
+{
+    pool_t *pool = pool_self;
+    if(pool)
+        return pool;
+
+    pthread_once(&pool_once, pool_init_key);
+
+    pthread_mutex_lock(&orphans_lock);
+    pool = orphans;
+    if(pool)
+        orphans = pool->next_orphan;
+    pthread_mutex_unlock(&orphans_lock);
+
+    if(!pool) {
+        pool = jsonp_malloc(sizeof(pool_t));
+        if(!pool)
+            return NULL;
+        memset(pool, 0, sizeof(pool_t));
+    }
+
+    /* hand the pool on when the thread exits */
+    pthread_setspecific(pool_key, pool);
+    pool_self = pool;
+    return pool;
+}
+
+static int pool_use(void)
+{
+    int enabled = __atomic_load_n(&pool_enabled, __ATOMIC_RELAXED);
+
+    if(!enabled) {
+        enabled = jsonp_alloc_funcs_default() ? 1 : -1;
+        __atomic_store_n(&pool_enabled, enabled, __ATOMIC_RELAXED);
+    }
+    return enabled > 0;
+}
+
+static slab_t *pool_new_slab(pool_t *pool, size_t size)
+{
+    slab_t *slab;
+
+    if(pool->slabs == pool->slabs_end) {
+        /* one slab more than used, to align the others */
+        char *segment = jsonp_malloc((SEGMENT_SLABS + 1) * SLAB_SIZE);
+        if(!segment)
+            return NULL;
+
+        pool->slabs = (char *)slab_of(segment + SLAB_SIZE - 1);
+        pool->slabs_end = pool->slabs + SEGMENT_SLABS * SLAB_SIZE;
+    }
+
+    slab = (slab_t *)pool->slabs;
+    pool->slabs += SLAB_SIZE;
+
+    slab->owner = pool;
+    slab->size = size;
+    return slab;
+}
+
+/* Take back the blocks that other threads have freed */
+static void pool_collect(pool_t *pool)
+{
+    block_t *block, *next;
+
+    block = __atomic_exchange_n(&pool->remote, NULL, __ATOMIC_ACQUIRE);
+    for(; block; block = next) {
+        size_t class = size_class(slab_of(block)->size);
+
+        next = block->next;
+        block->next = pool->free[class];
+        pool->free[class] = block;
+    }
+}
+
+static void *pool_refill(pool_t *pool, size_t class)
+{
+    size_t size = (class + 1) * GRANULE;
+    char *ptr;
+
+    if(__atomic_load_n(&pool->remote, __ATOMIC_RELAXED)) {
+        pool_collect(pool);
+        if(pool->free[class]) {
+            block_t *block = pool->free[class];
+            pool->free[class] = block->next;
+            return block;
+        }
+    }
+
+    if((size_t)(pool->end[class] - pool->pos[class]) < size) {
+        slab_t *slab = pool_new_slab(pool, size);
+        if(!slab)
+            return NULL;
+
+        pool->pos[class] = (char *)slab + SLAB_HEADER;
+        pool->end[class] = (char *)slab + SLAB_SIZE;
+    }
+
+    ptr = pool->pos[class];
+    pool->pos[class] += size;
+    return ptr;
+}
+
+void *jsonp_node_malloc(size_t size)
+{
+    pool_t *pool;
+    block_t *block;
+    size_t class;
+
+    if(!size || size > MAX_SIZE || !pool_use())
+        return jsonp_malloc(size);
+
+    /* blocks of this size can't come from anywhere else, see
+       jsonp_node_free() */
+    pool = pool_get();
+    if(!pool)
+        return NULL;
+
+    class = size_class(size);
+    block = pool->free[class];
+    if(!block)
+        return pool_refill(pool, class);
+
+    pool->free[class] = block->next;
+    return block;
+}
+
+void jsonp_node_free(void *ptr, size_t size)
+{
+    block_t *block = ptr;
+    slab_t *slab;
+
+    if(!ptr)
+        return;
+
+    if(!size || size > MAX_SIZE ||
+       __atomic_load_n(&pool_enabled, __ATOMIC_RELAXED) <= 0) {
+        jsonp_free(ptr);
+        return;
+    }
+
+    slab = slab_of(ptr);
+    if(slab->owner == pool_self) {
+        size_t class = size_class(slab->size);
+
+        block->next = pool_self->free[class];
+        pool_self->free[class] = block;
+    }
+    else {
+        pool_t *owner = slab->owner;
+
+        block->next = __atomic_load_n(&owner->remote, __ATOMIC_RELAXED);
+        while(!__atomic_compare_exchange_n(&owner->remote, &block->next, block, 1,
+                                           __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+}
+
+void *jsonp_node_realloc(void *ptr, size_t old_size, size_t new_size)
+{
+    void *new_ptr;
+
+    if(!ptr)
+        return jsonp_node_malloc(new_size);
+
+    if(__atomic_load_n(&pool_enabled, __ATOMIC_RELAXED) <= 0 ||
+       (old_size > MAX_SIZE && new_size > MAX_SIZE))
+        return jsonp_realloc(ptr, old_size, new_size);
+
+    if(old_size && new_size && old_size <= MAX_SIZE && new_size <= MAX_SIZE &&
+       size_class(old_size) == size_class(new_size))
+        return ptr;
+
+    /* moving into or out of the pools, or to another size class */
+    new_ptr = jsonp_node_malloc(new_size);
+    if(!new_ptr)
+        return NULL;
+
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    jsonp_node_free(ptr, old_size);
+    return new_ptr;
+}
+
+#else
+
+void *jsonp_node_malloc(size_t size)
+{
+    return jsonp_malloc(size);
+}
+
+void *jsonp_node_realloc(void *ptr, size_t old_size, size_t new_size)
+{
+    return jsonp_realloc(ptr, old_size, new_size);
+}
+
+void jsonp_node_free(void *ptr, size_t size)
+{
+    (void)size;
+    jsonp_free(ptr);
+}
+
+#endif
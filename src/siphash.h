@@ -0,0 +1,79 @@
+/*
+ * SipHash, by Jean-Philippe Aumasson and Daniel J. Bernstein, a keyed
+ * hash function that makes it hard to find colliding keys without
+ * knowing the secret key. This is SipHash-1-3, which also protects
+ * the dicts of Python and the HashMaps of Rust.
+ *
+ * Words are read in the machine's byte order. The hashes are only
+ * used in memory, so they needn't be the same on every platform.
+ */
+
+#ifndef SIPHASH_H
+#define SIPHASH_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include <jansson_private_config.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#define siphash_rotl(x, b)  (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define siphash_round(v0, v1, v2, v3)                                   \
+    do {                                                                \
+        v0 += v1; v1 = siphash_rotl(v1, 13); v1 ^= v0;                  \
+        v0 = siphash_rotl(v0, 32);                                      \
+        v2 += v3; v3 = siphash_rotl(v3, 16); v3 ^= v2;                  \
+        v0 += v3; v3 = siphash_rotl(v3, 21); v3 ^= v0;                  \
+        v2 += v1; v1 = siphash_rotl(v1, 17); v1 ^= v2;                  \
+        v2 = siphash_rotl(v2, 32);                                      \
+    } while(0)
+
+static JSON_INLINE uint64_t siphash(const void *key, size_t len,
+                                    uint64_t k0, uint64_t k1)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    const uint8_t *end = p + (len & ~(size_t)7);
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+    uint64_t m;
+
+    for(; p != end; p += 8) {
+        memcpy(&m, p, 8);
+        v3 ^= m;
+        siphash_round(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    /* the last 0 to 7 bytes and the length */
+    m = (uint64_t)len << 56;
+    switch(len & 7) {
+        case 7: m |= (uint64_t)p[6] << 48; /* fall through */
+        case 6: m |= (uint64_t)p[5] << 40; /* fall through */
+        case 5: m |= (uint64_t)p[4] << 32; /* fall through */
+        case 4: m |= (uint64_t)p[3] << 24; /* fall through */
+        case 3: m |= (uint64_t)p[2] << 16; /* fall through */
+        case 2: m |= (uint64_t)p[1] << 8;  /* fall through */
+        case 1: m |= (uint64_t)p[0];
+    }
+
+    v3 ^= m;
+    siphash_round(v0, v1, v2, v3);
+    v0 ^= m;
+
+    v2 ^= 0xff;
+    siphash_round(v0, v1, v2, v3);
+    siphash_round(v0, v1, v2, v3);
+    siphash_round(v0, v1, v2, v3);
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+#endif
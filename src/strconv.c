@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <errno.h>
+#include <float.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
@@ -8,6 +9,7 @@
 #endif
 #include "jansson_private.h"
 #include "strbuffer.h"
+#include "strconv_tables.h"
 
 /* need jansson_private_config.h to get the correct snprintf */
 #ifdef HAVE_CONFIG_H
@@ -18,6 +20,10 @@
 #define strtod __strtod
 #endif
 
+/* Largest value representable by json_int_t */
+#define JSON_INTEGER_MAX \
+    ((uint64_t)-1 >> (65 - 8 * sizeof(json_int_t)))
+
 #if JSON_HAVE_LOCALECONV
 #include <locale.h>
 
@@ -31,7 +37,7 @@
     this way. Multi-threaded programs should use uselocale() instead.
 */
 
-static void to_locale(strbuffer_t *strbuffer)
+static void to_locale(char *buffer)
 {
     const char *point;
     char *pos;
@@ -42,7 +48,7 @@ static void to_locale(strbuffer_t *strbuffer)
         return;
     }
 
-    pos = strchr(strbuffer->value, '.');
+    pos = strchr(buffer, '.');
     if(pos)
         *pos = *point;
 }
@@ -64,18 +70,182 @@ static void from_locale(char *buffer)
 }
 #endif
 
-int jsonp_strtod(strbuffer_t *strbuffer, double *out)
+
+/*** 128-bit arithmetic ***/
+
+typedef struct {
+    uint64_t high;
+    uint64_t low;
+} uint128_parts_t;
+
+static JSON_INLINE uint128_parts_t mul_64x64(uint64_t a, uint64_t b)
 {
-    double value;
+    uint128_parts_t result;
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 product = (unsigned __int128)a * b;
+    result.high = (uint64_t)(product >> 64);
+    result.low = (uint64_t)product;
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t p0 = a_lo * b_lo;
+    uint64_t p1 = a_lo * b_hi;
+    uint64_t p2 = a_hi * b_lo;
+    uint64_t p3 = a_hi * b_hi;
+    uint64_t middle = (p0 >> 32) + (uint32_t)p1 + (uint32_t)p2;
+
+    result.low = (middle << 32) | (uint32_t)p0;
+    result.high = p3 + (p1 >> 32) + (p2 >> 32) + (middle >> 32);
+#endif
+    return result;
+}
+
+static JSON_INLINE int leading_zeros(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(value);
+#else
+    int count = 0;
+    while(!(value & ((uint64_t)1 << 63))) {
+        value <<= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+
+/*** string -> number ***/
+
+#define DOUBLE_MANTISSA_BITS   52
+#define DOUBLE_MIN_EXPONENT    (-1023)
+#define DOUBLE_INFINITE_POWER  0x7FF
+
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+/* Powers of ten that are exactly representable as doubles */
+static const double exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#endif
+
+/*
+  Compute the IEEE 754 bits (without sign) of the double nearest to
+  w * 10^q, w != 0, using the Eisel-Lemire algorithm. Returns 0 on
+  success, or -1 in the rare case where the 128-bit approximation of
+  5^q is not precise enough to decide the rounding.
+*/
+static int eisel_lemire(uint64_t w, int64_t q, uint64_t *bits)
+{
+    uint128_parts_t product;
+    uint64_t mantissa;
+    int lz, upperbit, shift;
+    int64_t power2;
+    size_t index;
+
+    if(q < POW5_128_MIN_EXP) {
+        *bits = 0;
+        return 0;
+    }
+    if(q > POW5_128_MAX_EXP) {
+        *bits = (uint64_t)DOUBLE_INFINITE_POWER << DOUBLE_MANTISSA_BITS;
+        return 0;
+    }
+
+    lz = leading_zeros(w);
+    w <<= lz;
+
+    /* Only the upper DOUBLE_MANTISSA_BITS + 3 bits of the product are
+       needed. Use the lower half of the power only if they might be
+       affected by it. */
+    index = 2 * (size_t)(q - POW5_128_MIN_EXP);
+    product = mul_64x64(w, pow5_128[index]);
+    if((product.high & (~(uint64_t)0 >> (DOUBLE_MANTISSA_BITS + 3))) ==
+       (~(uint64_t)0 >> (DOUBLE_MANTISSA_BITS + 3)))
+    {
+        uint128_parts_t second = mul_64x64(w, pow5_128[index + 1]);
+        product.low += second.high;
+        if(second.high > product.low)
+            product.high++;
+    }
+
+    /* 5^q is exact within 128 bits for -27 <= q <= 55, elsewhere an
+       all-ones lower half means the result cannot be trusted */
+    if(product.low == ~(uint64_t)0 && (q < -27 || q > 55))
+        return -1;
+
+    upperbit = (int)(product.high >> 63);
+    shift = upperbit + 64 - DOUBLE_MANTISSA_BITS - 3;
+    mantissa = product.high >> shift;
+    power2 = (((152170 + 65536) * q) >> 16) + 63 + upperbit - lz
+             - DOUBLE_MIN_EXPONENT;
+
+    if(power2 <= 0) {
+        /* subnormal */
+        if(-power2 + 1 >= 64) {
+            *bits = 0;
+            return 0;
+        }
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+
+        /* rounding may have carried into the smallest normal */
+        *bits = mantissa;
+        return 0;
+    }
+
+    /* round ties to even; only possible when the product is exact */
+    if(product.low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1) {
+        if((mantissa << shift) == product.high)
+            mantissa &= ~(uint64_t)1;
+    }
+
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if(mantissa >= ((uint64_t)2 << DOUBLE_MANTISSA_BITS)) {
+        mantissa = (uint64_t)1 << DOUBLE_MANTISSA_BITS;
+        power2++;
+    }
+    mantissa &= ~((uint64_t)1 << DOUBLE_MANTISSA_BITS);
+
+    if(power2 >= DOUBLE_INFINITE_POWER) {
+        power2 = DOUBLE_INFINITE_POWER;
+        mantissa = 0;
+    }
+
+    *bits = mantissa | ((uint64_t)power2 << DOUBLE_MANTISSA_BITS);
+    return 0;
+}
+
+/* Fall back to the C library for the inputs the fast path cannot
+   decide. This is where the locale has to be taken into account. */
+static int strtod_slow(const char *str, size_t len, double *out)
+{
+    char stack_buffer[64];
+    char *buffer = stack_buffer;
     char *end;
+    double value;
+
+    if(len >= sizeof(stack_buffer)) {
+        buffer = jsonp_malloc(len + 1);
+        if(!buffer)
+            return -1;
+    }
+
+    memcpy(buffer, str, len);
+    buffer[len] = '\0';
 
 #if JSON_HAVE_LOCALECONV
-    to_locale(strbuffer);
+    to_locale(buffer);
 #endif
 
     errno = 0;
-    value = strtod(strbuffer->value, &end);
-    assert(end == strbuffer->value + strbuffer->length);
+    value = strtod(buffer, &end);
+    assert(end == buffer + len);
+
+    if(buffer != stack_buffer)
+        jsonp_free(buffer);
 
     if((value == HUGE_VAL || value == -HUGE_VAL) && errno == ERANGE) {
         /* Overflow */
@@ -86,6 +256,465 @@ int jsonp_strtod(strbuffer_t *strbuffer, double *out)
     return 0;
 }
 
+int jsonp_strtoint(const char *str, size_t len, json_int_t *out)
+{
+    const char *end = str + len;
+    uint64_t value = 0, limit;
+    int negative = 0;
+
+    if(str < end && *str == '-') {
+        negative = 1;
+        str++;
+    }
+
+    limit = JSON_INTEGER_MAX + negative;
+
+    for(; str < end; str++) {
+        unsigned int digit = (unsigned char)*str - '0';
+        assert(digit < 10);
+
+        if(value > (limit - digit) / 10) {
+            /* Overflow */
+            return -1;
+        }
+        value = value * 10 + digit;
+    }
+
+    if(negative && value)
+        *out = -(json_int_t)(value - 1) - 1;
+    else
+        *out = (json_int_t)value;
+    return 0;
+}
+
+int jsonp_strtod(const char *str, size_t len, double *out)
+{
+    const char *pos = str, *end = str + len;
+    uint64_t mantissa = 0, bits, bits_next;
+    int64_t exponent = 0, explicit_exponent = 0;
+    int negative = 0, digits = 0, truncated = 0;
+    double value;
+
+    if(pos < end && *pos == '-') {
+        negative = 1;
+        pos++;
+    }
+
+    /* Collect the first 19 significant digits, which always fit in
+       64 bits, and note whether anything nonzero was dropped */
+    for(; pos < end && '0' <= *pos && *pos <= '9'; pos++) {
+        unsigned int digit = *pos - '0';
+        if(digits < 19) {
+            mantissa = mantissa * 10 + digit;
+            if(mantissa)
+                digits++;
+        }
+        else {
+            exponent++;
+            truncated |= digit != 0;
+        }
+    }
+
+    if(pos < end && *pos == '.') {
+        for(pos++; pos < end && '0' <= *pos && *pos <= '9'; pos++) {
+            unsigned int digit = *pos - '0';
+            if(digits < 19) {
+                mantissa = mantissa * 10 + digit;
+                if(mantissa)
+                    digits++;
+                exponent--;
+            }
+            else
+                truncated |= digit != 0;
+        }
+    }
+
+    if(pos < end && (*pos == 'e' || *pos == 'E')) {
+        int exponent_negative = 0;
+
+        pos++;
+        if(pos < end && (*pos == '+' || *pos == '-'))
+            exponent_negative = *pos++ == '-';
+
+        for(; pos < end; pos++) {
+            /* Whether an exponent this large gives zero or infinity
+               depends on the number of digits, which may be as
+               large. Leave such rare inputs to strtod(). */
+            if(explicit_exponent >= 100000)
+                return strtod_slow(str, len, out);
+            explicit_exponent = explicit_exponent * 10 + (*pos - '0');
+        }
+
+        exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+    }
+    assert(pos == end);
+
+    if(mantissa == 0) {
+        *out = negative ? -0.0 : 0.0;
+        return 0;
+    }
+
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    /* Both operands are exact, so a single IEEE operation yields the
+       correctly rounded result */
+    if(!truncated && mantissa <= ((uint64_t)1 << 53) &&
+       -22 <= exponent && exponent <= 22)
+    {
+        value = (double)mantissa;
+        if(exponent < 0)
+            value /= exact_powers_of_ten[-exponent];
+        else
+            value *= exact_powers_of_ten[exponent];
+
+        *out = negative ? -value : value;
+        return 0;
+    }
+#endif
+
+    if(eisel_lemire(mantissa, exponent, &bits))
+        return strtod_slow(str, len, out);
+
+    /* With digits dropped, the value lies between mantissa and
+       mantissa + 1 ulp of the 19th digit. Both ends have to round to
+       the same double. */
+    if(truncated) {
+        if(eisel_lemire(mantissa + 1, exponent, &bits_next) || bits != bits_next)
+            return strtod_slow(str, len, out);
+    }
+
+    if((bits >> DOUBLE_MANTISSA_BITS) == DOUBLE_INFINITE_POWER) {
+        /* Overflow */
+        return -1;
+    }
+
+    if(negative)
+        bits |= (uint64_t)1 << 63;
+
+    memcpy(&value, &bits, sizeof(value));
+    *out = value;
+    return 0;
+}
+
+
+/*** number -> string ***/
+
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Write the decimal digits of value to the length bytes ending at end,
+   two at a time */
+static void write_digits(char *end, uint64_t value)
+{
+    while(value >= 100) {
+        unsigned int pair = (unsigned int)(value % 100) * 2;
+        value /= 100;
+        *--end = digit_pairs[pair + 1];
+        *--end = digit_pairs[pair];
+    }
+    if(value >= 10) {
+        *--end = digit_pairs[value * 2 + 1];
+        *--end = digit_pairs[value * 2];
+    }
+    else
+        *--end = (char)('0' + value);
+}
+
+static int decimal_length(uint64_t value)
+{
+    int length = 1;
+    while(value >= 10) {
+        value /= 10;
+        length++;
+    }
+    return length;
+}
+
+int jsonp_itostr(char *buffer, size_t size, json_int_t value)
+{
+    uint64_t magnitude;
+    size_t length;
+    int negative = value < 0;
+
+    magnitude = negative ? 0 - (uint64_t)value : (uint64_t)value;
+    length = negative + decimal_length(magnitude);
+    if(length >= size)
+        return -1;
+
+    if(negative)
+        buffer[0] = '-';
+    write_digits(buffer + length, magnitude);
+    buffer[length] = '\0';
+
+    return (int)length;
+}
+
+/* Ryu helpers, see "Ryu: fast float-to-string conversion" by Ulf Adams */
+
+static JSON_INLINE int pow5_bits(int e)
+{
+    return (int)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+static JSON_INLINE int log10_pow2(int e)
+{
+    return (int)(((uint32_t)e * 78913) >> 18);
+}
+
+static JSON_INLINE int log10_pow5(int e)
+{
+    return (int)(((uint32_t)e * 732923) >> 20);
+}
+
+static JSON_INLINE int pow5_factor(uint64_t value)
+{
+    int count = 0;
+    while(value % 5 == 0) {
+        value /= 5;
+        count++;
+    }
+    return count;
+}
+
+static JSON_INLINE int multiple_of_pow5(uint64_t value, int p)
+{
+    return pow5_factor(value) >= p;
+}
+
+static JSON_INLINE int multiple_of_pow2(uint64_t value, int p)
+{
+    return (value & (((uint64_t)1 << p) - 1)) == 0;
+}
+
+/* ((m * mul) >> j) where mul is a 128-bit (low, high) pair and
+   64 < j < 128 */
+static JSON_INLINE uint64_t mul_shift_64(uint64_t m, const uint64_t *mul, int j)
+{
+    uint128_parts_t b0 = mul_64x64(m, mul[0]);
+    uint128_parts_t b2 = mul_64x64(m, mul[1]);
+    uint64_t low = b0.high + b2.low;
+    uint64_t high = b2.high + (low < b0.high);
+    int shift = j - 64;
+
+    return (high << (64 - shift)) | (low >> shift);
+}
+
+/*
+  Find the shortest decimal mantissa * 10^exponent that rounds back to
+  the finite, nonzero double with the given IEEE 754 fields.
+*/
+static void shortest_decimal(uint64_t ieee_mantissa, unsigned int ieee_exponent,
+                             uint64_t *mantissa, int *exponent)
+{
+    int e2, e10, removed = 0;
+    uint64_t m2, mv, vr, vp, vm, output;
+    unsigned int mm_shift;
+    int accept_bounds, vm_trailing_zeros = 0, vr_trailing_zeros = 0;
+    unsigned int last_removed_digit = 0;
+
+    if(ieee_exponent == 0) {
+        /* 2 is subtracted to get 2 extra bits for the bounds */
+        e2 = 1 - 1023 - DOUBLE_MANTISSA_BITS - 2;
+        m2 = ieee_mantissa;
+    }
+    else {
+        e2 = (int)ieee_exponent - 1023 - DOUBLE_MANTISSA_BITS - 2;
+        m2 = ((uint64_t)1 << DOUBLE_MANTISSA_BITS) | ieee_mantissa;
+    }
+    accept_bounds = (m2 & 1) == 0;
+
+    /* The interval of valid representations is (mm, mp) around mv,
+       with mp = mv + 2 and mm = mv - 1 - mm_shift */
+    mv = 4 * m2;
+    mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+
+    if(e2 >= 0) {
+        int q = log10_pow2(e2) - (e2 > 3);
+        int k = POW5_INV_BITCOUNT + pow5_bits(q) - 1;
+        int i = -e2 + q + k;
+
+        e10 = q;
+        vr = mul_shift_64(4 * m2, pow5_inv_split[q], i);
+        vp = mul_shift_64(4 * m2 + 2, pow5_inv_split[q], i);
+        vm = mul_shift_64(4 * m2 - 1 - mm_shift, pow5_inv_split[q], i);
+
+        if(q <= 21) {
+            /* Only one of mp, mv and mm can be a multiple of 5 */
+            if(mv % 5 == 0)
+                vr_trailing_zeros = multiple_of_pow5(mv, q);
+            else if(accept_bounds)
+                vm_trailing_zeros = multiple_of_pow5(mv - 1 - mm_shift, q);
+            else
+                vp -= multiple_of_pow5(mv + 2, q);
+        }
+    }
+    else {
+        int q = log10_pow5(-e2) - (-e2 > 1);
+        int i = -e2 - q;
+        int k = pow5_bits(i) - POW5_BITCOUNT;
+        int j = q - k;
+
+        e10 = q + e2;
+        vr = mul_shift_64(4 * m2, pow5_split[i], j);
+        vp = mul_shift_64(4 * m2 + 2, pow5_split[i], j);
+        vm = mul_shift_64(4 * m2 - 1 - mm_shift, pow5_split[i], j);
+
+        if(q <= 1) {
+            /* mv = 4 * m2 always has at least two trailing zero bits */
+            vr_trailing_zeros = 1;
+            if(accept_bounds)
+                vm_trailing_zeros = mm_shift == 1;
+            else
+                vp--;
+        }
+        else if(q < 63) {
+            vr_trailing_zeros = multiple_of_pow2(mv, q);
+        }
+    }
+
+    /* Remove digits as long as the interval still contains a value
+       with fewer digits */
+    if(vm_trailing_zeros || vr_trailing_zeros) {
+        while(vp / 10 > vm / 10) {
+            vm_trailing_zeros &= vm % 10 == 0;
+            vr_trailing_zeros &= last_removed_digit == 0;
+            last_removed_digit = (unsigned int)(vr % 10);
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if(vm_trailing_zeros) {
+            while(vm % 10 == 0) {
+                vr_trailing_zeros &= last_removed_digit == 0;
+                last_removed_digit = (unsigned int)(vr % 10);
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        if(vr_trailing_zeros && last_removed_digit == 5 && vr % 2 == 0) {
+            /* exactly halfway, round to even */
+            last_removed_digit = 4;
+        }
+        output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) ||
+                       last_removed_digit >= 5);
+    }
+    else {
+        /* common case */
+        int round_up = 0;
+
+        if(vp / 100 > vm / 100) {
+            round_up = vr % 100 >= 50;
+            vr /= 100;
+            vp /= 100;
+            vm /= 100;
+            removed += 2;
+        }
+        while(vp / 10 > vm / 10) {
+            round_up = vr % 10 >= 5;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        output = vr + (vr == vm || round_up);
+    }
+
+    *mantissa = output;
+    *exponent = e10 + removed;
+}
+
+/* Shortest representation that round-trips, laid out like "%.17g" */
+static int dtostr_shortest(char *buffer, size_t size, double value)
+{
+    char digits[20];
+    char *out = buffer;
+    uint64_t bits, ieee_mantissa, mantissa;
+    unsigned int ieee_exponent;
+    int exponent, length, point, i;
+
+    memcpy(&bits, &value, sizeof(bits));
+    ieee_mantissa = bits & (((uint64_t)1 << DOUBLE_MANTISSA_BITS) - 1);
+    ieee_exponent = (unsigned int)(bits >> DOUBLE_MANTISSA_BITS) & 0x7FF;
+
+    /* longest output: "-0.0000" + 17 digits, or "-d.ddddddddddddddddde-324" */
+    if(size < 26)
+        return -1;
+
+    if(bits >> 63)
+        *out++ = '-';
+
+    if(ieee_exponent == 0 && ieee_mantissa == 0) {
+        memcpy(out, "0.0", 4);
+        return (int)(out - buffer) + 3;
+    }
+
+    shortest_decimal(ieee_mantissa, ieee_exponent, &mantissa, &exponent);
+    length = decimal_length(mantissa);
+    write_digits(digits + length, mantissa);
+
+    /* position of the decimal point relative to the first digit */
+    point = exponent + length;
+
+    if(point < -3 || point > 17) {
+        /* exponential notation */
+        *out++ = digits[0];
+        if(length > 1) {
+            *out++ = '.';
+            memcpy(out, digits + 1, length - 1);
+            out += length - 1;
+        }
+        *out++ = 'e';
+        exponent = point - 1;
+        if(exponent < 0) {
+            *out++ = '-';
+            exponent = -exponent;
+        }
+        i = decimal_length((uint64_t)exponent);
+        write_digits(out + i, (uint64_t)exponent);
+        out += i;
+    }
+    else if(point <= 0) {
+        /* 0.000ddd */
+        *out++ = '0';
+        *out++ = '.';
+        for(i = point; i < 0; i++)
+            *out++ = '0';
+        memcpy(out, digits, length);
+        out += length;
+    }
+    else if(point >= length) {
+        /* ddd000.0 */
+        memcpy(out, digits, length);
+        out += length;
+        for(i = length; i < point; i++)
+            *out++ = '0';
+        *out++ = '.';
+        *out++ = '0';
+    }
+    else {
+        /* ddd.ddd */
+        memcpy(out, digits, point);
+        out += point;
+        *out++ = '.';
+        memcpy(out, digits + point, length - point);
+        out += length - point;
+    }
+
+    *out = '\0';
+    return (int)(out - buffer);
+}
+
 int jsonp_dtostr(char *buffer, size_t size, double value, int precision)
 {
     int ret;
@@ -93,7 +722,7 @@ int jsonp_dtostr(char *buffer, size_t size, double value, int precision)
     size_t length;
 
     if (precision == 0)
-        precision = 17;
+        return dtostr_shortest(buffer, size, value);
 
     ret = snprintf(buffer, size, "%.*g", precision, value);
     if(ret < 0)
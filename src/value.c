@@ -37,10 +37,19 @@ static JSON_INLINE int isnan(double x) { return x != x; }
 static JSON_INLINE int isinf(double x) { return !isnan(x) && isnan(x - x); }
 #endif
 
-static JSON_INLINE void json_init(json_t *json, json_type type)
+/* Values in an arena are immortal until json_arena_reset() */
+static JSON_INLINE void json_init(json_t *json, json_type type, json_arena_t *arena)
 {
     json->type = type;
-    json->refcount = 1;
+    json->refcount = arena ? (size_t)-1 : 1;
+}
+
+/* A container in an arena that takes a value from outside the arena
+   keeps it until json_arena_reset() */
+static JSON_INLINE void arena_hold(json_arena_t *arena, json_t *value)
+{
+    if(arena && value->refcount != (size_t)-1)
+        jsonp_arena_hold(arena);
 }
 
 
@@ -50,7 +59,12 @@ extern volatile uint32_t hashtable_seed;
 
 json_t *json_object(void)
 {
-    json_object_t *object = jsonp_malloc(sizeof(json_object_t));
+    return json_object_in(NULL);
+}
+
+json_t *json_object_in(json_arena_t *arena)
+{
+    json_object_t *object = jsonp_arena_malloc(arena, sizeof(json_object_t));
     if(!object)
         return NULL;
 
@@ -59,21 +73,32 @@ json_t *json_object(void)
         json_object_seed(0);
     }
 
-    json_init(&object->json, JSON_OBJECT);
+    json_init(&object->json, JSON_OBJECT, arena);
+    object->lazy = NULL;
 
-    if(hashtable_init(&object->hashtable))
+    if(hashtable_init(&object->hashtable, arena))
     {
-        jsonp_free(object);
+        jsonp_arena_free(arena, object, sizeof(json_object_t));
         return NULL;
     }
 
+    if(arena && jsonp_arena_add_container(arena, &object->json))
+        return NULL;
+
     return &object->json;
 }
 
 static void json_delete_object(json_object_t *object)
 {
     hashtable_close(&object->hashtable);
-    jsonp_free(object);
+    jsonp_lazy_release(object->lazy);
+    jsonp_node_free(object, sizeof(json_object_t));
+}
+
+/* Decode the members of an object created with JSON_DECODE_LAZY */
+static JSON_INLINE int object_load(json_object_t *object)
+{
+    return object->lazy ? jsonp_lazy_load_object(object) : 0;
 }
 
 size_t json_object_size(const json_t *json)
@@ -84,6 +109,9 @@ size_t json_object_size(const json_t *json)
         return 0;
 
     object = json_to_object(json);
+    if(object_load(object))
+        return 0;
+
     return object->hashtable.size;
 }
 
@@ -95,9 +123,24 @@ json_t *json_object_get(const json_t *json, const char *key)
         return NULL;
 
     object = json_to_object(json);
+    if(object->lazy)
+        return jsonp_lazy_object_get(object, key);
+
     return hashtable_get(&object->hashtable, key);
 }
 
+/* Get a key whose hash (see hashtable_hash()) is already known */
+json_t *jsonp_object_get_hashed(const json_t *json, const char *key, size_t len,
+                                size_t hash)
+{
+    json_object_t *object = json_to_object(json);
+
+    if(object->lazy)
+        return jsonp_lazy_object_get(object, key);
+
+    return hashtable_get_hashed(&object->hashtable, key, len, hash);
+}
+
 int json_object_set_new_nocheck(json_t *json, const char *key, json_t *value)
 {
     json_object_t *object;
@@ -112,12 +155,33 @@ int json_object_set_new_nocheck(json_t *json, const char *key, json_t *value)
     }
     object = json_to_object(json);
 
-    if(hashtable_set(&object->hashtable, key, value))
+    if(object_load(object) || hashtable_set(&object->hashtable, key, value))
+    {
+        json_decref(value);
+        return -1;
+    }
+
+    arena_hold(object->hashtable.arena, value);
+    return 0;
+}
+
+/* Set a key that is known to be valid, with its length and hash */
+int jsonp_object_set_hashed(json_t *json, const char *key, size_t len,
+                            size_t hash, json_t *value)
+{
+    json_object_t *object = json_to_object(json);
+
+    if(!value)
+        return -1;
+
+    if(object_load(object) ||
+       hashtable_set_hashed(&object->hashtable, key, len, hash, value))
     {
         json_decref(value);
         return -1;
     }
 
+    arena_hold(object->hashtable.arena, value);
     return 0;
 }
 
@@ -140,9 +204,75 @@ int json_object_del(json_t *json, const char *key)
         return -1;
 
     object = json_to_object(json);
+    if(object_load(object))
+        return -1;
+
     return hashtable_del(&object->hashtable, key);
 }
 
+json_key_t json_key_make(const char *key)
+{
+    json_key_t result;
+    size_t len;
+
+    /* the hash depends on the seed, which must not change later */
+    if (!hashtable_seed)
+        json_object_seed(0);
+
+    /* a key that isn't valid UTF-8 gets a NULL key, which the
+       functions that take it refuse */
+    result.key = NULL;
+    result.len = 0;
+    result.hash = 0;
+    if(!key)
+        return result;
+
+    len = strlen(key);
+    if(!utf8_check_string(key, len))
+        return result;
+
+    result.key = key;
+    result.len = len;
+    result.hash = hashtable_hash(key, len);
+    return result;
+}
+
+json_t *json_object_get_k(const json_t *json, const json_key_t *key)
+{
+    if(!key || !key->key || !json_is_object(json))
+        return NULL;
+
+    return jsonp_object_get_hashed(json, key->key, key->len, key->hash);
+}
+
+int json_object_set_new_k(json_t *json, const json_key_t *key, json_t *value)
+{
+    if(!value)
+        return -1;
+
+    if(!key || !key->key || !json_is_object(json) || json == value)
+    {
+        json_decref(value);
+        return -1;
+    }
+
+    return jsonp_object_set_hashed(json, key->key, key->len, key->hash, value);
+}
+
+int json_object_del_k(json_t *json, const json_key_t *key)
+{
+    json_object_t *object;
+
+    if(!key || !key->key || !json_is_object(json))
+        return -1;
+
+    object = json_to_object(json);
+    if(object_load(object))
+        return -1;
+
+    return hashtable_del_hashed(&object->hashtable, key->key, key->len, key->hash);
+}
+
 int json_object_clear(json_t *json)
 {
     json_object_t *object;
@@ -153,6 +283,9 @@ int json_object_clear(json_t *json)
     object = json_to_object(json);
     hashtable_clear(&object->hashtable);
 
+    jsonp_lazy_release(object->lazy);
+    object->lazy = NULL;
+
     return 0;
 }
 
@@ -212,6 +345,9 @@ void *json_object_iter(json_t *json)
         return NULL;
 
     object = json_to_object(json);
+    if(object_load(object))
+        return NULL;
+
     return hashtable_iter(&object->hashtable);
 }
 
@@ -223,6 +359,9 @@ void *json_object_iter_at(json_t *json, const char *key)
         return NULL;
 
     object = json_to_object(json);
+    if(object_load(object))
+        return NULL;
+
     return hashtable_iter_at(&object->hashtable, key);
 }
 
@@ -262,6 +401,7 @@ int json_object_iter_set_new(json_t *json, void *iter, json_t *value)
     }
 
     hashtable_iter_set(iter, value);
+    arena_hold(json_to_object(json)->hashtable.arena, value);
     return 0;
 }
 
@@ -338,20 +478,30 @@ static json_t *json_object_deep_copy(const json_t *object)
 
 json_t *json_array(void)
 {
-    json_array_t *array = jsonp_malloc(sizeof(json_array_t));
+    return json_array_in(NULL);
+}
+
+json_t *json_array_in(json_arena_t *arena)
+{
+    json_array_t *array = jsonp_arena_malloc(arena, sizeof(json_array_t));
     if(!array)
         return NULL;
-    json_init(&array->json, JSON_ARRAY);
+    json_init(&array->json, JSON_ARRAY, arena);
 
     array->entries = 0;
     array->size = 8;
+    array->arena = arena;
+    array->lazy = NULL;
 
-    array->table = jsonp_malloc(array->size * sizeof(json_t *));
+    array->table = jsonp_arena_malloc(arena, array->size * sizeof(json_t *));
     if(!array->table) {
-        jsonp_free(array);
+        jsonp_arena_free(arena, array, sizeof(json_array_t));
         return NULL;
     }
 
+    if(arena && jsonp_arena_add_container(arena, &array->json))
+        return NULL;
+
     return &array->json;
 }
 
@@ -362,16 +512,29 @@ static void json_delete_array(json_array_t *array)
     for(i = 0; i < array->entries; i++)
         json_decref(array->table[i]);
 
-    jsonp_free(array->table);
-    jsonp_free(array);
+    jsonp_node_free(array->table, array->size * sizeof(json_t *));
+    jsonp_lazy_release(array->lazy);
+    jsonp_node_free(array, sizeof(json_array_t));
+}
+
+/* Decode the elements of an array created with JSON_DECODE_LAZY */
+static JSON_INLINE int array_load(json_array_t *array)
+{
+    return array->lazy ? jsonp_lazy_load_array(array) : 0;
 }
 
 size_t json_array_size(const json_t *json)
 {
+    json_array_t *array;
+
     if(!json_is_array(json))
         return 0;
+    array = json_to_array(json);
+
+    if(array_load(array))
+        return 0;
 
-    return json_to_array(json)->entries;
+    return array->entries;
 }
 
 json_t *json_array_get(const json_t *json, size_t index)
@@ -381,7 +544,7 @@ json_t *json_array_get(const json_t *json, size_t index)
         return NULL;
     array = json_to_array(json);
 
-    if(index >= array->entries)
+    if(array_load(array) || index >= array->entries)
         return NULL;
 
     return array->table[index];
@@ -401,7 +564,7 @@ int json_array_set_new(json_t *json, size_t index, json_t *value)
     }
     array = json_to_array(json);
 
-    if(index >= array->entries)
+    if(array_load(array) || index >= array->entries)
     {
         json_decref(value);
         return -1;
@@ -409,6 +572,7 @@ int json_array_set_new(json_t *json, size_t index, json_t *value)
 
     json_decref(array->table[index]);
     array->table[index] = value;
+    arena_hold(array->arena, value);
 
     return 0;
 }
@@ -426,33 +590,24 @@ static void array_copy(json_t **dest, size_t dpos,
     memcpy(&dest[dpos], &src[spos], count * sizeof(json_t *));
 }
 
-static json_t **json_array_grow(json_array_t *array,
-                                size_t amount,
-                                int copy)
+static json_t **json_array_grow(json_array_t *array, size_t amount)
 {
     size_t new_size;
-    json_t **old_table, **new_table;
+    json_t **new_table;
 
     if(array->entries + amount <= array->size)
         return array->table;
 
-    old_table = array->table;
-
     new_size = max(array->size + amount, array->size * 2);
-    new_table = jsonp_malloc(new_size * sizeof(json_t *));
+    new_table = jsonp_arena_realloc(array->arena, array->table,
+                                    array->size * sizeof(json_t *),
+                                    new_size * sizeof(json_t *));
     if(!new_table)
         return NULL;
 
     array->size = new_size;
     array->table = new_table;
-
-    if(copy) {
-        array_copy(array->table, 0, old_table, 0, array->entries);
-        jsonp_free(old_table);
-        return array->table;
-    }
-
-    return old_table;
+    return new_table;
 }
 
 int json_array_append_new(json_t *json, json_t *value)
@@ -469,13 +624,14 @@ int json_array_append_new(json_t *json, json_t *value)
     }
     array = json_to_array(json);
 
-    if(!json_array_grow(array, 1, 1)) {
+    if(array_load(array) || !json_array_grow(array, 1)) {
         json_decref(value);
         return -1;
     }
 
     array->table[array->entries] = value;
     array->entries++;
+    arena_hold(array->arena, value);
 
     return 0;
 }
@@ -483,7 +639,6 @@ int json_array_append_new(json_t *json, json_t *value)
 int json_array_insert_new(json_t *json, size_t index, json_t *value)
 {
     json_array_t *array;
-    json_t **old_table;
 
     if(!value)
         return -1;
@@ -494,28 +649,21 @@ int json_array_insert_new(json_t *json, size_t index, json_t *value)
     }
     array = json_to_array(json);
 
-    if(index > array->entries) {
+    if(array_load(array) || index > array->entries) {
         json_decref(value);
         return -1;
     }
 
-    old_table = json_array_grow(array, 1, 0);
-    if(!old_table) {
+    if(!json_array_grow(array, 1)) {
         json_decref(value);
         return -1;
     }
 
-    if(old_table != array->table) {
-        array_copy(array->table, 0, old_table, 0, index);
-        array_copy(array->table, index + 1, old_table, index,
-                   array->entries - index);
-        jsonp_free(old_table);
-    }
-    else
-        array_move(array, index + 1, index, array->entries - index);
+    array_move(array, index + 1, index, array->entries - index);
 
     array->table[index] = value;
     array->entries++;
+    arena_hold(array->arena, value);
 
     return 0;
 }
@@ -528,7 +676,7 @@ int json_array_remove(json_t *json, size_t index)
         return -1;
     array = json_to_array(json);
 
-    if(index >= array->entries)
+    if(array_load(array) || index >= array->entries)
         return -1;
 
     json_decref(array->table[index]);
@@ -555,6 +703,9 @@ int json_array_clear(json_t *json)
         json_decref(array->table[i]);
 
     array->entries = 0;
+
+    jsonp_lazy_release(array->lazy);
+    array->lazy = NULL;
     return 0;
 }
 
@@ -568,11 +719,14 @@ int json_array_extend(json_t *json, json_t *other_json)
     array = json_to_array(json);
     other = json_to_array(other_json);
 
-    if(!json_array_grow(array, other->entries, 1))
+    if(array_load(array) || array_load(other) ||
+       !json_array_grow(array, other->entries))
         return -1;
 
-    for(i = 0; i < other->entries; i++)
+    for(i = 0; i < other->entries; i++) {
         json_incref(other->table[i]);
+        arena_hold(array->arena, other->table[i]);
+    }
 
     array_copy(array->table, array->entries, other->table, 0, other->entries);
 
@@ -634,32 +788,83 @@ static json_t *json_array_deep_copy(const json_t *array)
 
 /*** string ***/
 
-static json_t *string_create(const char *value, size_t len, int own)
+static json_string_t *string_alloc(json_arena_t *arena, size_t len)
 {
-    char *v;
     json_string_t *string;
+    size_t size = len < JSON_STRING_INLINE ? JSON_STRING_INLINE : len + 1;
 
-    if(!value)
+    if(len >= (size_t)-1 - offsetof(json_string_t, data) - 1)
         return NULL;
 
-    if(own)
-        v = (char *)value;
+    string = jsonp_arena_malloc(arena, offsetof(json_string_t, data) + size);
+    if(!string)
+        return NULL;
+
+    json_init(&string->json, JSON_STRING, arena);
+    string->value = string->data;
+    string->length = len;
+    return string;
+}
+
+/* The allocated size of a string: as given by string_alloc() while the
+   value is in data, and kept at the start of data once it isn't */
+static size_t string_size(const json_string_t *string)
+{
+    size_t size;
+
+    if(string->value == string->data) {
+        size = string->length < JSON_STRING_INLINE ? JSON_STRING_INLINE
+                                                   : string->length + 1;
+        return offsetof(json_string_t, data) + size;
+    }
+
+    memcpy(&size, string->data, sizeof(size_t));
+    return size;
+}
+
+/* Point the string at a separate buffer */
+static void string_move_out(json_string_t *string, char *value, size_t len)
+{
+    if(string->value != string->data)
+        jsonp_free(string->value);
     else {
-        v = jsonp_strndup(value, len);
-        if(!v)
-            return NULL;
+        size_t size = string_size(string);
+        memcpy(string->data, &size, sizeof(size_t));
     }
 
-    string = jsonp_malloc(sizeof(json_string_t));
-    if(!string) {
-        jsonp_free(v);
+    string->value = value;
+    string->length = len;
+}
+
+static json_t *string_create(json_arena_t *arena, const char *value,
+                             size_t len, int own)
+{
+    json_string_t *string;
+
+    if(!value)
         return NULL;
+
+    /* adopted buffers are kept unless they are short */
+    if(own && len >= JSON_STRING_INLINE) {
+        string = string_alloc(NULL, 0);
+        if(!string) {
+            jsonp_free((char *)value);
+            return NULL;
+        }
+        string_move_out(string, (char *)value, len);
+        return &string->json;
     }
-    json_init(&string->json, JSON_STRING);
-    string->value = v;
-    string->length = len;
 
-    return &string->json;
+    string = string_alloc(arena, len);
+    if(string) {
+        memcpy(string->data, value, len);
+        string->data[len] = '\0';
+    }
+
+    if(own)
+        jsonp_free((char *)value);
+
+    return string ? &string->json : NULL;
 }
 
 json_t *json_string_nocheck(const char *value)
@@ -667,18 +872,23 @@ json_t *json_string_nocheck(const char *value)
     if(!value)
         return NULL;
 
-    return string_create(value, strlen(value), 0);
+    return string_create(NULL, value, strlen(value), 0);
 }
 
 json_t *json_stringn_nocheck(const char *value, size_t len)
 {
-    return string_create(value, len, 0);
+    return string_create(NULL, value, len, 0);
 }
 
 /* this is private; "steal" is not a public API concept */
 json_t *jsonp_stringn_nocheck_own(const char *value, size_t len)
 {
-    return string_create(value, len, 1);
+    return string_create(NULL, value, len, 1);
+}
+
+json_t *jsonp_stringn_nocheck_in(json_arena_t *arena, const char *value, size_t len)
+{
+    return string_create(arena, value, len, 0);
 }
 
 json_t *json_string(const char *value)
@@ -697,6 +907,22 @@ json_t *json_stringn(const char *value, size_t len)
     return json_stringn_nocheck(value, len);
 }
 
+json_t *json_string_in(json_arena_t *arena, const char *value)
+{
+    if(!value)
+        return NULL;
+
+    return json_stringn_in(arena, value, strlen(value));
+}
+
+json_t *json_stringn_in(json_arena_t *arena, const char *value, size_t len)
+{
+    if(!value || !utf8_check_string(value, len))
+        return NULL;
+
+    return string_create(arena, value, len, 0);
+}
+
 const char *json_string_value(const json_t *json)
 {
     if(!json_is_string(json))
@@ -726,18 +952,28 @@ int json_string_setn_nocheck(json_t *json, const char *value, size_t len)
     char *dup;
     json_string_t *string;
 
-    if(!json_is_string(json) || !value)
+    /* strings in an arena can't be changed */
+    if(!json_is_string(json) || json->refcount == (size_t)-1 || !value)
         return -1;
 
+    string = json_to_string(json);
+
+    /* value may point into the string itself. A longer string in data
+       moves out, as the size of data must follow from the length. */
+    if(string->value == string->data && string->length < JSON_STRING_INLINE &&
+       len < JSON_STRING_INLINE)
+    {
+        memmove(string->data, value, len);
+        string->data[len] = '\0';
+        string->length = len;
+        return 0;
+    }
+
     dup = jsonp_strndup(value, len);
     if(!dup)
         return -1;
 
-    string = json_to_string(json);
-    jsonp_free(string->value);
-    string->value = dup;
-    string->length = len;
-
+    string_move_out(string, dup, len);
     return 0;
 }
 
@@ -759,8 +995,11 @@ int json_string_setn(json_t *json, const char *value, size_t len)
 
 static void json_delete_string(json_string_t *string)
 {
-    jsonp_free(string->value);
-    jsonp_free(string);
+    size_t size = string_size(string);
+
+    if(string->value != string->data)
+        jsonp_free(string->value);
+    jsonp_node_free(string, size);
 }
 
 static int json_string_equal(const json_t *string1, const json_t *string2)
@@ -826,15 +1065,89 @@ json_t *json_sprintf(const char *fmt, ...) {
 
 json_t *json_integer(json_int_t value)
 {
-    json_integer_t *integer = jsonp_malloc(sizeof(json_integer_t));
+    return json_integer_in(NULL, value);
+}
+
+json_t *json_integer_in(json_arena_t *arena, json_int_t value)
+{
+    json_integer_t *integer = jsonp_arena_malloc(arena, sizeof(json_integer_t));
     if(!integer)
         return NULL;
-    json_init(&integer->json, JSON_INTEGER);
+    json_init(&integer->json, JSON_INTEGER, arena);
 
     integer->value = value;
     return &integer->json;
 }
 
+#if JSON_SMALL_INTEGER_MAX >= JSON_SMALL_INTEGER_MIN && \
+    (JSON_HAVE_ATOMIC_BUILTINS || JSON_HAVE_SYNC_BUILTINS)
+
+#define SMALL_INTEGER_COUNT (JSON_SMALL_INTEGER_MAX - JSON_SMALL_INTEGER_MIN + 1)
+
+/* Immortal like json_true(): the refcount of every entry is (size_t)-1 */
+static json_integer_t small_integers[SMALL_INTEGER_COUNT];
+
+/* 0 = not filled, 1 = being filled, 2 = ready */
+static volatile int small_integers_state;
+
+/* The first thread to get here fills the table. Others allocate their
+   integers as usual until it is ready. */
+static int small_integers_ready(void)
+{
+    int i;
+
+#if JSON_HAVE_ATOMIC_BUILTINS
+    int expected = 0;
+
+    if(__atomic_load_n(&small_integers_state, __ATOMIC_ACQUIRE) == 2)
+        return 1;
+    if(!__atomic_compare_exchange_n(&small_integers_state, &expected, 1, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return 0;
+#else
+    if(small_integers_state == 2) {
+        __sync_synchronize();
+        return 1;
+    }
+    if(!__sync_bool_compare_and_swap(&small_integers_state, 0, 1))
+        return 0;
+#endif
+
+    for(i = 0; i < SMALL_INTEGER_COUNT; i++) {
+        small_integers[i].json.type = JSON_INTEGER;
+        small_integers[i].json.refcount = (size_t)-1;
+        small_integers[i].value = JSON_SMALL_INTEGER_MIN + i;
+    }
+
+#if JSON_HAVE_ATOMIC_BUILTINS
+    __atomic_store_n(&small_integers_state, 2, __ATOMIC_RELEASE);
+#else
+    __sync_synchronize();
+    small_integers_state = 2;
+#endif
+    return 1;
+}
+
+json_t *jsonp_integer_shared(json_arena_t *arena, json_int_t value, size_t flags)
+{
+    if((flags & JSON_SHARE_INTEGERS) &&
+       value >= JSON_SMALL_INTEGER_MIN && value <= JSON_SMALL_INTEGER_MAX &&
+       small_integers_ready())
+        return &small_integers[value - JSON_SMALL_INTEGER_MIN].json;
+
+    return json_integer_in(arena, value);
+}
+
+#else
+
+json_t *jsonp_integer_shared(json_arena_t *arena, json_int_t value, size_t flags)
+{
+    (void)flags;
+    return json_integer_in(arena, value);
+}
+
+#endif
+
 json_int_t json_integer_value(const json_t *json)
 {
     if(!json_is_integer(json))
@@ -845,7 +1158,8 @@ json_int_t json_integer_value(const json_t *json)
 
 int json_integer_set(json_t *json, json_int_t value)
 {
-    if(!json_is_integer(json))
+    /* shared and arena integers can't be changed */
+    if(!json_is_integer(json) || json->refcount == (size_t)-1)
         return -1;
 
     json_to_integer(json)->value = value;
@@ -855,7 +1169,7 @@ int json_integer_set(json_t *json, json_int_t value)
 
 static void json_delete_integer(json_integer_t *integer)
 {
-    jsonp_free(integer);
+    jsonp_node_free(integer, sizeof(json_integer_t));
 }
 
 static int json_integer_equal(const json_t *integer1, const json_t *integer2)
@@ -872,16 +1186,21 @@ static json_t *json_integer_copy(const json_t *integer)
 /*** real ***/
 
 json_t *json_real(double value)
+{
+    return json_real_in(NULL, value);
+}
+
+json_t *json_real_in(json_arena_t *arena, double value)
 {
     json_real_t *real;
 
     if(isnan(value) || isinf(value))
         return NULL;
 
-    real = jsonp_malloc(sizeof(json_real_t));
+    real = jsonp_arena_malloc(arena, sizeof(json_real_t));
     if(!real)
         return NULL;
-    json_init(&real->json, JSON_REAL);
+    json_init(&real->json, JSON_REAL, arena);
 
     real->value = value;
     return &real->json;
@@ -897,7 +1216,8 @@ double json_real_value(const json_t *json)
 
 int json_real_set(json_t *json, double value)
 {
-    if(!json_is_real(json) || isnan(value) || isinf(value))
+    if(!json_is_real(json) || json->refcount == (size_t)-1 ||
+       isnan(value) || isinf(value))
         return -1;
 
     json_to_real(json)->value = value;
@@ -907,7 +1227,7 @@ int json_real_set(json_t *json, double value)
 
 static void json_delete_real(json_real_t *real)
 {
-    jsonp_free(real);
+    jsonp_node_free(real, sizeof(json_real_t));
 }
 
 static int json_real_equal(const json_t *real1, const json_t *real2)
@@ -937,16 +1257,54 @@ double json_number_value(const json_t *json)
 
 json_t *json_bytes(void *value, size_t size)
 {
-    json_bytes_t *bytes = jsonp_malloc(sizeof(json_bytes_t));
+    json_bytes_t *bytes = jsonp_node_malloc(sizeof(json_bytes_t));
     if(!bytes)
         return NULL;
-    json_init(&bytes->json, JSON_BYTES);
+    json_init(&bytes->json, JSON_BYTES, NULL);
 
     bytes->value = value;
     bytes->size = size;
     return &bytes->json;
 }
 
+/* The node and a copy of the bytes, together when in an arena */
+json_t *jsonp_bytes_in(json_arena_t *arena, const void *value, size_t size)
+{
+    json_bytes_t *bytes;
+    void *copy;
+
+    if(!arena) {
+        json_t *json;
+
+        copy = jsonp_malloc(size);
+        if(size && !copy)
+            return NULL;
+        if(size)
+            memcpy(copy, value, size);
+
+        json = json_bytes(copy, size);
+        if(!json)
+            jsonp_free(copy);
+        return json;
+    }
+
+    if(size > (size_t)-1 - sizeof(json_bytes_t))
+        return NULL;
+
+    bytes = jsonp_arena_malloc(arena, sizeof(json_bytes_t) + size);
+    if(!bytes)
+        return NULL;
+    json_init(&bytes->json, JSON_BYTES, arena);
+
+    bytes->value = NULL;
+    bytes->size = size;
+    if(size) {
+        bytes->value = (char *)bytes + sizeof(json_bytes_t);
+        memcpy(bytes->value, value, size);
+    }
+    return &bytes->json;
+}
+
 const void *json_bytes_value(const json_t *json)
 {
     if(!json_is_bytes(json))
@@ -965,7 +1323,7 @@ size_t json_bytes_size(const json_t *json)
 
 int json_bytes_set(json_t *json, void *value, size_t size)
 {
-    if(!json_is_bytes(json))
+    if(!json_is_bytes(json) || json->refcount == (size_t)-1)
         return -1;
 
     json_to_bytes(json)->value = value;
@@ -977,7 +1335,7 @@ int json_bytes_set(json_t *json, void *value, size_t size)
 static void json_delete_bytes(json_bytes_t *bytes)
 {
     jsonp_free(bytes->value);
-    jsonp_free(bytes);
+    jsonp_node_free(bytes, sizeof(json_bytes_t));
 }
 
 static int json_bytes_equal(const json_t *bytes1, const json_t *bytes2)
@@ -0,0 +1,138 @@
+/*
+ * wyhash, by Wang Yi <godspeed_china@yeah.net>, released into the
+ * public domain (The Unlicense). This is the final version 4 of the
+ * algorithm, reduced to what the hashtable needs.
+ *
+ * Words are read in the machine's byte order. The hashes are only
+ * used in memory, so they needn't be the same on every platform.
+ */
+
+#ifndef WYHASH_H
+#define WYHASH_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include <jansson_private_config.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#pragma intrinsic(_umul128)
+#endif
+
+static const uint64_t wyhash_secret[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+/* The 128-bit product of *a and *b, low half in *a, high half in *b */
+static JSON_INLINE void wyhash_mum(uint64_t *a, uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+    __extension__ unsigned __int128 r = *a;
+    r *= *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    *a = _umul128(*a, *b, b);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32;
+    uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static JSON_INLINE uint64_t wyhash_mix(uint64_t a, uint64_t b)
+{
+    wyhash_mum(&a, &b);
+    return a ^ b;
+}
+
+static JSON_INLINE uint64_t wyhash_r8(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static JSON_INLINE uint64_t wyhash_r4(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+/* 1 to 3 bytes */
+static JSON_INLINE uint64_t wyhash_r3(const uint8_t *p, size_t k)
+{
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+static JSON_INLINE uint64_t wyhash(const void *key, size_t len, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    uint64_t a, b;
+
+    seed ^= wyhash_mix(seed ^ wyhash_secret[0], wyhash_secret[1]);
+
+    if(len <= 16) {
+        if(len >= 4) {
+            a = (wyhash_r4(p) << 32) | wyhash_r4(p + ((len >> 3) << 2));
+            b = (wyhash_r4(p + len - 4) << 32) |
+                wyhash_r4(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if(len > 0) {
+            a = wyhash_r3(p, len);
+            b = 0;
+        }
+        else
+            a = b = 0;
+    }
+    else {
+        size_t i = len;
+
+        if(i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wyhash_mix(wyhash_r8(p) ^ wyhash_secret[1],
+                                  wyhash_r8(p + 8) ^ seed);
+                see1 = wyhash_mix(wyhash_r8(p + 16) ^ wyhash_secret[2],
+                                  wyhash_r8(p + 24) ^ see1);
+                see2 = wyhash_mix(wyhash_r8(p + 32) ^ wyhash_secret[3],
+                                  wyhash_r8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while(i > 48);
+            seed ^= see1 ^ see2;
+        }
+
+        while(i > 16) {
+            seed = wyhash_mix(wyhash_r8(p) ^ wyhash_secret[1],
+                              wyhash_r8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+
+        a = wyhash_r8(p + i - 16);
+        b = wyhash_r8(p + i - 8);
+    }
+
+    a ^= wyhash_secret[1];
+    b ^= seed;
+    wyhash_mum(&a, &b);
+    return wyhash_mix(a ^ wyhash_secret[0] ^ len, b ^ wyhash_secret[1]);
+}
+
+#endif
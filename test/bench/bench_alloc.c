@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* Builds and frees many small trees on many threads. Half of the
+   trees are freed by the thread that built them and half by another
+   thread. Compare builds with and without USE_POOL_ALLOC.
+
+   Usage: bench_alloc [threads [rounds]] */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <bosjansson.h>
+
+#define BATCH 1000
+
+typedef struct {
+    int id;
+    int rounds;
+    json_t **own;        /* trees built by this thread */
+    json_t **handed;     /* trees to free for another thread */
+} worker_t;
+
+static int threads = 8;
+static worker_t *workers;
+static pthread_barrier_t barrier;
+
+static json_t *build_tree(int seed)
+{
+    json_t *tree = json_object();
+    json_t *items = json_array();
+    char key[16];
+    int i;
+
+    for(i = 0; i < 8; i++) {
+        json_t *item = json_object();
+        json_object_set_new(item, "id", json_integer(seed * 8 + i));
+        json_object_set_new(item, "price", json_real(i + 0.25));
+        json_object_set_new(item, "name", json_string("item"));
+        json_object_set_new(item, "tags", json_pack("[ss]", "a", "b"));
+        json_array_append_new(items, item);
+    }
+
+    for(i = 0; i < 4; i++) {
+        sprintf(key, "field%d", i);
+        json_object_set_new(tree, key, json_integer(i));
+    }
+    json_object_set_new(tree, "items", items);
+    return tree;
+}
+
+static void *run_worker(void *data)
+{
+    worker_t *self = data;
+    worker_t *next = &workers[(self->id + 1) % threads];
+    int round, i;
+
+    for(round = 0; round < self->rounds; round++) {
+        for(i = 0; i < BATCH; i++)
+            self->own[i] = build_tree(i);
+
+        /* free the first half here, the second half in the next thread */
+        for(i = 0; i < BATCH / 2; i++)
+            json_decref(self->own[i]);
+        for(i = BATCH / 2; i < BATCH; i++)
+            next->handed[i] = self->own[i];
+
+        pthread_barrier_wait(&barrier);
+        for(i = BATCH / 2; i < BATCH; i++)
+            json_decref(self->handed[i]);
+        pthread_barrier_wait(&barrier);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t *ids;
+    struct timeval start, end;
+    int rounds = 100;
+    int i;
+
+    if(argc > 1)
+        threads = atoi(argv[1]);
+    if(argc > 2)
+        rounds = atoi(argv[2]);
+    if(threads < 1 || rounds < 1) {
+        fprintf(stderr, "usage: %s [threads [rounds]]\n", argv[0]);
+        return 2;
+    }
+
+    workers = calloc(threads, sizeof(worker_t));
+    ids = calloc(threads, sizeof(pthread_t));
+    pthread_barrier_init(&barrier, NULL, threads);
+
+    for(i = 0; i < threads; i++) {
+        workers[i].id = i;
+        workers[i].rounds = rounds;
+        workers[i].own = calloc(BATCH, sizeof(json_t *));
+        workers[i].handed = calloc(BATCH, sizeof(json_t *));
+    }
+
+    gettimeofday(&start, NULL);
+    for(i = 0; i < threads; i++)
+        pthread_create(&ids[i], NULL, run_worker, &workers[i]);
+    for(i = 0; i < threads; i++)
+        pthread_join(ids[i], NULL);
+    gettimeofday(&end, NULL);
+
+    printf("%d threads, %d trees: %.1f ms\n", threads, threads * rounds * BATCH,
+           (end.tv_sec - start.tv_sec) * 1000.0 +
+           (end.tv_usec - start.tv_usec) / 1000.0);
+
+    for(i = 0; i < threads; i++) {
+        free(workers[i].own);
+        free(workers[i].handed);
+    }
+    pthread_barrier_destroy(&barrier);
+    free(workers);
+    free(ids);
+    return 0;
+}
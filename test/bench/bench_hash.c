@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+/* Compares the hash functions that can be chosen with JANSSON_HASH
+   on sets of object keys. Like the hashtable, every hash includes the
+   strlen() of the key. The spread of the hashes is checked by
+   counting how many keys share a slot of a table with as many slots
+   as keys; about KEYS / e, or 1507, are expected.
+
+   Usage: bench_hash [rounds] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <bosjansson.h>
+
+#ifndef HAVE_STDINT_H
+#define HAVE_STDINT_H 1
+#endif
+#include "lookup3.h"
+#include "siphash.h"
+#include "wyhash.h"
+
+#define KEYS 4096
+#define SEED 0x12345678
+
+typedef struct {
+    const char *name;
+    char **keys;
+} key_set_t;
+
+typedef struct {
+    const char *name;
+    size_t (*hash)(const char *key);
+} hash_t;
+
+static size_t hash_lookup3(const char *key)
+{
+    return (size_t)hashlittle(key, strlen(key), SEED);
+}
+
+static size_t hash_wyhash(const char *key)
+{
+    return (size_t)wyhash(key, strlen(key), SEED);
+}
+
+static size_t hash_siphash(const char *key)
+{
+    return (size_t)siphash(key, strlen(key), SEED, ~(uint64_t)SEED);
+}
+
+static const hash_t hashes[] = {
+    {"lookup3", hash_lookup3},
+    {"wyhash", hash_wyhash},
+    {"siphash", hash_siphash},
+};
+
+/* keys of web APIs and JSON-RPC */
+static const char *field_names[] = {
+    "id", "jsonrpc", "method", "params", "result", "error", "code",
+    "message", "data", "name", "type", "value", "status", "created_at",
+    "updated_at", "user_id", "email", "items", "count", "total", "page",
+    "per_page", "next", "url", "title", "description", "tags", "price",
+    "currency", "timestamp", "enabled", "version",
+};
+
+static char **make_keys(const char *format, int field_names_only)
+{
+    char **keys = malloc(KEYS * sizeof(char *));
+    char buf[128];
+    int i;
+
+    for(i = 0; i < KEYS; i++) {
+        if(field_names_only)
+            sprintf(buf, "%s", field_names[i % (sizeof(field_names) / sizeof(field_names[0]))]);
+        else
+            sprintf(buf, format, i, i * 2654435761u, i ^ 0x5bd1e995);
+        keys[i] = strdup(buf);
+    }
+    return keys;
+}
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+/* the number of keys that don't get a slot of their own */
+static int collisions(const hash_t *hash, char **keys)
+{
+    static unsigned char slots[KEYS];
+    int i, result = 0;
+
+    memset(slots, 0, sizeof(slots));
+    for(i = 0; i < KEYS; i++) {
+        size_t slot = hash->hash(keys[i]) & (KEYS - 1);
+        if(slots[slot]++)
+            result++;
+    }
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    key_set_t sets[4];
+    int rounds = 2000;
+    size_t i, j;
+    int round, k;
+
+    if(argc > 1)
+        rounds = atoi(argv[1]);
+
+    sets[0].name = "field names";
+    sets[0].keys = make_keys(NULL, 1);
+    sets[1].name = "user_<n>";
+    sets[1].keys = make_keys("user_%d", 0);
+    sets[2].name = "uuid";
+    sets[2].keys = make_keys("%08x-4e5f-4a1b-9c2d-%04x%08x", 0);
+    sets[3].name = "64-byte path";
+    sets[3].keys = make_keys("/api/v2/accounts/%010d/transactions/%010u/items/%010d/x", 0);
+
+    printf("%-14s %-8s %10s %11s\n", "keys", "hash", "ns/key", "collisions");
+    for(i = 0; i < sizeof(sets) / sizeof(sets[0]); i++) {
+        for(j = 0; j < sizeof(hashes) / sizeof(hashes[0]); j++) {
+            const hash_t *hash = &hashes[j];
+            volatile size_t sink = 0;
+            double start, end;
+
+            start = now();
+            for(round = 0; round < rounds; round++) {
+                for(k = 0; k < KEYS; k++)
+                    sink += hash->hash(sets[i].keys[k]);
+            }
+            end = now();
+
+            printf("%-14s %-8s %10.2f ", sets[i].name, hash->name,
+                   (end - start) * 1e6 / ((double)rounds * KEYS));
+
+            /* the field names repeat */
+            if(i == 0)
+                printf("%11s\n", "-");
+            else
+                printf("%11d\n", collisions(hash, sets[i].keys));
+        }
+    }
+
+    for(i = 0; i < sizeof(sets) / sizeof(sets[0]); i++) {
+        for(k = 0; k < KEYS; k++)
+            free(sets[i].keys[k]);
+        free(sets[i].keys);
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef DECODE_INPUTS_H
+#define DECODE_INPUTS_H
+
+#include <string.h>
+#include "util.h"
+
+/* Valid and invalid documents on which every decoder must give
+   exactly the same result as json_loadb() */
+static const char *decode_inputs[] = {
+    "[]",
+    "{}",
+    " [1, -2, 3.5, -0.25e-3, 1E+2, true, false, null] ",
+    "{\"a\": {\"b\": [\"c\", {\"d\": \"e\"}]}, \"f\": \"\", \"g\": [[], {}]}",
+    "[\"escapes \\\" \\\\ \\/ \\b \\f \\n \\r \\t \\u00e9 \\uD834\\uDD1E\"]",
+    "[\"caf\xc3\xa9 \xf0\x9d\x84\x9e\"]",
+    "{\"k\\u00e9y\": 1, \"k\\\"\": [\"]\", \"}\"], \"\\\\\": {\"[\": \"{\"}}",
+    "[\"a string that is long enough to cross a block boundary of the index\"]",
+    "[\"backslashes at a block boundary                         \\\\\\\\\\\"\"]",
+    "[\"                                                           \\\\\", 1]",
+    "[\"                                                            \\\"\", 1]",
+    "{\"brackets\": \"[{]}:,\", \"x\": [\"\\\"]\"]}",
+    "42",
+    "\"string\"",
+    "-0",
+    "true",
+    "null",
+    "[1] [2]",
+    "{\"a\": 1, \"a\": 2}",
+    "{\"a\": 1, \"b\": 2, \"a\": 3}",
+    "{\"a\\u0000b\": 1}",
+    "[\"\\u0000\"]",
+    "[9223372036854775808]",
+    "[1e400]",
+    "[01]",
+    "[1.]",
+    "[1e+]",
+    "[-]",
+    "[1-2]",
+    "[tru]",
+    "[truex]",
+    "[true\"x\"]",
+    "[1,]",
+    "[1 2]",
+    "[,1]",
+    "{\"a\" 1}",
+    "{\"a\": 1,}",
+    "{1: 2}",
+    "{\"a\"}",
+    "[\"unterminated",
+    "[\"unterminated\\\"]",
+    "[\"bad \\x escape\"]",
+    "[\"bad \\u12G4 escape\"]",
+    "[\"\\uD834\"]",
+    "[\"\\uDD1E\"]",
+    "[\"new\nline\"]",
+    "[\"invalid \xc3 utf-8\"]",
+    "[\xe9]",
+    "[\\\"a\"]",
+    "[1",
+    "{\"a\":",
+    "",
+    "  ",
+    "]",
+};
+
+static const size_t decode_flags[] = {
+    0,
+    JSON_DECODE_ANY,
+    JSON_DECODE_ANY | JSON_DISABLE_EOF_CHECK,
+    JSON_DECODE_ANY | JSON_DECODE_INT_AS_REAL,
+    JSON_DECODE_ANY | JSON_REJECT_DUPLICATES,
+    JSON_DECODE_ANY | JSON_ALLOW_NUL,
+};
+
+typedef json_t *(*decode_func)(const char *input, size_t len, size_t flags,
+                               json_error_t *error);
+
+/* Decode the input and check that the value, or the error, is exactly
+   what json_loadb() gives */
+static void check_decoded(decode_func decode, const char *input, size_t len,
+                          size_t flags)
+{
+    json_error_t expected_error, error;
+    json_t *expected, *value;
+
+    expected = json_loadb(input, len, flags, &expected_error);
+    value = decode(input, len, flags, &error);
+
+    if(!expected != !value)
+        fail_input("the decoder and json_loadb disagree", input);
+
+    if(expected) {
+        char *s1, *s2;
+
+        if(!json_equal(expected, value))
+            fail_input("the decoder returned a wrong value", input);
+        if(error.position != expected_error.position)
+            fail_input("the decoder returned a wrong position", input);
+
+        /* Compare the dumps to check the order of the keys */
+        s1 = json_dumps(expected, JSON_ENCODE_ANY);
+        s2 = json_dumps(value, JSON_ENCODE_ANY);
+        if(strcmp(s1, s2))
+            fail_input("the decoder returned the keys in a wrong order", input);
+        free(s1);
+        free(s2);
+    }
+    else {
+        if(strcmp(error.text, expected_error.text) ||
+           error.line != expected_error.line ||
+           error.column != expected_error.column ||
+           error.position != expected_error.position ||
+           json_error_code(&error) != json_error_code(&expected_error))
+            fail_input("the decoder returned a wrong error", input);
+    }
+
+    json_decref(expected);
+    json_decref(value);
+}
+
+/* Check the decoder on every input with every set of flags */
+static void check_decode_inputs(decode_func decode)
+{
+    size_t i, j;
+
+    for(i = 0; i < sizeof(decode_inputs) / sizeof(decode_inputs[0]); i++) {
+        for(j = 0; j < sizeof(decode_flags) / sizeof(decode_flags[0]); j++)
+            check_decoded(decode, decode_inputs[i], strlen(decode_inputs[i]),
+                          decode_flags[j]);
+    }
+}
+
+#endif
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <bosjansson.h>
+#include <string.h>
+#include "util.h"
+
+static const char *inputs[] = {
+    "[]",
+    "{}",
+    " [1, -2, 3.5, -0.25e-3, 1E+2, 100000, true, false, null] ",
+    "{\"a\": {\"b\": [\"c\", {\"d\": \"e\"}]}, \"f\": \"\", \"g\": [[], {}]}",
+    "[\"escapes \\\" \\\\ \\/ \\b \\f \\n \\r \\t \\u00e9 \\uD834\\uDD1E\"]",
+    "[\"a string that is too long to be stored inline\"]",
+    "{\"a\": 1, \"b\": 2, \"a\": 3}",
+    "42",
+    "\"string\"",
+    "[\"\\u0000\"]",
+    "[9223372036854775808]",
+    "[1] [2]",
+    "[1,]",
+    "",
+};
+
+static const size_t flag_sets[] = {
+    0,
+    JSON_DECODE_ANY,
+    JSON_DECODE_ANY | JSON_DISABLE_EOF_CHECK,
+    JSON_DECODE_ANY | JSON_DECODE_INT_AS_REAL,
+    JSON_DECODE_ANY | JSON_REJECT_DUPLICATES,
+    JSON_DECODE_ANY | JSON_ALLOW_NUL,
+    JSON_DECODE_ANY | JSON_FAST_PARSE,
+    JSON_DECODE_ANY | JSON_DECODE_LAZY,
+};
+
+static void compare_with_heap()
+{
+    json_arena_t *arena = json_arena_create(0);
+    size_t i, j;
+
+    if(!arena)
+        fail("json_arena_create failed");
+
+    for(i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        for(j = 0; j < sizeof(flag_sets) / sizeof(flag_sets[0]); j++) {
+            const char *input = inputs[i];
+            size_t flags = flag_sets[j];
+            json_error_t expected_error, error;
+            json_t *expected, *value;
+
+            expected = json_loadb(input, strlen(input), flags, &expected_error);
+            value = json_loadb_arena(input, strlen(input), flags, arena, &error);
+
+            if(!expected != !value)
+                fail("json_loadb_arena succeeded or failed unlike json_loadb");
+
+            if(expected) {
+                if(!json_equal(expected, value))
+                    fail("json_loadb_arena decoded a different value");
+                if(json_is_array(value) && value->refcount != (size_t)-1)
+                    fail("value in an arena is not immortal");
+            }
+            else if(strcmp(expected_error.text, error.text) ||
+                    expected_error.position != error.position)
+                fail("json_loadb_arena reported a different error");
+
+            json_decref(expected);
+            json_decref(value);
+            json_arena_reset(arena);
+        }
+    }
+
+    json_arena_destroy(arena);
+}
+
+static void test_constructors()
+{
+    json_arena_t *arena = json_arena_create(256);
+    json_t *object, *array, *string, *integer, *real, *copy;
+    char key[16];
+    char long_string[1000];
+    int i;
+
+    if(!arena)
+        fail("json_arena_create failed");
+
+    object = json_object_in(arena);
+    array = json_array_in(arena);
+    if(!object || !array)
+        fail("unable to create containers in an arena");
+
+    /* enough to grow the array and rehash the object several times */
+    for(i = 0; i < 1000; i++) {
+        sprintf(key, "key%d", i);
+        if(json_object_set_new(object, key, json_integer_in(arena, i * 1000)))
+            fail("unable to set a value in an arena object");
+        if(json_array_append_new(array, json_real_in(arena, i + 0.5)))
+            fail("unable to append to an arena array");
+    }
+    if(json_object_size(object) != 1000 || json_array_size(array) != 1000)
+        fail("arena containers have the wrong size");
+    if(json_integer_value(json_object_get(object, "key999")) != 999000)
+        fail("arena object has the wrong value");
+    if(json_real_value(json_array_get(array, 999)) != 999.5)
+        fail("arena array has the wrong value");
+
+    if(json_object_del(object, "key0") || json_object_get(object, "key0"))
+        fail("unable to delete from an arena object");
+    if(json_array_remove(array, 0) || json_array_size(array) != 999)
+        fail("unable to remove from an arena array");
+
+    memset(long_string, 'x', sizeof(long_string) - 1);
+    long_string[sizeof(long_string) - 1] = '\0';
+    string = json_string_in(arena, long_string);
+    if(!string || strcmp(json_string_value(string), long_string))
+        fail("unable to create a long string in an arena");
+    if(json_string_in(arena, "\xff") || json_real_in(arena, 1.0 / 0.0))
+        fail("invalid arena values were created");
+
+    /* scalars in an arena are immutable */
+    integer = json_integer_in(arena, 5);
+    real = json_real_in(arena, 5.5);
+    if(!json_string_set(string, "x") || !json_integer_set(integer, 6) ||
+       !json_real_set(real, 6.5))
+        fail("arena scalars can be changed");
+    if(strcmp(json_string_value(string), long_string) ||
+       json_integer_value(integer) != 5 || json_real_value(real) != 5.5)
+        fail("arena scalars were changed");
+
+    /* arena values are ignored by reference counting */
+    json_incref(string);
+    json_decref(string);
+    json_decref(string);
+    if(string->refcount != (size_t)-1)
+        fail("arena value was reference counted");
+
+    /* copies are made on the heap */
+    copy = json_deep_copy(object);
+    if(!copy || copy->refcount != 1 || !json_equal(copy, object))
+        fail("unable to copy an arena object");
+    json_decref(copy);
+
+    json_arena_destroy(arena);
+}
+
+static void test_heap_values()
+{
+    json_arena_t *arena = json_arena_create(0);
+    json_t *object, *array, *other, *value;
+
+    if(!arena)
+        fail("json_arena_create failed");
+
+    value = json_string("kept until the arena is reset");
+    object = json_object_in(arena);
+    array = json_array_in(arena);
+    other = json_array();
+    if(!value || !object || !array || !other)
+        fail("unable to create values");
+
+    json_array_append(other, value);
+    json_object_set(object, "a", value);
+    json_object_set(object, "b", value);
+    json_array_append(array, value);
+    json_array_insert(array, 0, value);
+    json_array_extend(array, other);
+    json_object_iter_set(object, json_object_iter_at(object, "b"), value);
+    if(value->refcount != 7)
+        fail("arena containers did not take a reference");
+
+    /* removing releases as usual */
+    json_object_del(object, "a");
+    json_array_remove(array, 0);
+    if(value->refcount != 5)
+        fail("arena containers did not release a reference");
+
+    json_arena_reset(arena);
+    if(value->refcount != 2)
+        fail("json_arena_reset did not release heap values");
+
+    json_decref(other);
+    json_decref(value);
+    json_arena_destroy(arena);
+}
+
+static void test_bos()
+{
+    json_arena_t *arena = json_arena_create(0);
+    json_t *json, *expected, *value;
+    json_error_t error;
+    unsigned char *bytes;
+    bos_t *bos;
+    int i;
+
+    if(!arena)
+        fail("json_arena_create failed");
+
+    bytes = malloc(3);
+    memcpy(bytes, "\x01\x00\x02", 3);
+    json = json_pack("{s:[i,i,f,b,n], s:s, s:o, s:{s:s}}",
+                     "numbers", 1, 100000, 2.5, 1,
+                     "string", "a string that is too long to be stored inline",
+                     "bytes", json_bytes(bytes, 3),
+                     "nested", "key", "");
+    if(!json)
+        fail("json_pack failed");
+
+    bos = bos_serialize(json, &error);
+    if(!bos)
+        fail("bos_serialize failed");
+
+    expected = bos_deserialize(bos->data, &error);
+    if(!expected)
+        fail("bos_deserialize failed");
+
+    /* one arena serves many documents */
+    for(i = 0; i < 100; i++) {
+        value = bos_deserialize_arena(bos->data, arena, &error);
+        if(!value || !json_equal(value, expected))
+            fail("bos_deserialize_arena decoded a different value");
+        json_arena_reset(arena);
+    }
+
+    json_decref(expected);
+    json_decref(json);
+    bos_free(bos);
+    json_arena_destroy(arena);
+}
+
+static void run_tests()
+{
+    compare_with_heap();
+    test_constructors();
+    test_heap_values();
+    test_bos();
+
+    /* NULL is accepted like free(NULL) */
+    json_arena_reset(NULL);
+    json_arena_destroy(NULL);
+}
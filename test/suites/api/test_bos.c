@@ -408,6 +408,271 @@ static void test_serialize_deserialize(void) {
     free(error);
 }
 
+static void test_repeated_keys(void) {
+
+    json_error_t error;
+    json_t *array = json_array();
+    json_t *result;
+    bos_t *serialized;
+    char key[32];
+    int i;
+
+    /* more distinct keys than are interned */
+    for (i = 0; i < 5000; i++) {
+        json_t *record = json_object();
+        sprintf(key, "k%d", i);
+        json_object_set_new(record, "id", json_integer(i));
+        json_object_set_new(record, "name", json_string("record"));
+        json_object_set_new(record, "", json_true());
+        json_object_set_new(record, "empty", json_string(""));
+        json_object_set_new(record, key, json_null());
+        json_array_append_new(array, record);
+    }
+
+    serialized = bos_serialize(array, &error);
+    if (serialized == NULL)
+        fail("serialize failed");
+
+    result = bos_deserialize(serialized->data, &error);
+    if (!json_equal(array, result))
+        fail("deserialized objects with repeated keys differ");
+
+    json_decref(result);
+    json_decref(array);
+    bos_free(serialized);
+}
+
+/*** JSON text -> BOS tests ***/
+
+/* bos_from_json() must produce the bytes bos_serialize() does */
+static void check_from_json(const char *text, size_t flags) {
+
+    json_error_t error;
+    json_t *value = json_loadb(text, strlen(text), flags, &error);
+    bos_t *expected, *result;
+
+    if (value == NULL)
+        fail("from json: json_loadb failed");
+
+    expected = bos_serialize(value, &error);
+    result = bos_from_json(text, strlen(text), flags, &error);
+    if (expected == NULL || result == NULL)
+        fail("from json: serializing failed");
+
+    if (result->size != expected->size ||
+        memcmp(result->data, expected->data, expected->size) != 0)
+        fail("from json: output differs from bos_serialize");
+
+    json_decref(value);
+    bos_free(expected);
+    bos_free(result);
+}
+
+static void test_from_json(void) {
+
+    static const size_t counts[] = {0, 1, 252, 253, 254, 65535, 65536};
+    json_error_t error;
+    char *text;
+    char key[300];
+    size_t i, j, pos;
+
+    check_from_json("{}", 0);
+    check_from_json("[]", 0);
+    check_from_json("{\"a\": [1, -1, 255, 256, -129, 65536, -32769, 4294967296, -2147483649],"
+                    " \"b\": {\"c\": null, \"d\": [true, false, 1.5, \"str\"]},"
+                    " \"\": \"\", \"e\": [[[]], {}], \"f\": 9223372036854775807}", 0);
+    check_from_json("[1, 2.0]", JSON_DECODE_INT_AS_REAL);
+    check_from_json("\"scalar\"", JSON_DECODE_ANY);
+    check_from_json("[\"nul\\u0000byte\"]", JSON_ALLOW_NUL);
+
+    /* counts that need a wider uvarint than the one byte reserved */
+    text = malloc(65536 * 16 + 64);
+    for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+
+        pos = sprintf(text, "[");
+        for (j = 0; j < counts[i]; j++)
+            pos += sprintf(text + pos, "%s[%d]", j ? "," : "", (int)j);
+        sprintf(text + pos, "]");
+        check_from_json(text, 0);
+
+        pos = sprintf(text, "{\"x\": [1], \"o\": {");
+        for (j = 0; j < counts[i]; j++)
+            pos += sprintf(text + pos, "%s\"%d\":%d", j ? "," : "", (int)j, (int)j);
+        sprintf(text + pos, "}, \"y\": [2]}");
+        check_from_json(text, 0);
+    }
+    free(text);
+
+    if (bos_from_json("[1, 2", 5, 0, &error) != NULL)
+        fail("from json: invalid text succeeded");
+    if (error.line != 1 || error.position != 5)
+        fail("from json: invalid text has wrong error position");
+
+    if (bos_from_json("{\"a\": 1, \"a\": 2}", 16, JSON_REJECT_DUPLICATES, &error) != NULL)
+        fail("from json: duplicate key succeeded with JSON_REJECT_DUPLICATES");
+
+    memset(key, 'k', sizeof(key));
+    sprintf(key + 260, "\": 1}");
+    key[0] = '{';
+    key[1] = '"';
+    if (bos_from_json(key, strlen(key), 0, &error) != NULL)
+        fail("from json: too long key succeeded");
+    if (json_error_code(&error) != json_error_invalid_argument ||
+        strcmp(error.text, "key string is too long") != 0)
+        fail("from json: too long key has wrong error");
+}
+
+/*** BOS -> JSON text tests ***/
+
+struct text_buffer {
+    char data[4096];
+    size_t used;
+};
+
+static int dump_to_text(const char *buffer, size_t size, void *data) {
+    struct text_buffer *text = (struct text_buffer *)data;
+
+    if (text->used + size >= sizeof(text->data))
+        return -1;
+
+    memcpy(text->data + text->used, buffer, size);
+    text->used += size;
+    text->data[text->used] = '\0';
+    return 0;
+}
+
+/* bos_to_json() must produce the text json_dumps() does */
+static void check_to_json(json_t *value, size_t flags) {
+
+    json_error_t error;
+    struct text_buffer text;
+    bos_t *serialized = bos_serialize(value, &error);
+    json_t *deserialized;
+    char *expected;
+
+    if (serialized == NULL)
+        fail("to json: serialize failed");
+
+    deserialized = bos_deserialize(serialized->data, &error);
+    expected = json_dumps(deserialized, flags);
+    if (expected == NULL)
+        fail("to json: json_dumps failed");
+
+    text.used = 0;
+    if (bos_to_json(serialized->data, serialized->size, flags, dump_to_text, &text))
+        fail("to json: bos_to_json failed");
+
+    if (strcmp(text.data, expected) != 0)
+        fail("to json: output differs from json_dumps");
+
+    free(expected);
+    json_decref(deserialized);
+    bos_free(serialized);
+}
+
+static void check_bytes_to_json(size_t flags, const char *expected) {
+
+    static const unsigned char bytes[] = {0x00, 0xFF, 0x10, 0x7E};
+    json_error_t error;
+    struct text_buffer text;
+    void *copy = malloc(sizeof(bytes));
+    json_t *array;
+    bos_t *serialized;
+    char *dumped;
+
+    /* json_bytes() takes ownership of the data */
+    memcpy(copy, bytes, sizeof(bytes));
+    array = json_pack("[o]", json_bytes(copy, sizeof(bytes)));
+    serialized = bos_serialize(array, &error);
+    dumped = json_dumps(array, flags | JSON_COMPACT);
+
+    if (serialized == NULL || dumped == NULL)
+        fail("to json: serializing bytes failed");
+
+    text.used = 0;
+    if (bos_to_json(serialized->data, serialized->size, flags | JSON_COMPACT,
+                    dump_to_text, &text))
+        fail("to json: dumping bytes failed");
+
+    if (strcmp(text.data, expected) != 0 || strcmp(dumped, expected) != 0)
+        fail("to json: bytes dumped incorrectly");
+
+    free(dumped);
+    json_decref(array);
+    bos_free(serialized);
+}
+
+static void test_to_json(void) {
+
+    static const size_t flags[] = {
+        0, JSON_COMPACT, JSON_INDENT(2), JSON_INDENT(3) | JSON_COMPACT,
+        JSON_ENSURE_ASCII, JSON_SORT_KEYS, JSON_INDENT(1) | JSON_SORT_KEYS,
+        JSON_ESCAPE_SLASH | JSON_REAL_PRECISION(4)
+    };
+    json_error_t error;
+    struct text_buffer text;
+    json_t *value;
+    bos_t *serialized;
+    size_t i;
+
+    value = json_loads("{\"b\": [1, -1, 300, -70000, 5000000000, 2.5, true, false, null],"
+                       " \"a\": {\"z\": \"caf\\u00e9 \\\\ \\\" / \\n \\ud834\\udd1e\", \"y\": {}, \"x\": []},"
+                       " \"\": \"\", \"c\": [[{\"d\": [\"e\"]}]]}", 0, &error);
+    if (value == NULL)
+        fail("to json: json_loads failed");
+
+    for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+        check_to_json(value, flags[i]);
+
+    /* the deserialized key order differs from the text */
+    json_object_set_new(value, "0", json_integer(0));
+    check_to_json(value, JSON_SORT_KEYS);
+    json_decref(value);
+
+    value = json_string("scalar");
+    check_to_json(value, JSON_ENCODE_ANY);
+    json_decref(value);
+
+    /* bytes */
+    check_bytes_to_json(BOS_BYTES_AS_HEX, "[\"00ff107e\"]");
+    check_bytes_to_json(BOS_BYTES_AS_BASE64, "[\"AP8Qfg==\"]");
+    check_bytes_to_json(BOS_BYTES_AS_ARRAY, "[[0,255,16,126]]");
+
+    value = json_pack("[o]", json_bytes(malloc(1), 0));
+    serialized = bos_serialize(value, &error);
+    text.used = 0;
+    if (bos_to_json(serialized->data, serialized->size, BOS_BYTES_AS_ARRAY,
+                    dump_to_text, &text) || strcmp(text.data, "[[]]") != 0)
+        fail("to json: empty bytes dumped incorrectly");
+    if (bos_to_json(serialized->data, serialized->size, 0, dump_to_text, &text) == 0)
+        fail("to json: bytes dumped without a BOS_BYTES_AS_* flag");
+    bos_free(serialized);
+    json_decref(value);
+
+    /* invalid data */
+    value = json_pack("{s:[s,i]}", "key", "string", 1);
+    serialized = bos_serialize(value, &error);
+    text.used = 0;
+    if (bos_to_json(serialized->data, serialized->size - 1, 0, dump_to_text, &text) == 0)
+        fail("to json: truncated data succeeded");
+    if (bos_to_json(serialized->data, serialized->size, 0, dump_to_text, &text) != 0)
+        fail("to json: valid data failed");
+    ((unsigned char *)serialized->data)[serialized->size - 1] = 0xFF;
+    ((unsigned char *)serialized->data)[serialized->size - 2] = 0x10;
+    text.used = 0;
+    if (bos_to_json(serialized->data, serialized->size, 0, dump_to_text, &text) == 0)
+        fail("to json: invalid data type succeeded");
+    bos_free(serialized);
+    json_decref(value);
+
+    value = json_integer(1);
+    serialized = bos_serialize(value, &error);
+    if (bos_to_json(serialized->data, serialized->size, 0, dump_to_text, &text) == 0)
+        fail("to json: scalar succeeded without JSON_ENCODE_ANY");
+    bos_free(serialized);
+    json_decref(value);
+}
+
 /*** BOS format tests ***/
 
 static void test_format_null() {
@@ -1141,6 +1406,9 @@ static void test_validation_array() {
 static void run_tests()
 {
     test_serialize_deserialize();
+    test_repeated_keys();
+    test_from_json();
+    test_to_json();
     test_format_null();
     test_format_boolean(0);
     test_format_boolean(1);
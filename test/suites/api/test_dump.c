@@ -8,6 +8,7 @@
 #include "jansson_private_config.h"
 
 #include <bosjansson.h>
+#include <stdint.h>
 #include <string.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -128,6 +129,19 @@ static void circular_references()
         fail("json_dumps failed!");
     free(result);
 
+    result = json_dumps(json, JSON_NO_CYCLE_CHECK);
+    if(!result || strcmp(result, "[[[]]]"))
+        fail("json_dumps failed with JSON_NO_CYCLE_CHECK!");
+    free(result);
+
+    /* The same value appearing twice is not a circular reference */
+    json_array_append(json, json_array_get(json, 0));
+
+    result = json_dumps(json, JSON_COMPACT);
+    if(!result || strcmp(result, "[[[]],[[]]]"))
+        fail("json_dumps failed on a repeated value!");
+    free(result);
+
     json_decref(json);
 }
 
@@ -196,6 +210,60 @@ static void escape_slashes()
     json_decref(json);
 }
 
+static void escape_long_strings()
+{
+    /* Put each character that needs attention at every position of a
+       string long enough to cross the word and vector boundaries used
+       by the encoder */
+
+    static const struct {
+        const char *raw;
+        size_t flags;
+        const char *escaped;
+    } cases[] = {
+        {"\"", 0, "\\\""},
+        {"\\", 0, "\\\\"},
+        {"\n", 0, "\\n"},
+        {"\x01", 0, "\\u0001"},
+        {"\x1f", 0, "\\u001F"},
+        {"/", 0, "/"},
+        {"/", JSON_ESCAPE_SLASH, "\\/"},
+        {"\x7f", 0, "\x7f"},
+        {"\xc3\xa9", 0, "\xc3\xa9"},
+        {"\xc3\xa9", JSON_ENSURE_ASCII, "\\u00E9"},
+        {"\xf0\x9d\x84\x9e", JSON_ENSURE_ASCII, "\\uD834\\uDD1E"},
+    };
+    const size_t length = 40;
+    size_t i, j;
+
+    for(i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        for(j = 0; j <= length; j++) {
+            char raw[64], expected[80];
+            json_t *json;
+            char *result;
+
+            memset(raw, 'a', j);
+            strcpy(raw + j, cases[i].raw);
+            memset(raw + strlen(raw), 'b', length - j);
+            raw[j + strlen(cases[i].raw) + length - j] = '\0';
+
+            expected[0] = '"';
+            memset(expected + 1, 'a', j);
+            strcpy(expected + 1 + j, cases[i].escaped);
+            memset(expected + strlen(expected), 'b', length - j);
+            strcpy(expected + 1 + j + strlen(cases[i].escaped) + length - j, "\"");
+
+            json = json_string(raw);
+            result = json_dumps(json, JSON_ENCODE_ANY | cases[i].flags);
+            if(!result || strcmp(result, expected))
+                fail("json_dumps failed to escape a long string");
+
+            free(result);
+            json_decref(json);
+        }
+    }
+}
+
 static void encode_nul_byte()
 {
     json_t *json;
@@ -250,6 +318,28 @@ static void dumpb()
     json_decref(obj);
 }
 
+static void dump_size()
+{
+    json_t *obj;
+    char *result;
+
+    obj = json_pack("{s:s, s:[i, f, n], s:{}}", "foo", "bar\n\xc3\xa9",
+                    "baz", 42, 0.5, "qux");
+
+    result = json_dumps(obj, JSON_ENSURE_ASCII | JSON_INDENT(2));
+    if(!result)
+        fail("json_dumps failed");
+
+    if(json_dump_size(obj, JSON_ENSURE_ASCII | JSON_INDENT(2)) != strlen(result))
+        fail("json_dump_size returned the wrong size");
+    free(result);
+
+    if(json_dump_size(json_null(), 0) != (size_t)-1)
+        fail("json_dump_size succeeded for a non-container without JSON_ENCODE_ANY");
+
+    json_decref(obj);
+}
+
 static void dumpfd()
 {
 #ifdef HAVE_UNISTD_H
@@ -288,12 +378,12 @@ static void embed()
         NULL
     };
 
+    json_t *parse;
+    char *embed;
     size_t i;
 
     for(i = 0; plains[i]; i++) {
         const char *plain = plains[i];
-        json_t *parse = NULL;
-        char *embed = NULL;
         size_t psize = 0;
         size_t esize = 0;
 
@@ -309,6 +399,86 @@ static void embed()
             fail("json_dumps(JSON_EMBED) returned an invalid value");
         free(embed);
     }
+
+    /* empty containers embed as nothing, which is not an error */
+    parse = json_array();
+    embed = json_dumps(parse, JSON_EMBED);
+    if(!embed || strcmp(embed, ""))
+        fail("json_dumps(JSON_EMBED) failed for an empty array");
+    free(embed);
+    if(json_dump_size(parse, JSON_EMBED) != 0)
+        fail("json_dump_size(JSON_EMBED) failed for an empty array");
+    json_decref(parse);
+
+    parse = json_object();
+    embed = json_dumps(parse, JSON_EMBED | JSON_INDENT(2));
+    if(!embed || strcmp(embed, ""))
+        fail("json_dumps(JSON_EMBED) failed for an empty object");
+    free(embed);
+    json_decref(parse);
+}
+
+static void check_dump_any(json_t *json, size_t flags, const char *expected)
+{
+    char *result;
+
+    if(!json)
+        fail("unable to create value");
+
+    result = json_dumps(json, JSON_ENCODE_ANY | flags);
+    if(!result || strcmp(result, expected) != 0) {
+        failhdr;
+        fprintf(stderr, "\"%s\" != \"%s\"\n", result ? result : "(null)", expected);
+        exit(1);
+    }
+
+    free(result);
+    json_decref(json);
+}
+
+static void encode_numbers()
+{
+    static const struct {
+        double value;
+        const char *expected;
+    } reals[] = {
+        {0.0, "0.0"},
+        {-0.0, "-0.0"},
+        {1.0, "1.0"},
+        {-1.5, "-1.5"},
+        {0.1, "0.1"},
+        {100.1, "100.1"},
+        {0.30000000000000004, "0.30000000000000004"},
+        {1e-4, "0.0001"},
+        {1e-5, "1e-5"},
+        {1e16, "10000000000000000.0"},
+        {1e17, "1e17"},
+        {1e22, "1e22"},
+        {1e23, "1e23"},
+        {123e45, "1.23e47"},
+        {9007199254740993.0, "9007199254740992.0"},
+        {5e-324, "5e-324"},
+        {2.2250738585072014e-308, "2.2250738585072014e-308"},
+        {1.7976931348623157e308, "1.7976931348623157e308"}
+    };
+    size_t i;
+
+    for(i = 0; i < sizeof(reals) / sizeof(reals[0]); i++)
+        check_dump_any(json_real(reals[i].value), 0, reals[i].expected);
+
+    /* an explicit precision still rounds to that many digits */
+    check_dump_any(json_real(0.1), JSON_REAL_PRECISION(17), "0.10000000000000001");
+    check_dump_any(json_real(3.14159), JSON_REAL_PRECISION(3), "3.14");
+    check_dump_any(json_real(123e45), JSON_REAL_PRECISION(2), "1.2e47");
+
+    check_dump_any(json_integer(0), 0, "0");
+    check_dump_any(json_integer(7), 0, "7");
+    check_dump_any(json_integer(-42), 0, "-42");
+    check_dump_any(json_integer(1234567890), 0, "1234567890");
+    if(sizeof(json_int_t) == 8) {
+        check_dump_any(json_integer(INT64_MAX), 0, "9223372036854775807");
+        check_dump_any(json_integer(INT64_MIN), 0, "-9223372036854775808");
+    }
 }
 
 static void run_tests()
@@ -318,9 +488,12 @@ static void run_tests()
     circular_references();
     encode_other_than_array_or_object();
     escape_slashes();
+    escape_long_strings();
     encode_nul_byte();
     dump_file();
     dumpb();
+    dump_size();
     dumpfd();
     embed();
+    encode_numbers();
 }
@@ -14,6 +14,7 @@ struct my_sink {
     char *buf;
     size_t off;
     size_t cap;
+    size_t calls;
 };
 
 static int my_writer(const char *buffer, size_t len, void *data) {
@@ -23,6 +24,7 @@ static int my_writer(const char *buffer, size_t len, void *data) {
     }
     memcpy(s->buf + s->off, buffer, len);
     s->off += len;
+    s->calls++;
     return 0;
 }
 
@@ -45,6 +47,7 @@ static void run_tests()
     }
 
     s.off = 0;
+    s.calls = 0;
     s.cap = strlen(dumped_to_string);
     s.buf = malloc(s.cap);
     if (!s.buf) {
@@ -75,6 +78,41 @@ static void run_tests()
         fail("json_dump_callback succeeded on a short buffer when it should have failed");
     }
 
+    s.off = 0;
+    s.calls = 0;
+    if (json_dump_callback_ex(json, my_writer, &s, 0, 4096) == -1 ||
+        s.off != s.cap || strncmp(dumped_to_string, s.buf, s.off) != 0) {
+        json_decref(json);
+        free(dumped_to_string);
+        free(s.buf);
+        fail("json_dump_callback_ex did not produce identical output");
+    }
+
+    if (s.calls != 1) {
+        json_decref(json);
+        free(dumped_to_string);
+        free(s.buf);
+        fail("json_dump_callback_ex did not coalesce the output");
+    }
+
+    s.off = 0;
+    s.calls = 0;
+    if (json_dump_callback_ex(json, my_writer, &s, 0, 8) == -1 ||
+        s.off != s.cap || strncmp(dumped_to_string, s.buf, s.off) != 0) {
+        json_decref(json);
+        free(dumped_to_string);
+        free(s.buf);
+        fail("json_dump_callback_ex with a small buffer did not produce identical output");
+    }
+
+    s.off = 1;
+    if (json_dump_callback_ex(json, my_writer, &s, 0, 4096) != -1) {
+        json_decref(json);
+        free(dumped_to_string);
+        free(s.buf);
+        fail("json_dump_callback_ex succeeded on a short buffer when it should have failed");
+    }
+
     json_decref(json);
     free(dumped_to_string);
     free(s.buf);
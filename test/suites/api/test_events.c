@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <bosjansson.h>
+#include <string.h>
+#include "util.h"
+
+/* Rebuild the value from the events to compare it with json_loadb() */
+struct builder {
+    json_t *stack[16];
+    char *keys[16];
+    int depth;
+    json_t *result;
+    int abort_on_key;
+};
+
+static int add(struct builder *b, json_t *value)
+{
+    json_t *parent;
+
+    if (b->depth == 0) {
+        b->result = value;
+        return 0;
+    }
+
+    parent = b->stack[b->depth - 1];
+    if (json_is_array(parent))
+        return json_array_append_new(parent, value);
+
+    json_object_set_new(parent, b->keys[b->depth - 1], value);
+    free(b->keys[b->depth - 1]);
+    b->keys[b->depth - 1] = NULL;
+    return 0;
+}
+
+static int on_start(struct builder *b, json_t *container)
+{
+    if (b->depth == 16)
+        return -1;
+    b->keys[b->depth] = NULL;
+    b->stack[b->depth++] = container;
+    return 0;
+}
+
+static int on_end(struct builder *b)
+{
+    json_t *container = b->stack[--b->depth];
+    return add(b, container);
+}
+
+static int start_object(void *ctx) { return on_start(ctx, json_object()); }
+static int start_array(void *ctx) { return on_start(ctx, json_array()); }
+static int end_container(void *ctx) { return on_end(ctx); }
+
+static int key(void *ctx, const char *key, size_t len)
+{
+    struct builder *b = ctx;
+
+    if (b->abort_on_key && strcmp(key, "stop") == 0)
+        return -1;
+    if (strlen(key) != len)
+        return -1;
+
+    b->keys[b->depth - 1] = strdup(key);
+    return 0;
+}
+
+static int string(void *ctx, const char *value, size_t len)
+{
+    return add(ctx, json_stringn(value, len));
+}
+
+static int integer(void *ctx, json_int_t value)
+{
+    return add(ctx, json_integer(value));
+}
+
+static int real(void *ctx, double value)
+{
+    return add(ctx, json_real(value));
+}
+
+static int boolean(void *ctx, int value)
+{
+    return add(ctx, json_boolean(value));
+}
+
+static int null(void *ctx)
+{
+    return add(ctx, json_null());
+}
+
+static const json_handler_t handler = {
+    start_object, key, end_container, start_array, end_container,
+    string, integer, real, boolean, null
+};
+
+static void builder_clear(struct builder *b)
+{
+    while (b->depth > 0) {
+        b->depth--;
+        json_decref(b->stack[b->depth]);
+        free(b->keys[b->depth]);
+    }
+    json_decref(b->result);
+    b->result = NULL;
+}
+
+static void check_events(const char *input, size_t flags)
+{
+    struct builder b;
+    json_error_t error, expected_error;
+    json_t *expected;
+    int res;
+
+    memset(&b, 0, sizeof(b));
+
+    expected = json_loads(input, flags, &expected_error);
+    res = json_parse_events(input, strlen(input), &handler, &b, flags, &error);
+
+    if (!expected) {
+        if (res != -1)
+            fail("json_parse_events succeeded on invalid input");
+        if (strcmp(error.text, expected_error.text) ||
+            error.line != expected_error.line ||
+            error.column != expected_error.column)
+            fail("json_parse_events returned a different error than json_loads");
+    }
+    else {
+        if (res != 0)
+            fail("json_parse_events failed on valid input");
+        if (!json_equal(b.result, expected))
+            fail("json_parse_events produced the wrong events");
+    }
+
+    builder_clear(&b);
+    json_decref(expected);
+}
+
+static void run_tests()
+{
+    struct builder b;
+    json_error_t error;
+    const char *stop = "{\"a\": [1, 2], \"stop\": true}";
+    static const json_handler_t empty_handler;
+
+    check_events("{\"a\": [1, -2.5, \"x\\ty\", true, false, null], \"b\": {}}", 0);
+    check_events("[\"caf\\u00e9\", {\"k\\u00e9y\": [[]]}, 1e2, -0]", 0);
+    check_events("[1, 2, 3]", JSON_DECODE_INT_AS_REAL);
+    check_events("\"scalar\"", JSON_DECODE_ANY);
+    check_events("[1] garbage", JSON_DISABLE_EOF_CHECK);
+    check_events("[1] garbage", 0);
+    check_events("{\"a\": 1, \"a\": 2}", JSON_REJECT_DUPLICATES);
+    check_events("{\"a\": 1, \"b\": {\"a\": 2}}", JSON_REJECT_DUPLICATES);
+    check_events("[\"\\u0000\"]", 0);
+    check_events("{\"a\" 1}", 0);
+    check_events("[1, 2", 0);
+    check_events("42", 0);
+
+    memset(&b, 0, sizeof(b));
+    b.abort_on_key = 1;
+    if (json_parse_events(stop, strlen(stop), &handler, &b, 0, &error) != -1)
+        fail("json_parse_events did not stop when a handler failed");
+    if (json_error_code(&error) != json_error_aborted)
+        fail("json_parse_events returned a wrong error code for a failed handler");
+    builder_clear(&b);
+
+    if (json_parse_events(stop, strlen(stop), &empty_handler, NULL, 0, &error))
+        fail("json_parse_events failed with no callbacks");
+
+    if (json_parse_events(NULL, 0, &handler, NULL, 0, &error) != -1)
+        fail("json_parse_events succeeded on NULL input");
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <bosjansson.h>
+#include <string.h>
+#include "util.h"
+#include "decode_inputs.h"
+
+/* JSON_FAST_PARSE must give exactly the same result as the lexer */
+static json_t *fast_parse(const char *input, size_t len, size_t flags,
+                          json_error_t *error)
+{
+    return json_loadb(input, len, flags | JSON_FAST_PARSE, error);
+}
+
+/* Shift a document with long strings and backslash runs over all
+   offsets of a 64 byte block */
+static void block_boundaries()
+{
+    char buffer[512];
+    const char *doc =
+        "{\"k\\\\\": [\"\\\\\\\\\\\"\", \"a\\\\\\\"b\", {\"\\\"\": \"x\\\\\"}, -1.5e3, true]}";
+    size_t shift, len;
+
+    for(shift = 0; shift < 130; shift++) {
+        memset(buffer, ' ', shift);
+        strcpy(buffer + shift, doc);
+        len = strlen(buffer);
+        check_decoded(fast_parse, buffer, len, 0);
+
+        /* cut the input at every position */
+        while(len-- > shift)
+            check_decoded(fast_parse, buffer, len, 0);
+    }
+}
+
+/* Build random documents out of a small set of tokens */
+static void random_documents()
+{
+    static const char *tokens[] = {
+        "[", "]", "{", "}", ":", ",", " ", "\"a\"", "\"\\\\\"", "\"\\\"\"",
+        "1", "-2.5e1", "true", "null", "\"\\u00e9\"", "\"                \""
+    };
+    char buffer[1024];
+    unsigned int seed = 12345;
+    int i, j;
+
+    for(i = 0; i < 20000; i++) {
+        int count;
+
+        buffer[0] = '\0';
+        seed = seed * 1103515245 + 12345;
+        count = (seed >> 16) % 40 + 1;
+
+        for(j = 0; j < count; j++) {
+            seed = seed * 1103515245 + 12345;
+            strcat(buffer, tokens[(seed >> 16) % (sizeof(tokens) / sizeof(tokens[0]))]);
+        }
+
+        check_decoded(fast_parse, buffer, strlen(buffer), JSON_DECODE_ANY);
+    }
+}
+
+static void large_document()
+{
+    json_t *array, *value;
+    json_error_t error;
+    char *text;
+    int i;
+
+    array = json_array();
+    for(i = 0; i < 1000; i++) {
+        json_array_append_new(array, json_pack("{s:i, s:s, s:s, s:[f, b, n]}",
+                                               "id", i, "name", "x\"y\\z",
+                                               "caf\xc3\xa9\n", "line\nbreak \xc3\xa9",
+                                               "data", i / 4.0, i % 2));
+    }
+
+    text = json_dumps(array, JSON_INDENT(2));
+    value = json_loadb(text, strlen(text), JSON_FAST_PARSE, &error);
+    if(!json_equal(array, value))
+        fail("JSON_FAST_PARSE failed on a large document");
+    if(error.position != (int)strlen(text))
+        fail("JSON_FAST_PARSE returned a wrong position");
+
+    free(text);
+    json_decref(value);
+    json_decref(array);
+}
+
+static void run_tests()
+{
+    check_decode_inputs(fast_parse);
+    block_boundaries();
+    random_documents();
+    large_document();
+}
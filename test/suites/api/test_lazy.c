@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <bosjansson.h>
+#include <string.h>
+#include "util.h"
+#include "decode_inputs.h"
+
+static json_t *decode_lazy(const char *input, size_t len, size_t flags,
+                           json_error_t *error)
+{
+    return json_loadb(input, len, flags | JSON_DECODE_LAZY, error);
+}
+
+static json_t *load_lazy(const char *text)
+{
+    json_t *json = json_loadb(text, strlen(text), JSON_DECODE_LAZY, NULL);
+    if(!json)
+        fail("json_loadb failed with JSON_DECODE_LAZY");
+    return json;
+}
+
+static void partial_access()
+{
+    json_t *json, *b, *value;
+    char *dumped;
+    const char *text =
+        "{\"a\": [1, 2], \"b\": {\"c\": \"x\", \"d\": [true]}, \"k\\u00e9y\": 3, \"b\": {\"e\": 4}}";
+
+    json = load_lazy(text);
+
+    /* The last duplicate wins, like without JSON_DECODE_LAZY */
+    b = json_object_get(json, "b");
+    if(!json_is_object(b) || !json_object_get(b, "e") || json_object_get(b, "c"))
+        fail("json_object_get returned a wrong value for a lazy object");
+
+    if(json_integer_value(json_object_get(json, "k\xc3\xa9y")) != 3)
+        fail("json_object_get failed on an escaped key");
+
+    if(json_object_get(json, "missing"))
+        fail("json_object_get returned a value for a missing key");
+
+    /* Decoding the rest must keep the value that was returned */
+    if(json_object_size(json) != 3)
+        fail("json_object_size returned a wrong size for a lazy object");
+    if(json_object_get(json, "b") != b)
+        fail("decoding a lazy object replaced a returned value");
+
+    dumped = json_dumps(json, JSON_COMPACT);
+    if(strcmp(dumped, "{\"a\":[1,2],\"b\":{\"e\":4},\"k\xc3\xa9y\":3}"))
+        fail("a lazy object was dumped in a wrong order");
+    free(dumped);
+    json_decref(json);
+
+    /* Modifying lazy containers */
+    json = load_lazy(text);
+    if(json_object_set_new(json, "z", json_null()) || json_object_size(json) != 4)
+        fail("json_object_set_new failed on a lazy object");
+    if(json_object_del(json, "a") || json_object_get(json, "a"))
+        fail("json_object_del failed on a lazy object");
+    json_decref(json);
+
+    json = load_lazy(text);
+    if(json_object_clear(json) || json_object_size(json) != 0)
+        fail("json_object_clear failed on a lazy object");
+    json_decref(json);
+
+    json = load_lazy("[[1, 2], {\"a\": [3]}, \"s\"]");
+    value = json_array_get(json_object_get(json_array_get(json, 1), "a"), 0);
+    if(json_integer_value(value) != 3)
+        fail("json_array_get failed on a lazy array");
+    if(json_array_append_new(json_array_get(json, 0), json_integer(5)) ||
+        json_array_size(json_array_get(json, 0)) != 3)
+        fail("json_array_append_new failed on a lazy array");
+    json_decref(json);
+
+    /* The values outlive the lazy root */
+    json = load_lazy("{\"a\": {\"b\": [1, {\"c\": 2}]}}");
+    value = json_incref(json_object_get(json, "a"));
+    json_decref(json);
+    if(json_integer_value(json_object_get(json_array_get(json_object_get(value, "b"), 1), "c")) != 2)
+        fail("a lazy value did not outlive its parent");
+    json_decref(value);
+
+    /* Copies and comparisons */
+    json = load_lazy(text);
+    value = json_deep_copy(json);
+    if(!json_equal(json, value))
+        fail("json_deep_copy failed on a lazy object");
+    json_decref(value);
+    json_decref(json);
+}
+
+/* Reading every key of a large object, in any order */
+static void many_keys()
+{
+    json_t *json, *first, *value;
+    char *text, key[32];
+    size_t i, n = 500, pos = 0;
+
+    text = malloc(n * 40);
+    text[pos++] = '{';
+    for(i = 0; i < n; i++) {
+        /* some keys have escapes */
+        pos += sprintf(text + pos, i % 7 ? "%s\"k%u\": %u" : "%s\"\\u006b%u\": %u",
+                       i ? ", " : "", (unsigned int)i, (unsigned int)i);
+    }
+    strcpy(text + pos, "}");
+
+    json = load_lazy(text);
+    first = json_object_get(json, "k0");
+    for(i = n; i-- > 0;) {
+        sprintf(key, "k%u", (unsigned int)i);
+        value = json_object_get(json, key);
+        if(!json_is_integer(value) || json_integer_value(value) != (json_int_t)i)
+            fail("json_object_get returned a wrong value for a lazy object");
+        if(json_object_get(json, "missing"))
+            fail("json_object_get returned a value for a missing key");
+    }
+    if(json_object_get(json, "k0") != first)
+        fail("decoding a lazy object replaced a returned value");
+    if(json_object_size(json) != n)
+        fail("json_object_size returned a wrong size for a lazy object");
+    json_decref(json);
+
+    /* a missing key first */
+    json = load_lazy(text);
+    if(json_object_get(json, "missing") || json_integer_value(json_object_get(json, "k7")) != 7)
+        fail("json_object_get failed after a missing key");
+    json_decref(json);
+
+    free(text);
+}
+
+static void run_tests()
+{
+    check_decode_inputs(decode_lazy);
+    partial_access();
+    many_keys();
+}
@@ -209,6 +209,17 @@ static void position()
     if(error.position != 14)
         fail("json_loads returned a wrong position");
     json_decref(json);
+
+    /* numbers are scanned in the buffer itself */
+    json = json_loadb("[1,\n 2.5e3 99999999999999999999]", 32, 0, &error);
+    if(json || strcmp(error.text, "too big integer near '99999999999999999999'") ||
+       error.line != 2 || error.column != 27 || error.position != 31)
+        fail("json_loadb returned a wrong error for a number");
+
+    json = json_loadb("[-99999999999999999999]", 23, 0, &error);
+    if(json || strcmp(error.text, "too big negative integer") ||
+       error.column != 22 || error.position != 22)
+        fail("json_loadb returned a wrong error for a number");
 }
 
 static void error_code()
@@ -231,6 +242,46 @@ static void error_code()
         fail("json_loads returned incorrect error code");
 }
 
+static void repeated_keys()
+{
+    json_t *json, *record;
+    json_error_t error;
+    char *text, *p;
+    int i;
+
+    /* More distinct keys than are interned, and escaped keys that are
+       the same after decoding */
+    text = malloc(5000 * 64);
+    p = text + sprintf(text, "[");
+    for(i = 0; i < 5000; i++)
+        p += sprintf(p, "%s{\"id\": %d, \"k%d\": 0, \"\\u00e9\": 1, \"\xc3\xa9\": 2}",
+                     i ? "," : "", i, i);
+    sprintf(p, "]");
+
+    json = json_loads(text, JSON_REJECT_DUPLICATES, &error);
+    if(json)
+        fail("json_loads did not reject keys that are the same after decoding");
+
+    json = json_loads(text, 0, &error);
+    if(!json || json_array_size(json) != 5000)
+        fail("json_loads failed on repeated keys");
+
+    for(i = 0; i < 5000; i++) {
+        char key[16];
+
+        record = json_array_get(json, i);
+        sprintf(key, "k%d", i);
+        if(json_object_size(record) != 3 ||
+           json_integer_value(json_object_get(record, "id")) != i ||
+           !json_object_get(record, key) ||
+           json_integer_value(json_object_get(record, "\xc3\xa9")) != 2)
+            fail("json_loads returned a wrong object for repeated keys");
+    }
+
+    json_decref(json);
+    free(text);
+}
+
 static void run_tests()
 {
     file_not_found();
@@ -243,4 +294,5 @@ static void run_tests()
     load_wrong_args();
     position();
     error_code();
+    repeated_keys();
 }
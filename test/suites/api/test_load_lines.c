@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <bosjansson.h>
+#include <string.h>
+#include "util.h"
+
+#define RECORDS 40000
+
+struct check {
+    size_t next;
+    size_t stop_at;
+    int errors;
+    json_t *kept;
+};
+
+/* Every 1000th record is invalid */
+static char *make_lines()
+{
+    char *buffer = malloc(RECORDS * 80);
+    char *p = buffer;
+    int i;
+
+    for (i = 0; i < RECORDS; i++) {
+        if (i % 1000 == 999)
+            p += sprintf(p, "{\"id\": %d, \"broken\"}\n", i);
+        else
+            p += sprintf(p, "{\"id\": %d, \"name\": \"record %d\"}\r\n", i, i);
+
+        if (i % 100 == 0)
+            p += sprintf(p, "  \n");
+    }
+    *p = '\0';
+    return buffer;
+}
+
+static int check_record(size_t index, json_t *value, const json_error_t *error, void *ctx)
+{
+    struct check *check = ctx;
+
+    if (index != check->next++)
+        fail("json_load_lines_parallel delivered a record out of order");
+
+    if (index % 1000 == 999) {
+        /* The line number counts the blank lines, too */
+        if (value || !error)
+            fail("json_load_lines_parallel decoded an invalid record");
+        if (error->line != (int)(index + index / 100 + 2))
+            fail("json_load_lines_parallel returned a wrong error line");
+        check->errors++;
+    }
+    else {
+        if (!value || json_integer_value(json_object_get(value, "id")) != (json_int_t)index)
+            fail("json_load_lines_parallel returned a wrong record");
+
+        /* a value in an arena must be copied to be kept */
+        if (index == 5)
+            check->kept = json_deep_copy(value);
+        json_decref(value);
+    }
+
+    return index == check->stop_at ? -1 : 0;
+}
+
+static void run_tests()
+{
+    char *buffer = make_lines();
+    size_t len = strlen(buffer);
+    static const size_t flags[] = {0, JSON_LINES_ARENA};
+    struct check check;
+    int nthreads;
+    size_t i;
+
+    for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+        for (nthreads = 0; nthreads <= 4; nthreads++) {
+            check.next = 0;
+            check.stop_at = (size_t)-1;
+            check.errors = 0;
+            check.kept = NULL;
+
+            if (json_load_lines_parallel(buffer, len, flags[i], nthreads, check_record, &check))
+                fail("json_load_lines_parallel failed");
+            if (check.next != RECORDS || check.errors != RECORDS / 1000)
+                fail("json_load_lines_parallel did not deliver all records");
+
+            if (json_integer_value(json_object_get(check.kept, "id")) != 5 ||
+                strcmp(json_string_value(json_object_get(check.kept, "name")), "record 5"))
+                fail("a copied record did not outlive json_load_lines_parallel");
+            json_decref(check.kept);
+        }
+    }
+
+    /* Stop in the middle */
+    check.next = 0;
+    check.stop_at = 12345;
+    if (json_load_lines_parallel(buffer, len, 0, 3, check_record, &check) != -1)
+        fail("json_load_lines_parallel did not stop");
+    if (check.next != 12346)
+        fail("json_load_lines_parallel delivered records after stopping");
+    json_decref(check.kept);
+
+    check.next = 0;
+    if (json_load_lines_parallel("", 0, 0, 2, check_record, &check) || check.next != 0)
+        fail("json_load_lines_parallel failed on empty input");
+
+    if (json_load_lines_parallel(NULL, 0, 0, 2, check_record, &check) != -1)
+        fail("json_load_lines_parallel succeeded on NULL input");
+
+    free(buffer);
+}
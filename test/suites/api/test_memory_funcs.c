@@ -122,6 +122,105 @@ static void test_secure_funcs(void)
     create_and_free_complex_object();
 }
 
+/* counts the blocks of one tenant */
+typedef struct {
+    int blocks;
+    int reallocs;
+} tenant_t;
+
+static void *tenant_malloc(size_t size, void *ctx)
+{
+    ((tenant_t *)ctx)->blocks++;
+    return malloc(size);
+}
+
+static void *tenant_realloc(void *ptr, size_t size, void *ctx)
+{
+    ((tenant_t *)ctx)->reallocs++;
+    return realloc(ptr, size);
+}
+
+static void tenant_free(void *ptr, void *ctx)
+{
+    ((tenant_t *)ctx)->blocks--;
+    free(ptr);
+}
+
+static void grow_and_free(tenant_t *tenant)
+{
+    json_t *array, *object;
+    json_error_t error;
+    char key[16];
+    char *text;
+    bos_t *bos;
+    int i;
+
+    array = json_array();
+    object = json_object();
+    for(i = 0; i < 100; i++) {
+        sprintf(key, "key%d", i);
+        json_array_insert_new(array, 0, json_integer(i));
+        json_object_set_new(object, key, json_string("value"));
+    }
+    json_object_set_new(object, "array", array);
+
+    if(json_array_size(array) != 100 ||
+       json_integer_value(json_array_get(array, 0)) != 99 ||
+       json_integer_value(json_array_get(array, 99)) != 0)
+        fail("array grown with realloc has the wrong items");
+
+    text = json_dumps(object, JSON_SORT_KEYS);
+    bos = bos_serialize(object, &error);
+    if(!text || !bos)
+        fail("unable to encode with custom allocation functions");
+
+    json_decref(object);
+    object = json_loads(text, 0, NULL);
+    if(!object || json_object_size(object) != 101)
+        fail("unable to decode with custom allocation functions");
+
+    json_decref(object);
+    bos_free(bos);
+    tenant_free(text, tenant);
+}
+
+static void test_funcs_ex(void)
+{
+    tenant_t tenant = {0, 0};
+    json_malloc_ex_t mfunc = NULL;
+    json_realloc_ex_t rfunc = NULL;
+    json_free_ex_t ffunc = NULL;
+    json_malloc_t legacy_mfunc;
+    void *ctx = NULL;
+
+    json_set_alloc_funcs_ex(tenant_malloc, tenant_realloc, tenant_free, &tenant);
+    json_get_alloc_funcs_ex(&mfunc, &rfunc, &ffunc, &ctx);
+    if(mfunc != tenant_malloc || rfunc != tenant_realloc ||
+       ffunc != tenant_free || ctx != &tenant)
+        fail("json_get_alloc_funcs_ex returned the wrong functions");
+
+    json_get_alloc_funcs(&legacy_mfunc, NULL);
+    if(legacy_mfunc)
+        fail("json_get_alloc_funcs returned a function after json_set_alloc_funcs_ex");
+
+    grow_and_free(&tenant);
+    if(tenant.blocks != 0)
+        fail("blocks were leaked or freed twice");
+    if(tenant.reallocs == 0)
+        fail("growing did not use the realloc function");
+
+    /* without a realloc function, blocks are moved */
+    json_set_alloc_funcs_ex(tenant_malloc, NULL, tenant_free, &tenant);
+    grow_and_free(&tenant);
+    if(tenant.blocks != 0)
+        fail("blocks were leaked or freed twice without realloc");
+
+    json_set_alloc_funcs(malloc, free);
+    json_get_alloc_funcs_ex(&mfunc, &rfunc, &ffunc, &ctx);
+    if(mfunc || rfunc || ffunc || ctx)
+        fail("json_set_alloc_funcs did not clear the functions");
+}
+
 static void test_bad_args(void)
 {
     /* The result of this test is not crashing. */
@@ -133,5 +232,6 @@ static void run_tests()
     test_simple();
     test_secure_funcs();
     test_oom();
+    test_funcs_ex();
     test_bad_args();
 }
@@ -6,6 +6,8 @@
  */
 
 #include <math.h>
+#include <stdint.h>
+#include <string.h>
 #include <bosjansson.h>
 #include "util.h"
 
@@ -72,6 +74,227 @@ static void test_bad_args(void)
     json_decref(txt);
 }
 
+static uint64_t xorshift_state = UINT64_C(88172645463325252);
+
+static uint64_t xorshift(void)
+{
+    xorshift_state ^= xorshift_state << 13;
+    xorshift_state ^= xorshift_state >> 7;
+    xorshift_state ^= xorshift_state << 17;
+    return xorshift_state;
+}
+
+/* The decoder must produce exactly the bits strtod() produces */
+static void check_real_parity(const char *text)
+{
+    json_t *json;
+    double expected, actual;
+    char *end;
+
+    expected = strtod(text, &end);
+    if(*end != '\0')
+        return;  /* the locale's decimal point is not '.' */
+
+    json = json_loads(text, JSON_DECODE_ANY | JSON_DECODE_INT_AS_REAL, NULL);
+    if(isinf(expected)) {
+        if(json)
+            fail("decoding an overflowing real succeeded");
+        return;
+    }
+    if(!json)
+        fail("unable to decode real");
+
+    actual = json_real_value(json);
+    if(memcmp(&actual, &expected, sizeof(double)) != 0) {
+        failhdr;
+        fprintf(stderr, "%s: %.17g != %.17g\n", text, actual, expected);
+        exit(1);
+    }
+
+    json_decref(json);
+}
+
+/* prefix, count times fill, middle and suffix */
+static void check_long_real_parity(const char *prefix, char fill, size_t count,
+                                   const char *middle, const char *suffix)
+{
+    size_t prefix_len = strlen(prefix), middle_len = strlen(middle);
+    char *text = malloc(prefix_len + count + middle_len + strlen(suffix) + 1);
+
+    if(!text)
+        fail("malloc failed");
+
+    memcpy(text, prefix, prefix_len);
+    memset(text + prefix_len, fill, count);
+    memcpy(text + prefix_len + count, middle, middle_len);
+    strcpy(text + prefix_len + count + middle_len, suffix);
+
+    check_real_parity(text);
+    free(text);
+}
+
+static void test_real_parsing(void)
+{
+    static const char *corpus[] = {
+        "0.0", "-0.0", "0e10", "1", "-1", "0.1", "0.2", "0.3",
+        "0.30000000000000004", "1e23", "8.589973e9", "1.5e-3",
+        "9007199254740992", "9007199254740993", "9007199254740995",
+        "3.0517578125e-05", "7.2057594037927933e16",
+        "2.2250738585072011e-308", "2.2250738585072012e-308",
+        "2.2250738585072014e-308", "4.9406564584124654e-324",
+        "2.4703282292062327e-324", "2.4703282292062328e-324",
+        "1.7976931348623157e308", "1.7976931348623158e308",
+        "1.7976931348623159e308", "1e308", "1e309", "1e-400",
+        "100000000000000016777215", "100000000000000016777216",
+        "123456789012345678901234567890e-10",
+        "0.000000000000000000000000000000000000000000001e-300",
+        "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000011102230246251565404236316680908203124",
+        "1.00000000000000011102230246251565404236316680908203126",
+        "179769313486231580793728971405301e276",
+        NULL
+    };
+    char buffer[128];
+    size_t i;
+    int j;
+
+    for(i = 0; corpus[i]; i++)
+        check_real_parity(corpus[i]);
+
+    /* many digits that offset a huge exponent */
+    check_long_real_parity("1", '0', 100000, "", "e-1000000");
+    check_long_real_parity("1", '0', 100000, "", "e-100010");
+    check_long_real_parity("0.", '0', 1000000, "1", "e1000050");
+    check_long_real_parity("0.", '0', 1000000, "1", "e1000400");
+
+    for(i = 0; i < 20000; i++) {
+        uint64_t bits = xorshift();
+        double value;
+        int pos = 0, digits;
+
+        /* round trip of an arbitrary double */
+        memcpy(&value, &bits, sizeof(double));
+        if(!isnan(value) && !isinf(value)) {
+            snprintf(buffer, sizeof(buffer), "%.17e", value);
+            check_real_parity(buffer);
+            snprintf(buffer, sizeof(buffer), "%.*e", (int)(xorshift() % 17), value);
+            check_real_parity(buffer);
+        }
+
+        /* long digit strings that do not fit in 64 bits */
+        digits = 1 + (int)(xorshift() % 40);
+        buffer[pos++] = '1' + (int)(xorshift() % 9);
+        for(j = 1; j < digits; j++)
+            buffer[pos++] = '0' + (int)(xorshift() % 10);
+        buffer[pos++] = '.';
+        buffer[pos++] = '0' + (int)(xorshift() % 10);
+        snprintf(buffer + pos, sizeof(buffer) - pos, "e%d",
+                 (int)(xorshift() % 700) - 350);
+        check_real_parity(buffer);
+    }
+}
+
+static void test_integer_parsing(void)
+{
+    json_t *json;
+    json_error_t error;
+
+    json = json_loads("[0, -0, 9223372036854775807, -9223372036854775808]", 0, &error);
+    if(!json)
+        fail("unable to decode integers");
+    if(json_integer_value(json_array_get(json, 0)) != 0 ||
+       json_integer_value(json_array_get(json, 1)) != 0)
+        fail("wrong zero value");
+    if(sizeof(json_int_t) == 8) {
+        if(json_integer_value(json_array_get(json, 2)) != INT64_MAX)
+            fail("wrong maximum integer value");
+        if(json_integer_value(json_array_get(json, 3)) != INT64_MIN)
+            fail("wrong minimum integer value");
+    }
+    json_decref(json);
+
+    if(sizeof(json_int_t) == 8) {
+        json = json_loads("[9223372036854775808]", 0, &error);
+        if(json || json_error_code(&error) != json_error_numeric_overflow)
+            fail("decoding a too big integer succeeded");
+
+        json = json_loads("[-9223372036854775809]", 0, &error);
+        if(json || json_error_code(&error) != json_error_numeric_overflow)
+            fail("decoding a too big negative integer succeeded");
+    }
+}
+
+static void test_shared_integers(void)
+{
+    json_error_t error;
+    json_t *array1 = json_loads("[1, 1, -128, 1023, 1024, -129]",
+                                JSON_SHARE_INTEGERS, &error);
+    json_t *array2 = json_loadb("[1]", 3, JSON_SHARE_INTEGERS | JSON_FAST_PARSE,
+                                &error);
+    json_t *unshared = json_loads("[1, 1]", 0, &error);
+    json_t *created = json_integer(1);
+    json_t *small, *large;
+    bos_t *serialized;
+    json_t *deserialized;
+
+    if(!array1 || !array2 || !unshared || !created)
+        fail("unable to create integers");
+
+    /* without the flag, decoded integers are new and can be changed */
+    if(json_array_get(unshared, 0) == json_array_get(unshared, 1) ||
+       json_integer_set(json_array_get(unshared, 0), 2) != 0 ||
+       json_integer_value(json_array_get(unshared, 1)) != 1)
+        fail("decoded integers are shared without JSON_SHARE_INTEGERS");
+
+    small = json_array_get(array1, 0);
+    large = json_array_get(array1, 4);
+
+#if JSON_SMALL_INTEGER_MAX >= JSON_SMALL_INTEGER_MIN
+    if(small != json_array_get(array1, 1) || small != json_array_get(array2, 0))
+        fail("small decoded integers are not shared");
+    if(json_integer_set(small, 2) != -1 || json_integer_value(small) != 1)
+        fail("could set a shared integer");
+#endif
+    if(json_integer_value(json_array_get(array1, 2)) != -128 ||
+       json_integer_value(json_array_get(array1, 3)) != 1023 ||
+       json_integer_value(json_array_get(array1, 5)) != -129)
+        fail("wrong decoded integer value");
+
+    /* shared or not, refcounting works the same */
+    json_decref(json_incref(small));
+
+    if(large == json_array_get(array1, 5) || json_integer_set(large, 2) != 0)
+        fail("large decoded integers are shared");
+
+    /* json_integer() always returns a new integer */
+    if(created == small || json_integer_set(created, 2) != 0 ||
+       json_integer_value(created) != 2)
+        fail("json_integer() returned a shared integer");
+
+    serialized = bos_serialize(array1, &error);
+    deserialized = bos_deserialize_ex(serialized->data, JSON_SHARE_INTEGERS,
+                                      NULL, &error);
+#if JSON_SMALL_INTEGER_MAX >= JSON_SMALL_INTEGER_MIN
+    if(json_array_get(deserialized, 0) != small)
+        fail("small deserialized integers are not shared");
+#endif
+    if(json_integer_value(json_array_get(deserialized, 4)) != 2)
+        fail("wrong deserialized integer value");
+    json_decref(deserialized);
+
+    deserialized = bos_deserialize(serialized->data, &error);
+    if(json_array_get(deserialized, 0) == small ||
+       json_integer_set(json_array_get(deserialized, 0), 2) != 0)
+        fail("deserialized integers are shared without JSON_SHARE_INTEGERS");
+    json_decref(deserialized);
+
+    bos_free(serialized);
+    json_decref(unshared);
+    json_decref(created);
+    json_decref(array2);
+    json_decref(array1);
+}
+
 static void run_tests()
 {
     json_t *integer, *real;
@@ -123,4 +346,7 @@ static void run_tests()
     test_inifity();
 #endif
     test_bad_args();
+    test_shared_integers();
+    test_integer_parsing();
+    test_real_parsing();
 }
@@ -539,6 +539,212 @@ static void test_object_foreach_safe()
     json_decref(object);
 }
 
+static void test_order_after_rehash()
+{
+    const char *key;
+    void *iter, *tmp;
+    json_t *object, *value;
+    char buf[16];
+    int i, expected;
+
+    object = json_object();
+    for(i = 0; i < 1000; i++) {
+        sprintf(buf, "%d", i);
+        json_object_set_new(object, buf, json_integer(i));
+    }
+
+    /* delete the odd keys while iterating, and add as many new ones,
+       which makes the table compact its entries */
+    json_object_foreach_safe(object, tmp, key, value) {
+        i = (int)json_integer_value(value);
+        if(i % 2 && i < 1000) {
+            json_object_del(object, key);
+            sprintf(buf, "%d", i + 1000);
+            json_object_set_new(object, buf, json_integer(i + 1000));
+        }
+    }
+    if(json_object_size(object) != 1000)
+        fail("wrong size after deleting and adding keys");
+
+    expected = 0;
+    json_object_foreach(object, key, value) {
+        if(json_integer_value(value) != expected)
+            fail("insertion order was not preserved");
+        expected += expected == 998 ? 3 : 2;
+    }
+
+    /* an iterator stays valid while its object grows */
+    iter = json_object_iter_at(object, "500");
+    for(i = 2000; i < 3000; i++) {
+        sprintf(buf, "%d", i);
+        json_object_set_new(object, buf, json_integer(i));
+    }
+    if(strcmp(json_object_iter_key(iter), "500") ||
+       json_integer_value(json_object_iter_value(iter)) != 500 ||
+       strcmp(json_object_iter_key(json_object_iter_next(object, iter)), "502"))
+        fail("iterator changed when the object grew");
+
+    for(i = 0; i < 3000; i++) {
+        int present = i < 2000 ? (i < 1000) == !(i % 2) : 1;
+
+        sprintf(buf, "%d", i);
+        if(present != !!json_object_get(object, buf))
+            fail("wrong keys after growing");
+    }
+
+    json_decref(object);
+}
+
+static void test_small_objects()
+{
+    json_t *object;
+    void *iter;
+    char buf[16];
+    int n, i;
+
+    /* around the size where small objects get an index */
+    for(n = 0; n <= 12; n++) {
+        object = json_object();
+        for(i = 0; i < n; i++) {
+            sprintf(buf, "k%d", i);
+            json_object_set_new(object, buf, json_integer(i));
+        }
+
+        /* delete the first key and add it back, many times */
+        for(i = 0; i < 20 && n > 0; i++) {
+            iter = json_object_iter(object);
+            sprintf(buf, "%s", json_object_iter_key(iter));
+            json_object_del(object, buf);
+            json_object_set_new(object, buf, json_integer(i));
+        }
+        if(json_object_size(object) != (size_t)n)
+            fail("small object has the wrong size");
+
+        /* the keys have been rotated 20 times */
+        iter = json_object_iter(object);
+        for(i = 0; i < n; i++) {
+            sprintf(buf, "k%d", (i + 20) % n);
+            if(!iter || strcmp(json_object_iter_key(iter), buf))
+                fail("small object lost the insertion order");
+            if(json_object_get(object, buf) != json_object_iter_value(iter))
+                fail("small object returned the wrong value");
+            iter = json_object_iter_next(object, iter);
+        }
+        if(iter)
+            fail("small object has too many keys");
+
+        if(json_object_get(object, "missing"))
+            fail("small object found a missing key");
+
+        json_decref(object);
+    }
+
+    /* keys and iterators stay valid while the object grows and gets
+       an index, and after keys are deleted */
+    object = json_object();
+    json_object_set_new(object, "first", json_integer(0));
+    json_object_set_new(object, "a somewhat longer key than most", json_integer(1));
+    iter = json_object_iter(object);
+    for(i = 2; i < 40; i++) {
+        sprintf(buf, "k%d", i);
+        json_object_set_new(object, buf, json_integer(i));
+        if(i % 3 == 0)
+            json_object_del(object, buf);
+    }
+    if(strcmp(json_object_iter_key(iter), "first") ||
+       json_object_key_to_iter(json_object_iter_key(iter)) != iter ||
+       json_integer_value(json_object_iter_value(iter)) != 0)
+        fail("small object moved a key");
+
+    iter = json_object_iter_next(object, iter);
+    if(strcmp(json_object_iter_key(iter), "a somewhat longer key than most"))
+        fail("small object lost a long key");
+
+    json_object_clear(object);
+    if(json_object_size(object) != 0 || json_object_iter(object))
+        fail("cleared object has keys");
+    json_object_set_new(object, "again", json_true());
+    if(json_object_get(object, "again") != json_true())
+        fail("cleared object can't be used again");
+
+    json_decref(object);
+}
+
+static void test_key_handles()
+{
+    json_key_t id = json_key_make("id");
+    json_key_t ids = json_key_make("ids");
+    json_key_t bad = json_key_make("\xff");
+    json_key_t none = json_key_make(NULL);
+    json_t *object, *value;
+    char buf[16];
+    int n, i;
+
+    if(id.len != 2 || strcmp(id.key, "id"))
+        fail("json_key_make returned the wrong key");
+    if(bad.key || none.key)
+        fail("json_key_make accepted an invalid key");
+
+    /* a flat object, and one with an index */
+    for(n = 0; n <= 100; n += 100) {
+        object = json_object();
+        for(i = 0; i < n; i++) {
+            sprintf(buf, "i%d", i);
+            json_object_set_new(object, buf, json_integer(i));
+        }
+
+        if(json_object_set_new_k(object, &ids, json_integer(1)))
+            fail("json_object_set_new_k failed");
+        if(json_object_get_k(object, &id))
+            fail("json_object_get_k found a key that is a prefix of another");
+        if(json_object_set_new_k(object, &id, json_integer(2)))
+            fail("json_object_set_new_k failed");
+
+        value = json_object_get_k(object, &id);
+        if(!value || json_integer_value(value) != 2 ||
+           json_object_get(object, "id") != value)
+            fail("json_object_get_k returned the wrong value");
+        if(json_object_get_k(object, &ids) != json_object_get(object, "ids"))
+            fail("json_object_get_k returned the wrong value");
+
+        if(json_object_set_new_k(object, &id, json_integer(3)) ||
+           json_object_size(object) != (size_t)n + 2 ||
+           json_integer_value(json_object_get(object, "id")) != 3)
+            fail("json_object_set_new_k didn't replace the value");
+
+        if(json_object_del_k(object, &id) || json_object_get(object, "id"))
+            fail("json_object_del_k failed");
+        if(!json_object_del_k(object, &id))
+            fail("json_object_del_k deleted a missing key");
+        if(!json_object_get(object, "ids"))
+            fail("json_object_del_k deleted the wrong key");
+
+        json_decref(object);
+    }
+
+    object = json_loads("{\"ids\": 1, \"id\": 2}", JSON_DECODE_LAZY, NULL);
+    value = json_object_get_k(object, &id);
+    if(!value || json_integer_value(value) != 2)
+        fail("json_object_get_k failed on a lazy object");
+    json_decref(object);
+
+    object = json_object();
+    if(json_object_get_k(object, &bad) || json_object_get_k(NULL, &id) ||
+       json_object_get_k(object, NULL))
+        fail("json_object_get_k accepted bad arguments");
+    if(!json_object_set_new_k(object, &bad, json_true()) ||
+       !json_object_set_new_k(object, &none, json_true()) ||
+       !json_object_set_new_k(NULL, &id, json_true()) ||
+       !json_object_set_new_k(object, &id, json_incref(object)) ||
+       !json_object_set_new_k(object, &id, NULL))
+        fail("json_object_set_new_k accepted bad arguments");
+    if(!json_object_del_k(object, &bad) || !json_object_del_k(NULL, &id))
+        fail("json_object_del_k accepted bad arguments");
+    if(json_object_size(object) != 0)
+        fail("bad arguments changed the object");
+    json_decref(object);
+}
+
 static void test_bad_args(void)
 {
     json_t *obj = json_object();
@@ -673,5 +879,8 @@ static void run_tests()
     test_preserve_order();
     test_object_foreach();
     test_object_foreach_safe();
+    test_order_after_rehash();
+    test_small_objects();
+    test_key_handles();
     test_bad_args();
 }
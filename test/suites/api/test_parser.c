@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <bosjansson.h>
+#include <string.h>
+#include "util.h"
+#include "decode_inputs.h"
+
+static size_t chunk;
+
+/* Feed the input in chunks of the given size */
+static json_t *parse_chunked(const char *input, size_t len, size_t flags,
+                             json_error_t *error)
+{
+    json_parser_t *parser;
+    json_t *value;
+    size_t pos;
+
+    parser = json_parser_new(flags);
+    if(!parser)
+        fail("json_parser_new failed");
+
+    for(pos = 0; pos < len; pos += chunk) {
+        size_t n = len - pos < chunk ? len - pos : chunk;
+        if(json_parser_feed(parser, input + pos, n) < 0)
+            break;
+    }
+
+    value = json_parser_result(parser, error);
+    json_parser_free(parser);
+    return value;
+}
+
+static void compare_with_loadb()
+{
+    for(chunk = 1; chunk <= 4; chunk++)
+        check_decode_inputs(parse_chunked);
+
+    chunk = 4096;
+    check_decode_inputs(parse_chunked);
+}
+
+static int feed(json_parser_t *parser, const char *text)
+{
+    return json_parser_feed(parser, text, strlen(text));
+}
+
+static void feed_status()
+{
+    json_parser_t *parser;
+    json_error_t error;
+    json_t *value;
+
+    parser = json_parser_new(0);
+
+    if(feed(parser, "{\"id\": 1, \"method\": \"fo") != 0)
+        fail("json_parser_feed did not ask for more input");
+    if(feed(parser, "o\"}") != 1)
+        fail("json_parser_feed did not report a complete value");
+    if(feed(parser, "\r\n") != 1)
+        fail("json_parser_feed failed on trailing whitespace");
+
+    value = json_parser_result(parser, &error);
+    if(!value || strcmp(json_string_value(json_object_get(value, "method")), "foo"))
+        fail("json_parser_result returned a wrong value");
+    json_decref(value);
+    json_parser_free(parser);
+
+    parser = json_parser_new(0);
+    if(feed(parser, "[1]") != 1)
+        fail("json_parser_feed did not report a complete value");
+    if(feed(parser, " ,") != -1)
+        fail("json_parser_feed accepted data after the value");
+    if(feed(parser, "]") != -1)
+        fail("json_parser_feed did not stay failed");
+
+    value = json_parser_result(parser, &error);
+    if(value)
+        fail("json_parser_result returned a value after an error");
+    if(strcmp(error.source, "<parser>") != 0)
+        fail("json_parser_result returned an invalid error source");
+    if(strcmp(error.text, "end of file expected near ','") != 0)
+        fail("json_parser_result returned an invalid error message");
+    json_parser_free(parser);
+
+    /* Freeing a parser in the middle of a value must not leak */
+    parser = json_parser_new(0);
+    if(feed(parser, "{\"a\": [{\"b\": \"c") != 0)
+        fail("json_parser_feed failed on a partial value");
+    json_parser_free(parser);
+}
+
+static void run_tests()
+{
+    compare_with_loadb();
+    feed_status();
+}
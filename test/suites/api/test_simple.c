@@ -194,6 +194,33 @@ static void run_tests()
 
     json_decref(value);
 
+    /* short strings are stored in the value, longer ones apart */
+    value = json_string("short");
+    if(json_string_set(value, "a string that is too long to be stored inline"))
+        fail("json_string_set failed");
+    if(strcmp(json_string_value(value), "a string that is too long to be stored inline"))
+        fail("invalid string value");
+    if(json_string_set(value, json_string_value(value) + 2))
+        fail("json_string_set failed");
+    if(strcmp(json_string_value(value), "string that is too long to be stored inline"))
+        fail("invalid string value");
+    if(json_string_set(value, "short again"))
+        fail("json_string_set failed");
+    if(strcmp(json_string_value(value), "short again"))
+        fail("invalid string value");
+    json_decref(value);
+
+    value = json_string("exactly15 bytes");
+    if(json_string_set(value, json_string_value(value) + 8))
+        fail("json_string_set failed");
+    if(strcmp(json_string_value(value), "5 bytes") || json_string_length(value) != 7)
+        fail("invalid string value");
+    if(json_string_setn(value, "exactly 16 bytes", 16))
+        fail("json_string_setn failed");
+    if(strcmp(json_string_value(value), "exactly 16 bytes") || json_string_length(value) != 16)
+        fail("invalid string value");
+    json_decref(value);
+
 
     value = json_integer(123);
     if(!value)
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2009-2016 Petri Lehtinen <petri@digip.org>
+ *
+ * Jansson is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "jansson_private_config.h"
+
+#include <bosjansson.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include "util.h"
+
+struct my_source {
+    const char *buf;
+    size_t off;
+    size_t cap;
+    size_t chunk;
+};
+
+/* Hand out the input a few bytes at a time to cross chunk boundaries
+   in the middle of tokens */
+static size_t trickle_reader(void *buf, size_t buflen, void *arg)
+{
+    struct my_source *s = arg;
+    if (buflen > s->chunk)
+        buflen = s->chunk;
+    if (buflen > s->cap - s->off)
+        buflen = s->cap - s->off;
+    memcpy(buf, s->buf + s->off, buflen);
+    s->off += buflen;
+    return buflen;
+}
+
+static const char ndjson[] =
+    "{\"id\": 1, \"name\": \"caf\xc3\xa9\"}\n"
+    "[1, 2.5, true]\n"
+    "\n"
+    "{\"id\": 3}{\"id\": 4}[]  \n";
+
+static void check_values(json_stream_t *stream)
+{
+    json_error_t error;
+    json_t *value, *expected;
+    int i;
+
+    const char *expected_texts[] = {
+        "{\"id\": 1, \"name\": \"caf\xc3\xa9\"}",
+        "[1, 2.5, true]",
+        "{\"id\": 3}",
+        "{\"id\": 4}",
+        "[]"
+    };
+
+    if (!stream)
+        fail("creating a stream failed");
+
+    for (i = 0; i < 5; i++) {
+        value = json_stream_next(stream, &error);
+        if (!value)
+            fail("json_stream_next failed");
+
+        expected = json_loads(expected_texts[i], 0, NULL);
+        if (!json_equal(value, expected))
+            fail("json_stream_next returned a wrong value");
+
+        json_decref(expected);
+        json_decref(value);
+    }
+
+    if (json_stream_eof(stream))
+        fail("json_stream_eof returned true too early");
+
+    if (json_stream_next(stream, &error))
+        fail("json_stream_next returned a value at the end of input");
+
+    if (!json_stream_eof(stream))
+        fail("json_stream_eof returned false at the end of input");
+
+    json_stream_close(stream);
+}
+
+static void stream_callback()
+{
+    struct my_source s;
+    size_t chunk;
+
+    for (chunk = 1; chunk <= 8; chunk++) {
+        s.buf = ndjson;
+        s.off = 0;
+        s.cap = strlen(ndjson);
+        s.chunk = chunk;
+
+        check_values(json_stream_callback(trickle_reader, &s, 0));
+    }
+}
+
+static void stream_file()
+{
+    FILE *fp = tmpfile();
+    if (!fp)
+        fail("tmpfile() failed");
+
+    fputs(ndjson, fp);
+    rewind(fp);
+
+    check_values(json_stream_file(fp, 0));
+    fclose(fp);
+}
+
+static void stream_fd()
+{
+#ifdef HAVE_UNISTD_H
+    int fds[2] = {-1, -1};
+
+    if (pipe(fds))
+        fail("pipe() failed");
+
+    if (write(fds[1], ndjson, strlen(ndjson)) != (ssize_t)strlen(ndjson))
+        fail("write() failed");
+    close(fds[1]);
+
+    check_values(json_stream_fd(fds[0], 0));
+    close(fds[0]);
+#endif
+}
+
+static void stream_scalars()
+{
+    struct my_source s;
+    json_stream_t *stream;
+    json_error_t error;
+    json_t *value;
+    const char text[] = "1 \"two\" 3.5\nnull";
+
+    s.buf = text;
+    s.off = 0;
+    s.cap = strlen(text);
+    s.chunk = 1024;
+
+    stream = json_stream_callback(trickle_reader, &s, 0);
+    value = json_stream_next(stream, &error);
+    if (value)
+        fail("json_stream_next decoded a scalar without JSON_DECODE_ANY");
+    if (json_stream_eof(stream))
+        fail("json_stream_eof returned true after an error");
+    json_stream_close(stream);
+
+    s.off = 0;
+    stream = json_stream_callback(trickle_reader, &s, JSON_DECODE_ANY);
+
+    value = json_stream_next(stream, &error);
+    if (!json_is_integer(value) || json_integer_value(value) != 1)
+        fail("json_stream_next failed to decode an integer");
+    json_decref(value);
+
+    value = json_stream_next(stream, &error);
+    if (!json_is_string(value) || strcmp(json_string_value(value), "two"))
+        fail("json_stream_next failed to decode a string");
+    json_decref(value);
+
+    value = json_stream_next(stream, &error);
+    if (!json_is_real(value) || json_real_value(value) != 3.5)
+        fail("json_stream_next failed to decode a real");
+    json_decref(value);
+
+    value = json_stream_next(stream, &error);
+    if (!json_is_null(value))
+        fail("json_stream_next failed to decode null");
+
+    if (json_stream_next(stream, &error) || !json_stream_eof(stream))
+        fail("json_stream_next failed to detect the end of input");
+
+    json_stream_close(stream);
+}
+
+static void stream_error()
+{
+    struct my_source s;
+    json_stream_t *stream;
+    json_error_t error;
+    json_t *value;
+    const char text[] = "{\"a\": 1}\n{\"b\": 2}\n{\"c\" 3}\n";
+
+    s.buf = text;
+    s.off = 0;
+    s.cap = strlen(text);
+    s.chunk = 1024;
+
+    stream = json_stream_callback(trickle_reader, &s, 0);
+
+    value = json_stream_next(stream, &error);
+    json_decref(value);
+    value = json_stream_next(stream, &error);
+    json_decref(value);
+
+    value = json_stream_next(stream, &error);
+    if (value)
+        fail("json_stream_next decoded invalid input");
+    if (json_stream_eof(stream))
+        fail("json_stream_eof returned true after an error");
+    if (error.line != 3)
+        fail("json_stream_next returned a wrong error line");
+    if (strcmp(error.source, "<callback>") != 0)
+        fail("json_stream_next returned an invalid error source");
+    if (strcmp(error.text, "':' expected near '3'") != 0)
+        fail("json_stream_next returned an invalid error message");
+
+    json_stream_close(stream);
+
+    if (json_stream_callback(NULL, NULL, 0))
+        fail("json_stream_callback succeeded on a NULL callback");
+    if (json_stream_fd(-1, 0))
+        fail("json_stream_fd succeeded on an invalid fd");
+}
+
+static void run_tests()
+{
+    stream_callback();
+    stream_file();
+    stream_fd();
+    stream_scalars();
+    stream_error();
+}
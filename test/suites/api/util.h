@@ -29,6 +29,13 @@
         exit(1);                                                 \
     } while(0)
 
+#define fail_input(msg, input)                                   \
+    do {                                                         \
+        failhdr;                                                 \
+        fprintf(stderr, "%s: '%s'\n", msg, input);               \
+        exit(1);                                                 \
+    } while(0)
+
 /* Assumes json_error_t error */
 #define check_errors(code_, texts_, num_, source_,                      \
     line_, column_, position_)                                          \